@@ -0,0 +1,489 @@
+#include <packer/max_rects.hpp>
+#include <packer/skyline.hpp>
+#include <av/util/packing/guillotine.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace av;
+
+namespace {
+    /** @brief A named way to generate a set of rectangles. */
+    struct distribution {
+        const char *name;
+        std::vector<rect_size> (*generate)(size_t count, int max_side, std::mt19937 &rng);
+    };
+
+    /** @brief Sides uniformly distributed up to the largest side. */
+    std::vector<rect_size> uniform(size_t count, int max_side, std::mt19937 &rng) {
+        std::uniform_int_distribution<int> side(1, max_side);
+
+        std::vector<rect_size> sizes;
+        for(size_t i = 0; i < count; ++i) sizes.push_back({side(rng), side(rng), static_cast<int>(i)});
+        return sizes;
+    }
+
+    /** @brief Sides following a Pareto distribution: mostly small, with a long tail of large ones. */
+    std::vector<rect_size> power_law(size_t count, int max_side, std::mt19937 &rng) {
+        std::uniform_real_distribution<double> unit(0.0, 1.0);
+        auto side = [&]() {
+            double pareto = 4.0 * std::pow(1.0 - unit(rng), -1.0 / 1.5);
+            return std::clamp(static_cast<int>(pareto), 1, max_side);
+        };
+
+        std::vector<rect_size> sizes;
+        for(size_t i = 0; i < count; ++i) sizes.push_back({side(), side(), static_cast<int>(i)});
+        return sizes;
+    }
+
+    /** @brief Long and thin rectangles, half of them tall and half of them wide. */
+    std::vector<rect_size> tall_thin(size_t count, int max_side, std::mt19937 &rng) {
+        std::uniform_int_distribution<int> thin(1, std::max(1, max_side / 16)), length(std::max(1, max_side / 4), max_side);
+
+        std::vector<rect_size> sizes;
+        for(size_t i = 0; i < count; ++i) {
+            int a = thin(rng), b = length(rng);
+            sizes.push_back(i % 2 ? rect_size{b, a, static_cast<int>(i)} : rect_size{a, b, static_cast<int>(i)});
+        }
+
+        return sizes;
+    }
+
+    /**
+     * @brief Glyphs of a few font sizes: heights close to the size, widths around half of it, and many exact
+     * duplicates, as every size rasterizes the same few shapes.
+     */
+    std::vector<rect_size> glyphs(size_t count, int max_side, std::mt19937 &rng) {
+        std::vector<int> font_sizes;
+        for(int size = 8; size <= max_side; size = size * 3 / 2) font_sizes.push_back(size);
+        if(font_sizes.empty()) font_sizes.push_back(max_side);
+
+        std::uniform_int_distribution<size_t> font(0, font_sizes.size() - 1);
+        std::normal_distribution<double> width_ratio(0.55, 0.15), height_ratio(0.9, 0.1);
+
+        std::vector<rect_size> sizes;
+        for(size_t i = 0; i < count; ++i) {
+            int size = font_sizes[font(rng)];
+            int width = std::clamp(static_cast<int>(std::lround(size * width_ratio(rng))), 1, max_side);
+            int height = std::clamp(static_cast<int>(std::lround(size * height_ratio(rng))), 1, max_side);
+            sizes.push_back({width, height, static_cast<int>(i)});
+        }
+
+        return sizes;
+    }
+
+    /**
+     * @brief What a game's sprites tend to look like: mostly power-of-two icons and tiles, some freely sized sprites,
+     * a bit of text, and a few large panels and backgrounds.
+     */
+    std::vector<rect_size> real_world(size_t count, int max_side, std::mt19937 &rng) {
+        std::vector<rect_size> text = glyphs(count, std::max(1, max_side / 4), rng);
+        std::vector<rect_size> sprites = uniform(count, std::max(1, max_side / 2), rng);
+        std::vector<rect_size> large = uniform(count, max_side, rng);
+
+        std::uniform_int_distribution<int> kind(0, 99), icon_power(3, 7);
+        std::vector<rect_size> sizes;
+        for(size_t i = 0; i < count; ++i) {
+            int roll = kind(rng);
+            rect_size size;
+            if(roll < 40) {
+                int side = std::min(1 << icon_power(rng), max_side);
+                size = {side, side};
+            } else if(roll < 75) {
+                size = sprites[i];
+            } else if(roll < 95) {
+                size = text[i];
+            } else {
+                size = large[i];
+            }
+
+            size.id = static_cast<int>(i);
+            sizes.push_back(size);
+        }
+
+        return sizes;
+    }
+
+    /**
+     * @brief Checks the outcome of a batch insertion: every rectangle was either packed once, with its own size or
+     * flipped, or left over, and packed ones lie inside the bin without overlapping each other.
+     *
+     * @return An empty string if the packing is valid, or what's wrong with it.
+     */
+    std::string validate(const std::vector<rect_size> &sizes, const std::vector<rect_size> &left, const std::vector<rect> &placed, const std::vector<int> &ids, int width, int height, double occupancy) {
+        if(placed.size() != ids.size()) return "not every packed rectangle has an id";
+        if(placed.size() + left.size() != sizes.size()) return "rectangles went missing";
+
+        std::vector<bool> seen(sizes.size(), false);
+        for(const rect_size &size : left) {
+            if(size.id < 0 || static_cast<size_t>(size.id) >= sizes.size() || seen[size.id]) return "a leftover rectangle has a bad id";
+            seen[size.id] = true;
+        }
+
+        std::vector<uint8_t> covered(static_cast<size_t>(width) * height, 0);
+        uint64_t area = 0;
+        for(size_t i = 0; i < placed.size(); ++i) {
+            const rect &r = placed[i];
+            int id = ids[i];
+            if(id < 0 || static_cast<size_t>(id) >= sizes.size() || seen[id]) return "a packed rectangle has a bad id";
+            seen[id] = true;
+
+            const rect_size &size = sizes[id];
+            if(!(r.width == size.width && r.height == size.height) && !(r.width == size.height && r.height == size.width)) {
+                return "a packed rectangle changed size";
+            }
+
+            if(r.x < 0 || r.y < 0 || r.x + r.width > width || r.y + r.height > height) return "a packed rectangle is out of the bin";
+
+            for(int y = r.y; y < r.y + r.height; ++y) {
+                uint8_t *row = covered.data() + static_cast<size_t>(y) * width;
+                for(int x = r.x; x < r.x + r.width; ++x) {
+                    if(row[x]) return "packed rectangles overlap";
+                    row[x] = 1;
+                }
+            }
+
+            area += static_cast<uint64_t>(r.width) * r.height;
+        }
+
+        double expected = static_cast<double>(area) / (static_cast<uint64_t>(width) * height);
+        if(std::abs(expected - occupancy) > 1e-9) return "occupancy() is off";
+
+        return "";
+    }
+
+    inline bool same_rect(const rect &a, const rect &b) {
+        return a.x == b.x && a.y == b.y && a.width == b.width && a.height == b.height;
+    }
+
+    /**
+     * @brief `max_rects_bin_pack` as it was before it indexed free rectangles and cached scores: every search scans
+     * the whole free list, and every placement tests every free rectangle. It's the reference the indexed packer
+     * must place exactly like, down to how ties are broken.
+     */
+    class linear_max_rects {
+        public:
+        using heuristic = max_rects_bin_pack::heuristic;
+
+        linear_max_rects(int width, int height): bin_width(width), bin_height(height) {
+            free_rects.push_back({0, 0, width, height});
+        }
+
+        /** @brief Inserts rectangles in batch, always placing the one that scores best next. */
+        void insert(std::vector<rect_size> &rects, std::vector<rect> &dst, std::vector<int> &dst_ids, heuristic method) {
+            while(rects.size() > 0) {
+                int best_score1 = std::numeric_limits<int>::max();
+                int best_score2 = std::numeric_limits<int>::max();
+                int best_index = -1;
+                rect best_node = {};
+
+                for(size_t i = 0; i < rects.size(); ++i) {
+                    int score1, score2;
+                    rect new_node = find_pos(rects[i].width, rects[i].height, method, score1, score2);
+                    if(new_node.height == 0) continue;
+
+                    if(score1 < best_score1 || (score1 == best_score1 && score2 < best_score2)) {
+                        best_score1 = score1;
+                        best_score2 = score2;
+                        best_node = new_node;
+                        best_index = static_cast<int>(i);
+                    }
+                }
+
+                if(best_index == -1) return;
+
+                place(best_node);
+                dst.push_back(best_node);
+                dst_ids.push_back(rects[best_index].id);
+                rects[best_index] = rects.back();
+                rects.pop_back();
+            }
+        }
+
+        /** @brief Inserts a single rectangle, returning an empty `rect` if it doesn't fit. */
+        rect insert(int width, int height, heuristic method) {
+            int score1, score2;
+            rect new_node = find_pos(width, height, method, score1, score2);
+            if(new_node.height != 0) place(new_node);
+
+            return new_node;
+        }
+
+        private:
+        int bin_width;
+        int bin_height;
+
+        std::vector<rect> used_rects;
+        std::vector<rect> free_rects;
+        std::vector<rect> new_free_rects;
+        size_t new_free_rects_last_size = 0;
+
+        /** @brief Scores a position, the primary score first; lower is better. */
+        void score(const rect &free, int width, int height, heuristic method, int &score1, int &score2) const {
+            int leftover_hor = free.width - width, leftover_ver = free.height - height;
+            switch(method) {
+                case heuristic::best_short_side_fit:
+                    score1 = std::min(leftover_hor, leftover_ver);
+                    score2 = std::max(leftover_hor, leftover_ver);
+                    break;
+
+                case heuristic::best_long_side_fit:
+                    score1 = std::max(leftover_hor, leftover_ver);
+                    score2 = std::min(leftover_hor, leftover_ver);
+                    break;
+
+                case heuristic::best_area_fit:
+                    score1 = free.width * free.height - width * height;
+                    score2 = std::min(leftover_hor, leftover_ver);
+                    break;
+
+                case heuristic::bottom_left_rule:
+                    score1 = free.y + height;
+                    score2 = free.x;
+                    break;
+
+                case heuristic::contact_point_rule: {
+                    int contact = 0;
+                    if(free.x == 0 || free.x + width == bin_width) contact += height;
+                    if(free.y == 0 || free.y + height == bin_height) contact += width;
+
+                    for(const rect &r : used_rects) {
+                        if(r.x == free.x + width || r.x + r.width == free.x) contact += common_length(r.y, r.y + r.height, free.y, free.y + height);
+                        if(r.y == free.y + height || r.y + r.height == free.y) contact += common_length(r.x, r.x + r.width, free.x, free.x + width);
+                    }
+
+                    score1 = -contact;
+                    score2 = 0;
+                } break;
+            }
+        }
+
+        /** @brief Finds the best position, the first one found among equally scored ones. */
+        rect find_pos(int width, int height, heuristic method, int &best_score1, int &best_score2) const {
+            rect best_node = {};
+            best_score1 = std::numeric_limits<int>::max();
+            best_score2 = std::numeric_limits<int>::max();
+
+            auto visit = [&](const rect &free, int w, int h) {
+                if(free.width < w || free.height < h) return;
+
+                int score1, score2;
+                score(free, w, h, method, score1, score2);
+                if(score1 < best_score1 || (score1 == best_score1 && score2 < best_score2)) {
+                    best_node = {free.x, free.y, w, h};
+                    best_score1 = score1;
+                    best_score2 = score2;
+                }
+            };
+
+            for(const rect &free : free_rects) {
+                visit(free, width, height);
+                visit(free, height, width);
+            }
+
+            return best_node;
+        }
+
+        void place(const rect &node) {
+            for(size_t i = 0; i < free_rects.size();) {
+                if(split_free_node(free_rects[i], node)) {
+                    free_rects[i] = free_rects.back();
+                    free_rects.pop_back();
+                } else {
+                    ++i;
+                }
+            }
+
+            for(const rect &old : free_rects) {
+                for(size_t j = 0; j < new_free_rects.size();) {
+                    if(new_free_rects[j].contained_in(old)) {
+                        new_free_rects[j] = new_free_rects.back();
+                        new_free_rects.pop_back();
+                    } else {
+                        ++j;
+                    }
+                }
+            }
+
+            free_rects.insert(free_rects.end(), new_free_rects.begin(), new_free_rects.end());
+            new_free_rects.clear();
+            used_rects.push_back(node);
+        }
+
+        void insert_new(const rect &new_rect) {
+            for(size_t i = 0; i < new_free_rects_last_size;) {
+                if(new_rect.contained_in(new_free_rects[i])) return;
+
+                if(new_free_rects[i].contained_in(new_rect)) {
+                    new_free_rects[i] = new_free_rects[--new_free_rects_last_size];
+                    new_free_rects[new_free_rects_last_size] = new_free_rects.back();
+                    new_free_rects.pop_back();
+                } else {
+                    ++i;
+                }
+            }
+
+            new_free_rects.push_back(new_rect);
+        }
+
+        bool split_free_node(const rect &free, const rect &used) {
+            if(
+                used.x >= free.x + free.width || used.x + used.width <= free.x ||
+                used.y >= free.y + free.height || used.y + used.height <= free.y
+            ) return false;
+
+            new_free_rects_last_size = new_free_rects.size();
+
+            // Above, below, left and right of the used rectangle, in that order.
+            if(used.y > free.y) insert_new({free.x, free.y, free.width, used.y - free.y});
+            if(used.y + used.height < free.y + free.height) insert_new({free.x, used.y + used.height, free.width, free.y + free.height - (used.y + used.height)});
+            if(used.x > free.x) insert_new({free.x, free.y, used.x - free.x, free.height});
+            if(used.x + used.width < free.x + free.width) insert_new({used.x + used.width, free.y, free.x + free.width - (used.x + used.width), free.height});
+
+            return true;
+        }
+    };
+
+    /**
+     * @brief Packs a set of rectangles with every heuristic of `max_rects_bin_pack` and `linear_max_rects`, both in
+     * batch and one at a time, printing a row for each heuristic.
+     */
+    template<size_t T_count>
+    bool compare_linear(const char *distribution, const char *const (&names)[T_count], const std::vector<rect_size> &sizes, int size) {
+        static_assert(T_count == std::size(max_rects_bin_pack::heuristics), "Every heuristic needs a name.");
+
+        bool same = true;
+        for(size_t i = 0; i < T_count; ++i) {
+            max_rects_bin_pack::heuristic method = max_rects_bin_pack::heuristics[i];
+
+            std::vector<rect_size> left = sizes, linear_left = sizes;
+            std::vector<rect> placed, linear_placed;
+            std::vector<int> ids, linear_ids;
+
+            max_rects_bin_pack bin(size, size, true);
+            linear_max_rects linear(size, size);
+            bin.insert(left, placed, ids, method);
+            linear.insert(linear_left, linear_placed, linear_ids, method);
+
+            bool batch = ids == linear_ids && std::equal(placed.begin(), placed.end(), linear_placed.begin(), linear_placed.end(), same_rect);
+
+            bool single = true;
+            bin.init(size, size, true);
+            linear = linear_max_rects(size, size);
+            for(const rect_size &r : sizes) single = single && same_rect(bin.insert(r.width, r.height, method), linear.insert(r.width, r.height, method));
+
+            std::printf("%-12s %-12s %-14s %8zu %s\n",
+                distribution, "linear", names[i], sizes.size(), batch && single ? "same" : !batch ? "batch insert differs" : "single insert differs"
+            );
+
+            same = same && batch && single;
+        }
+
+        return same;
+    }
+
+    /** @brief The side of a square bin with as much area as the given rectangles, but at least `max_side`. */
+    int bin_size(const std::vector<rect_size> &sizes, int max_side) {
+        uint64_t area = 0;
+        for(const rect_size &r : sizes) area += static_cast<uint64_t>(r.width) * r.height;
+
+        return std::max(static_cast<int>(std::ceil(std::sqrt(static_cast<double>(area)))), max_side);
+    }
+
+    /** @brief Whether every packing was valid so far. */
+    bool all_valid = true;
+
+    /** @brief Packs a set of rectangles with every heuristic of a bin, printing a row for each. */
+    template<typename T_bin, size_t T_count>
+    void run(const char *distribution, const char *packer, const char *const (&names)[T_count], const std::vector<rect_size> &sizes, int size) {
+        static_assert(T_count == std::size(T_bin::heuristics), "Every heuristic needs a name.");
+
+        for(size_t i = 0; i < T_count; ++i) {
+            std::vector<rect_size> left = sizes;
+            std::vector<rect> placed;
+            std::vector<int> ids;
+
+            T_bin bin(size, size, true);
+            auto start = std::chrono::steady_clock::now();
+            bin.insert(left, placed, ids, T_bin::heuristics[i]);
+            auto end = std::chrono::steady_clock::now();
+
+            std::string error = validate(sizes, left, placed, ids, size, size, bin.occupancy());
+            if(!error.empty()) all_valid = false;
+
+            std::printf("%-12s %-12s %-14s %8zu %9.2f%% %10.1f  %s\n",
+                distribution, packer, names[i], placed.size(), bin.occupancy() * 100.0,
+                std::chrono::duration<double, std::milli>(end - start).count(), error.empty() ? "ok" : error.c_str()
+            );
+        }
+    }
+}
+
+/**
+ * Packs reproducible sets of rectangles drawn from several distributions with every heuristic of every bin packing
+ * algorithm, timing the batch insertion and reporting the occupancy. Each set goes in a square bin with as much area as
+ * the rectangles combined, so a perfect packing would fit them all and fill it. Every packing is validated, and the
+ * exit code is nonzero if any of them wasn't, so this doubles as a check for packer changes. `max_rects_bin_pack` is
+ * also checked to place the first few rectangles of every set exactly like a plain linear scan over its free list.
+ *
+ * Usage: pack_bench [count] [max-side] [seed]
+ */
+int main(int argc, char *argv[]) {
+    long count = argc > 1 ? std::atol(argv[1]) : 2000;
+    int max_side = argc > 2 ? std::atoi(argv[2]) : 128;
+    unsigned long seed = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 1234;
+    if(count <= 0 || max_side <= 0) {
+        std::fprintf(stderr, "Invalid arguments.\n");
+        return 1;
+    }
+
+    static constexpr distribution distributions[] = {
+        {"uniform", uniform},
+        {"power-law", power_law},
+        {"tall-thin", tall_thin},
+        {"glyphs", glyphs},
+        {"real-world", real_world}
+    };
+
+    static constexpr const char *max_rects_names[] = {"short-side", "long-side", "area", "bottom-left", "contact-point"};
+    static constexpr const char *skyline_names[] = {"bottom-left", "min-waste"};
+    static constexpr const char *guillotine_names[] = {"short-side", "long-side", "area"};
+    static constexpr size_t linear_count = 500;
+
+    std::printf("%ld rectangles up to %d wide, seed %lu.\n\n", count, max_side, seed);
+    std::printf("%-12s %-12s %-14s %8s %10s %10s\n", "set", "packer", "heuristic", "packed", "occupancy", "ms");
+
+    for(const distribution &d : distributions) {
+        // Every set is generated from its own seed, so that it doesn't depend on which sets came before it.
+        std::mt19937 rng(seed);
+        std::vector<rect_size> sizes = d.generate(static_cast<size_t>(count), max_side, rng);
+
+        int size = bin_size(sizes, max_side);
+        std::printf("\n%s: %dx%d\n", d.name, size, size);
+
+        run<max_rects_bin_pack>(d.name, "max-rects", max_rects_names, sizes, size);
+
+        // The linear scan takes quadratic time, so it only packs the first few rectangles.
+        std::vector<rect_size> first(sizes.begin(), sizes.begin() + std::min<size_t>(sizes.size(), linear_count));
+        if(!compare_linear(d.name, max_rects_names, first, bin_size(first, max_side))) all_valid = false;
+
+        run<skyline_bin_pack>(d.name, "skyline", skyline_names, sizes, size);
+        run<guillotine_bin_pack>(d.name, "guillotine", guillotine_names, sizes, size);
+    }
+
+    if(!all_valid) {
+        std::fprintf(stderr, "\nSome packings were invalid.\n");
+        return 1;
+    }
+
+    return 0;
+}
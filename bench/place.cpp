@@ -0,0 +1,82 @@
+#include <packer/max_rects.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using namespace av;
+
+namespace {
+    /** @brief Lays out randomly sized rectangles in rows until the bin is full, so none of them overlap. */
+    std::vector<rect> shelves(int size, int max_side, std::mt19937 &rng) {
+        std::uniform_int_distribution<int> side(1, max_side);
+
+        std::vector<rect> rects;
+        for(int y = 0; y + max_side <= size; y += max_side) {
+            for(int x = 0;;) {
+                rect r = {x, y, side(rng), side(rng)};
+                if(x + r.width > size) break;
+
+                rects.push_back(r);
+                x += r.width;
+            }
+        }
+
+        return rects;
+    }
+}
+
+/**
+ * Measures how `max_rects_bin_pack::place()` scales with the size of the free list. Rectangles are placed in random
+ * order so the free space gets as fragmented as it does while packing, and every placement is timed along with the
+ * free list size it started with.
+ *
+ * Usage: place_bench [bin-size] [max-side]
+ */
+int main(int argc, char *argv[]) {
+    int size = argc > 1 ? std::atoi(argv[1]) : 4096;
+    int max_side = argc > 2 ? std::atoi(argv[2]) : 24;
+    if(size <= 0 || max_side <= 0 || max_side > size) {
+        std::fprintf(stderr, "Invalid arguments.\n");
+        return 1;
+    }
+
+    std::mt19937 rng(1234);
+    std::vector<rect> rects = shelves(size, max_side, rng);
+    std::shuffle(rects.begin(), rects.end(), rng);
+
+    // Placements are grouped by the binary logarithm of the free list size.
+    static constexpr int groups = 32;
+    double total_ns[groups] = {};
+    size_t counts[groups] = {};
+
+    max_rects_bin_pack bin(size, size, false);
+    for(const rect &r : rects) {
+        size_t free_count = bin.get_free_rects().size();
+
+        auto start = std::chrono::steady_clock::now();
+        bin.place(r);
+        auto end = std::chrono::steady_clock::now();
+
+        int group = 0;
+        while((size_t(2) << group) <= free_count) ++group;
+
+        total_ns[group] += std::chrono::duration<double, std::nano>(end - start).count();
+        ++counts[group];
+    }
+
+    std::printf("Placed %zu rectangles in %dx%d, %.2f%% occupancy.\n\n", rects.size(), size, size, bin.occupancy() * 100.0);
+    std::printf("%16s %10s %12s\n", "free rects", "places", "ns/place");
+    for(int group = 0; group < groups; ++group) {
+        if(!counts[group]) continue;
+
+        char range[32];
+        std::snprintf(range, sizeof(range), "%zu-%zu", size_t(1) << group, (size_t(2) << group) - 1);
+        std::printf("%16s %10zu %12.0f\n", range, counts[group], total_ns[group] / counts[group]);
+    }
+
+    return 0;
+}
@@ -0,0 +1,128 @@
+#ifndef AV_CORE_GRAPHICS_ATLAS_HPP
+#define AV_CORE_GRAPHICS_ATLAS_HPP
+
+#include <glad/glad.h>
+#include <av/util/graphics/atlas_file.hpp>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace av {
+    /**
+     * @brief A binary atlas file written by the packer, memory-mapped and uploaded as one OpenGL texture per page. The
+     * pixels are handed to OpenGL straight from the mapping, and the mapping stays alive for region lookups, which
+     * neither copy nor allocate. Block compressed pages are uploaded as they are if the driver supports their format,
+     * and decoded to 8-bit RGBA first otherwise. Single channel pages, e.g. of signed distance fields, are sampled from
+     * the red channel. Indexed pages are uploaded as their indices, in the red channel, next to a 256 by 1 texture of
+     * their palette; both are sampled with nearest filtering, since indices can't be blended, and `palette_function`
+     * turns them back into colors in a shader.
+     *
+     * The pages of an atlas packed with `--array` are instead uploaded as the layers of one `GL_TEXTURE_2D_ARRAY`, in
+     * one allocation per mip level, so that sprites of every page can be drawn in one call: the layer of a region is
+     * its page index, passed to shaders e.g. as a `vert_attribute::layer` attribute. The palettes of indexed layers are
+     * then the rows of one texture, which `array_palette_function` looks up.
+     */
+    class atlas {
+        /** @brief The mapped file, or `nullptr` if the atlas is empty. */
+        void *mapping;
+        /** @brief The size of `mapping`, in bytes. */
+        size_t mapping_size;
+#ifdef _WIN32
+        /** @brief The file mapping object backing `mapping`. */
+        void *mapping_handle;
+#endif
+        /** @brief The validated contents of `mapping`. */
+        atlas_view view;
+        /** @brief `GL_TEXTURE_2D`, or `GL_TEXTURE_2D_ARRAY` if the pages are the layers of one texture array. */
+        GLenum target;
+        /** @brief The handles to the OpenGL textures, one per page, or only one for a texture array. */
+        std::vector<unsigned int> textures;
+        /** @brief The handles to the OpenGL palette textures, laid out as `textures`, `0` where pages aren't indexed. */
+        std::vector<unsigned int> palettes;
+
+        public:
+        /**
+         * @brief GLSL source of `vec4 av_palette_sample(sampler2D page, sampler2D palette, vec2 uv)`, which looks the
+         * index of an indexed page up in its palette, to paste into fragment shaders before their `main()`.
+         */
+        static constexpr const char *palette_function =
+            "vec4 av_palette_sample(sampler2D page, sampler2D palette, vec2 uv) {\n"
+            "    return texelFetch(palette, ivec2(int(texture(page, uv).r * 255.0 + 0.5), 0), 0);\n"
+            "}\n";
+        /**
+         * @brief GLSL source of `vec4 av_array_palette_sample(sampler2DArray pages, sampler2D palettes, vec3 uv)`, the
+         * same for a texture array atlas, where the third coordinate is the layer.
+         */
+        static constexpr const char *array_palette_function =
+            "vec4 av_array_palette_sample(sampler2DArray pages, sampler2D palettes, vec3 uv) {\n"
+            "    return texelFetch(palettes, ivec2(int(texture(pages, uv).r * 255.0 + 0.5), int(uv.z + 0.5)), 0);\n"
+            "}\n";
+
+        atlas(const atlas &) = delete;
+        /**
+         * @brief Maps an atlas file and uploads its pages, with their mip levels if it has any. An exception is thrown
+         * if the file couldn't be mapped or isn't a valid atlas.
+         *
+         * @param path The atlas file path.
+         */
+        atlas(const std::string &path);
+        /** @brief Destroys the page and palette textures and unmaps the file. */
+        ~atlas();
+
+        /** @return The mapped file contents, e.g. to iterate over every region. */
+        inline const atlas_view &get_view() const {
+            return view;
+        }
+
+        /** @return How many pages this atlas has. */
+        inline size_t get_page_count() const {
+            return view.page_count();
+        }
+
+        /** @return `GL_TEXTURE_2D`, or `GL_TEXTURE_2D_ARRAY` if the pages are the layers of one texture array. */
+        inline GLenum get_target() const {
+            return target;
+        }
+
+        /** @return The handle to the OpenGL texture of a page, the same for every page of a texture array. */
+        inline unsigned int get_texture(size_t page) const {
+            return textures[target == GL_TEXTURE_2D_ARRAY ? 0 : page];
+        }
+
+        /** @return The handle to the OpenGL palette texture of a page, or `0` if it isn't indexed. */
+        inline unsigned int get_palette(size_t page) const {
+            return palettes[target == GL_TEXTURE_2D_ARRAY ? 0 : page];
+        }
+
+        /**
+         * @brief Binds the texture of a page to a texture unit, and its palette, if it has one, to the unit after it,
+         * as `av_palette_sample()` and `av_array_palette_sample()` take them. Leaves the given unit active. Binding any
+         * page of a texture array binds all of them.
+         *
+         * @param page The page index.
+         * @param unit The texture unit, from `0`.
+         */
+        inline void bind(size_t page, unsigned int unit = 0) const {
+            if(unsigned int palette = get_palette(page)) {
+                glActiveTexture(GL_TEXTURE0 + unit + 1);
+                glBindTexture(GL_TEXTURE_2D, palette);
+            }
+
+            glActiveTexture(GL_TEXTURE0 + unit);
+            glBindTexture(target, get_texture(page));
+        }
+
+        /**
+         * @brief Looks a region up by name, in constant time and without allocating.
+         *
+         * @param name The region name, i.e. the sprite file path relative to its input directory, without extension.
+         * @return The region, or `nullptr` if there is none with that name.
+         */
+        inline const atlas_region *find(std::string_view name) const {
+            return view.find(name);
+        }
+    };
+}
+
+#endif // !AV_CORE_GRAPHICS_ATLAS_HPP
@@ -0,0 +1,203 @@
+#ifndef AV_CORE_GRAPHICS_DYNAMICATLAS_HPP
+#define AV_CORE_GRAPHICS_DYNAMICATLAS_HPP
+
+#include <glad/glad.h>
+#include <av/util/packing/guillotine.hpp>
+#include <av/util/packing/rect.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+
+namespace av {
+    class thread_pool;
+
+    /**
+     * @brief An RGBA texture that regions are packed into and taken out of at runtime, for content whose set keeps
+     * changing, such as glyphs. Drawing everything from one texture instead of one per region saves a texture bind per
+     * region.
+     *
+     * Regions are referred to by handles, which stay valid until the region is removed or evicted. When a region
+     * doesn't fit, the least recently used ones are evicted until it does, except for regions used in the current frame,
+     * which may still be waiting to be drawn. Evicting leaves holes that only merge with their neighbours when they share
+     * a whole edge, so `defragment()` repacks every region into a fresh texture now and then.
+     *
+     * Every function must be called on the thread owning the OpenGL context.
+     */
+    class dynamic_atlas {
+        public:
+        /** @brief Refers to a region. `0` never refers to one. */
+        using handle = uint64_t;
+
+        private:
+        /** @brief Marks the end of the recency list, or a region that isn't in it. */
+        static constexpr uint32_t npos = std::numeric_limits<uint32_t>::max();
+
+        /** @brief A slot in the region table, which either holds a region or is free to hold the next one. */
+        struct region {
+            /** @brief Where the pixels are, without the padding. */
+            rect area;
+            /** @brief The frame this region was last used in. */
+            uint64_t last_used;
+            /** @brief Bumped every time the slot is freed, so that handles to what was there before go stale. */
+            uint32_t version;
+            /** @brief The neighbouring regions in the recency list, more and less recently used respectively. */
+            uint32_t newer, older;
+            bool live;
+        };
+
+        /** @brief A repacking of every region, computed on another thread by `defragment()`. */
+        struct defrag_job {
+            /** @brief The padded size of every region, with its slot as id. */
+            std::vector<rect_size> sizes;
+            /** @brief The version of every slot in `sizes` at the time. */
+            std::vector<uint32_t> versions;
+            /** @brief The fresh bin, with every region packed that fit. */
+            guillotine_bin_pack bin;
+            /** @brief Where each packed region went, and the slot it came from. */
+            std::vector<rect> placed;
+            std::vector<int> ids;
+            std::atomic<bool> done{false};
+        };
+
+        int width, height, padding;
+        /** @brief The handle to the OpenGL texture. */
+        unsigned int texture;
+        guillotine_bin_pack bin;
+
+        /** @brief The region table, indexed by the lower half of a handle. */
+        std::vector<region> regions;
+        /** @brief The slots of `regions` that are free. */
+        std::vector<uint32_t> free_slots;
+        /** @brief The most and least recently used regions. */
+        uint32_t newest, oldest;
+        size_t live_count;
+
+        uint64_t frame;
+        /** @brief Bumped whenever regions move to a new texture. */
+        uint64_t generation;
+        /** @brief The padded pixels of the region being uploaded. Kept around to avoid allocating for every region. */
+        std::vector<uint8_t> staging;
+        /** @brief The repacking in progress, or `nullptr` if there is none. */
+        std::shared_ptr<defrag_job> job;
+
+        /** @return The slot a handle refers to, or `npos` if the handle is stale. */
+        uint32_t slot_of(handle region_handle) const;
+        /** @return The placement of a region in `bin`, with its padding. */
+        rect padded(const rect &area) const;
+
+        /** @brief Unlinks a region from the recency list. */
+        void unlink(uint32_t slot);
+        /** @brief Links an unlinked region in as the most recently used one. */
+        void link_newest(uint32_t slot);
+        /** @brief Removes a live region, giving its space back to `bin` and its slot to `free_slots`. */
+        void release(uint32_t slot);
+        /**
+         * @brief Moves every region to where `job` packed it, copying the pixels into a new texture.
+         * @return Whether every region fit in the repacking; if not, nothing changes.
+         */
+        bool apply_defrag();
+
+        public:
+        dynamic_atlas(const dynamic_atlas &) = delete;
+        /**
+         * @brief Creates the texture, with undefined contents.
+         *
+         * @param width   The texture width.
+         * @param height  The texture height.
+         * @param padding The border around every region, filled by extruding its edges so that linear filtering at the
+         *                edges doesn't pick up neighbouring regions.
+         */
+        dynamic_atlas(int width, int height, int padding = 1);
+        /** @brief Destroys the texture. A repacking in progress finishes on its own and is thrown away. */
+        ~dynamic_atlas();
+
+        /**
+         * @brief Packs a region and uploads its pixels with `glTexSubImage2D()`, evicting the least recently used
+         * regions if there isn't enough room. The new region counts as used in the current frame.
+         *
+         * @param width  The region width.
+         * @param height The region height.
+         * @param pixels The region pixels, as tightly packed RGBA rows.
+         * @return The handle to the region, or `0` if it doesn't fit even with every region not used in the current
+         *         frame evicted.
+         */
+        handle insert(int width, int height, const uint8_t *pixels);
+
+        /**
+         * @brief Removes a region, giving its space back. Does nothing if the handle is stale.
+         * @param region_handle The region.
+         */
+        void remove(handle region_handle);
+
+        /**
+         * @brief Looks a region up and marks it as used in the current frame, so it won't be evicted before the next
+         * one.
+         *
+         * @param region_handle The region.
+         * @return Where the region is in the texture, or `nullptr` if the handle is stale, in which case the region has
+         *         to be inserted again. Stays valid until the next call to `insert()` or `update()`.
+         */
+        const rect *use(handle region_handle);
+
+        /** @return Whether a handle still refers to a region. */
+        inline bool contains(handle region_handle) const {
+            return slot_of(region_handle) != npos;
+        }
+
+        /**
+         * @brief Starts repacking every region into a fresh bin on a thread of the given pool. Does nothing if a
+         * repacking is already in progress. `update()` picks the result up once it's done.
+         *
+         * @param pool The pool to repack on, which must outlive the repacking but not necessarily this atlas.
+         */
+        void defragment(thread_pool &pool);
+
+        /** @return Whether a repacking started by `defragment()` hasn't been picked up yet. */
+        inline bool is_defragmenting() const {
+            return job != nullptr;
+        }
+
+        /**
+         * @brief Moves on to the next frame; must be called once every frame. If a repacking is done, every region is
+         * moved to where it was repacked in a new texture, with `glBlitFramebuffer()`. The region table serves as the
+         * remap table: handles stay valid, but their regions, the texture handle and `get_generation()` change. The
+         * repacking is dropped if the regions inserted since don't fit around it.
+         */
+        void update();
+
+        /** @return The handle to the OpenGL texture, which changes when a repacking is applied. */
+        inline unsigned int get_texture() const {
+            return texture;
+        }
+
+        /** @return A number that changes whenever regions move, e.g. to know when to rebuild cached texture coordinates. */
+        inline uint64_t get_generation() const {
+            return generation;
+        }
+
+        /** @return The texture width. */
+        inline int get_width() const {
+            return width;
+        }
+
+        /** @return The texture height. */
+        inline int get_height() const {
+            return height;
+        }
+
+        /** @return How many regions there are. */
+        inline size_t get_region_count() const {
+            return live_count;
+        }
+
+        /** @return The ratio of the area taken by regions, with their padding, to the texture area. */
+        inline double occupancy() const {
+            return bin.occupancy();
+        }
+    };
+}
+
+#endif // !AV_CORE_GRAPHICS_DYNAMICATLAS_HPP
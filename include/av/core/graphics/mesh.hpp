@@ -4,7 +4,11 @@
 #include <glad/glad.h>
 #include <av/core/graphics/shader.hpp>
 
+#include <array>
+#include <cstddef>
 #include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace av {
@@ -16,6 +20,8 @@ namespace av {
         static const vert_attribute color;
         /** @brief 4 `unsigned char` components; alpha, blue, green, and red. Can be packed into a single float value. */
         static const vert_attribute color_packed;
+        /** @brief 1 `float` component; the texture array layer, i.e. atlas page, to sample. */
+        static const vert_attribute layer;
 
         /** @brief How many components this attribute has. Affects `size`. */
         int components;
@@ -78,19 +84,112 @@ namespace av {
     };
 
     /**
-     * @brief A mesh is a non copy-constructible class holding a state of a vertex buffer object and an element buffer
-     * object in order to draw objects on an OpenGL surface.
-     * 
-     * Optionally holding a non-empty element buffer, a mesh can be rendered by invoking
-     * `render(const shader &, int, size_t, size_t, bool)`, which, of course, requires the mesh's vertices to be set
-     * first. The element buffer can be used to reduce the amount of memory required for the vertices, preventing the
-     * same vertices to be defined twice.
+     * @brief A vertex attribute known at compile time, as `layout` takes them. Every attribute type derives from one and
+     * adds the `name` it goes by in shaders, like the `attr` types below.
+     *
+     * @tparam T_components How many components the attribute has.
+     * @tparam T_type       The component type, one of those `vert_attribute::type` may be.
+     * @tparam T_normalized Whether integer components are normalized.
      */
-    class mesh {
-        /** @brief How many bytes each vertex take. Determined by given vertex attributes. */
+    template<int T_components, int T_type, bool T_normalized = false>
+    struct static_attribute {
+        static constexpr int components = T_components;
+        static constexpr int type = T_type;
+        static constexpr bool normalized = T_normalized;
+        /** @brief How many bytes the attribute takes per vertex. */
+        static constexpr int size = T_components * (
+            T_type == GL_BYTE || T_type == GL_UNSIGNED_BYTE ? sizeof(char) :
+            T_type == GL_SHORT || T_type == GL_UNSIGNED_SHORT ? sizeof(short) :
+            T_type == GL_INT || T_type == GL_UNSIGNED_INT ? sizeof(int) :
+            T_type == GL_FLOAT ? sizeof(float) : 0);
+
+        static_assert(size > 0, "Invalid vertex attribute type.");
+    };
+
+    /** @brief The compile-time counterparts of the `vert_attribute` constants. */
+    namespace attr {
+        struct pos_2D: static_attribute<2, GL_FLOAT> {
+            static constexpr const char *name = "a_pos";
+        };
+
+        struct color: static_attribute<4, GL_FLOAT> {
+            static constexpr const char *name = "a_col";
+        };
+
+        struct color_packed: static_attribute<4, GL_UNSIGNED_BYTE, true> {
+            static constexpr const char *name = "a_col";
+        };
+
+        struct layer: static_attribute<1, GL_FLOAT> {
+            static constexpr const char *name = "a_layer";
+        };
+    }
+
+    /**
+     * @brief A vertex layout known at compile time, i.e. a list of `static_attribute` types, laid out one after another
+     * without padding. The stride, offsets and types are all `constexpr`, so binding it is a fixed sequence of OpenGL
+     * calls.
+     *
+     * @tparam T_attributes The attribute types, in the order they are laid out in.
+     */
+    template<typename... T_attributes>
+    struct layout {
+        /** @brief How many attributes there are. */
+        static constexpr size_t count = sizeof...(T_attributes);
+        /** @brief How many bytes each vertex takes. */
+        static constexpr size_t stride = (static_cast<size_t>(T_attributes::size) + ... + 0);
+        /** @brief Where each attribute starts in a vertex, in bytes. */
+        static constexpr std::array<size_t, count> offsets = [] {
+            std::array<size_t, count> offsets = {};
+            size_t sizes[] = {static_cast<size_t>(T_attributes::size)..., 0}, offset = 0;
+            for(size_t i = 0; i < count; ++i) {
+                offsets[i] = offset;
+                offset += sizes[i];
+            }
+
+            return offsets;
+        }();
+
+        /**
+         * @brief Whether a vertex type can be uploaded as this layout as is: it must be as large as a vertex, so that
+         * it has no padding, and be copyable byte by byte. Its members should go in the same order as the attributes.
+         */
+        template<typename T_vertex>
+        static constexpr bool fits = sizeof(T_vertex) == stride && std::is_trivially_copyable_v<T_vertex> && std::is_standard_layout_v<T_vertex>;
+
+        /** @brief Binds and enables every attribute to the given shader, for the bound vertex buffer. */
+        static void bind(const shader &program) {
+            bind_each(program, std::index_sequence_for<T_attributes...>());
+        }
+
+        /** @brief Disables every attribute of the given shader. */
+        static void unbind(const shader &program) {
+            (glDisableVertexAttribArray(program.attribute_loc(T_attributes::name)), ...);
+        }
+
+        private:
+        template<size_t... T_indices>
+        static void bind_each(const shader &program, std::index_sequence<T_indices...>) {
+            (bind_attribute<T_attributes, offsets[T_indices]>(program), ...);
+        }
+
+        template<typename T_attribute, size_t T_offset>
+        static void bind_attribute(const shader &program) {
+            unsigned int loc = program.attribute_loc(T_attribute::name);
+
+            glEnableVertexAttribArray(loc);
+            glVertexAttribPointer(loc, T_attribute::components, T_attribute::type, T_attribute::normalized, stride, reinterpret_cast<void*>(T_offset));
+        }
+    };
+
+    /**
+     * @brief The vertex buffer object and element buffer object of a mesh, and how much of them is filled, shared by
+     * every kind of `mesh`.
+     */
+    class mesh_buffers {
+        protected:
+        /** @brief How many bytes each vertex take. Determined by the vertex attributes. */
         size_t vertex_size;
-        /** @brief Lists an attribute each vertex has. */
-        std::vector<vert_attribute> attributes;
 
         /** @brief How many vertices this mesh currently holds. */
         size_t max_vertices;
@@ -104,19 +203,18 @@ namespace av {
         /** @brief The handle to the generated OpenGL element buffer object. */
         unsigned int element_buffer;
 
-        public:
-        mesh(const mesh &) = delete;
+        /** @brief Generates empty buffers for vertices of the given size. */
+        mesh_buffers(size_t vertex_size);
+        /** Destroys the buffers, freeing the OpenGL resources they hold. */
+        ~mesh_buffers();
+
         /**
-         * @brief Constructs an empty mesh with given vertex attributes. These attributes are identifiers to each
-         * vertices' data, e.g. position and color. Calls to `set_vertices(float *, size_t, size_t)` and (optionally)
-         * `set_elements(unsigned short *, size_t, size_t)` must be invoked in order to initialize the mesh data to be
-         * rendered.
-         * 
-         * @param attributes The vertex attributes.
+         * @brief Draws the buffers, of which the vertex attributes must have been bound; see `mesh::render()`.
          */
-        mesh(std::initializer_list<vert_attribute> attributes);
-        /** Destroys this mesh, freeing the OpenGL resources it holds. */
-        ~mesh();
+        void draw(int primitive_type, size_t offset, size_t count) const;
+
+        public:
+        mesh_buffers(const mesh_buffers &) = delete;
 
         /** @return How many bytes each vertex take. */
         inline size_t get_vertex_size() const {
@@ -141,7 +239,7 @@ namespace av {
          * @tparam T_usage Buffer data usage, must be either `GL_STATIC_DRAW`, `GL_DYNAMIC_DRAW`, or `GL_STREAM_DRAW`.
          */
         template<int T_usage = GL_STATIC_DRAW>
-        inline void set_vertices(float *vertices, size_t offset, size_t length) {
+        inline void set_vertices(const float *vertices, size_t offset, size_t length) {
             static_assert(T_usage == GL_STATIC_DRAW || T_usage == GL_DYNAMIC_DRAW || T_usage == GL_STREAM_DRAW, "Invalid vertex data usage.");
 
             glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
@@ -159,7 +257,7 @@ namespace av {
          * @tparam T_usage Buffer data usage, must be either `GL_STATIC_DRAW`, `GL_DYNAMIC_DRAW`, or `GL_STREAM_DRAW`.
          */
         template<int T_usage = GL_STATIC_DRAW>
-        inline void set_elements(unsigned short *elements, size_t offset, size_t length) {
+        inline void set_elements(const unsigned short *elements, size_t offset, size_t length) {
             static_assert(T_usage == GL_STATIC_DRAW || T_usage == GL_DYNAMIC_DRAW || T_usage == GL_STREAM_DRAW, "Invalid index data usage.");
 
             glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, element_buffer);
@@ -168,7 +266,94 @@ namespace av {
             max_elements = length / sizeof(unsigned short);
             has_elements = max_elements > 0;
         }
-        
+    };
+
+    /**
+     * @brief A mesh is a non copy-constructible class holding a state of a vertex buffer object and an element buffer
+     * object in order to draw objects on an OpenGL surface.
+     * 
+     * Optionally holding a non-empty element buffer, a mesh can be rendered by invoking
+     * `render(const shader &, int, size_t, size_t, bool)`, which, of course, requires the mesh's vertices to be set
+     * first. The element buffer can be used to reduce the amount of memory required for the vertices, preventing the
+     * same vertices to be defined twice.
+     *
+     * The vertex attributes are given as a `layout` type, e.g. `mesh<layout<attr::pos_2D, attr::color_packed>>`, so
+     * that the mesh holds no more than its buffers and binds them without looking anything up but the attribute
+     * locations. `mesh<>` takes a list of `vert_attribute`s at runtime instead.
+     *
+     * @tparam T_layout The `layout` of every vertex, or `void` for vertex attributes given at runtime.
+     */
+    template<typename T_layout = void>
+    class mesh: public mesh_buffers {
+        public:
+        using layout_type = T_layout;
+        using mesh_buffers::set_vertices;
+
+        /**
+         * @brief Constructs an empty mesh. Calls to `set_vertices()` and (optionally) `set_elements()` must be invoked
+         * in order to initialize the mesh data to be rendered.
+         */
+        mesh(): mesh_buffers(T_layout::stride) {}
+
+        /**
+         * @brief Sets the vertices of this mesh from typed vertices, which must fit `T_layout` as `layout::fits` says.
+         *
+         * @param vertices The vertices.
+         * @param count    How many vertices there are.
+         * @tparam T_usage Buffer data usage, must be either `GL_STATIC_DRAW`, `GL_DYNAMIC_DRAW`, or `GL_STREAM_DRAW`.
+         */
+        template<int T_usage = GL_STATIC_DRAW, typename T_vertex>
+        inline void set_vertices(const T_vertex *vertices, size_t count) {
+            static_assert(T_usage == GL_STATIC_DRAW || T_usage == GL_DYNAMIC_DRAW || T_usage == GL_STREAM_DRAW, "Invalid vertex data usage.");
+            static_assert(T_layout::template fits<T_vertex>, "The vertex type doesn't match the mesh layout.");
+
+            glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+            glBufferData(GL_ARRAY_BUFFER, count * sizeof(T_vertex), vertices, T_usage);
+
+            max_vertices = count;
+        }
+
+        /** @brief Renders this mesh to the default or the currently bound frame buffer, as `mesh<>::render()` does. */
+        void render(const shader &program, int primitive_type, size_t offset, size_t count, bool auto_bind = true) const {
+            if(auto_bind) bind(program);
+            draw(primitive_type, offset, count);
+            if(auto_bind) unbind(program);
+        }
+
+        /** @brief Binds and enables this mesh's vertices data to the given shader, in a fixed sequence of calls. */
+        void bind(const shader &program) const {
+            glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+            T_layout::bind(program);
+
+            if(has_elements) glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, element_buffer);
+        }
+
+        /** @brief Resets this mesh's vertices data to the given shader. */
+        void unbind(const shader &program) const {
+            T_layout::unbind(program);
+
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            if(has_elements) glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        }
+    };
+
+    /** @brief A mesh whose vertex attributes are only known at runtime; see `mesh`. */
+    template<>
+    class mesh<void>: public mesh_buffers {
+        /** @brief Lists an attribute each vertex has. */
+        std::vector<vert_attribute> attributes;
+
+        public:
+        /**
+         * @brief Constructs an empty mesh with given vertex attributes. These attributes are identifiers to each
+         * vertices' data, e.g. position and color. Calls to `set_vertices(const float *, size_t, size_t)` and
+         * (optionally) `set_elements(const unsigned short *, size_t, size_t)` must be invoked in order to initialize the
+         * mesh data to be rendered.
+         * 
+         * @param attributes The vertex attributes.
+         */
+        mesh(std::initializer_list<vert_attribute> attributes);
+
         /**
          * @brief Renders this mesh to the default or the currently bound frame buffer.
          * 
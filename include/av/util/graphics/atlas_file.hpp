@@ -0,0 +1,321 @@
+#ifndef AV_UTIL_GRAPHICS_ATLASFILE_HPP
+#define AV_UTIL_GRAPHICS_ATLASFILE_HPP
+
+#include <av/util/hash.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace av {
+    /**
+     * @brief The header of a binary atlas file, as written by the packer. Everything in the file is little endian and
+     * laid out so that it can be used in place once the file is in memory, typically memory-mapped:
+     *
+     * - This header.
+     * - `page_count` `atlas_page` records.
+     * - `bucket_count` `uint32_t` displacements of the minimal perfect hash over the region names.
+     * - `region_count` `atlas_region` records, ordered by the slot their name hashes to.
+     * - `names_size` bytes of region names, not null-terminated.
+     * - `vertex_count` vertices of region meshes, `atlas_vertex_floats` `float`s each.
+     * - `index_count` `uint16_t` indices of region meshes.
+     * - The pixels of every page, each starting at a multiple of `atlas_alignment`.
+     */
+    struct atlas_header {
+        /** @brief `atlas_magic`. */
+        char magic[4];
+        /** @brief `atlas_version`. */
+        uint32_t version;
+        uint32_t page_count;
+        uint32_t region_count;
+        uint32_t bucket_count;
+        /** @brief `atlas_flag_array` if the pages are the layers of one texture array, or `0`. */
+        uint32_t flags;
+        /** @brief The seed the region names are hashed with. */
+        uint64_t seed;
+        /** @brief Offsets of the tables above from the start of the file. */
+        uint64_t pages_offset, buckets_offset, regions_offset, names_offset, vertices_offset, indices_offset;
+        uint64_t names_size;
+        /** @brief How many vertices and indices the meshes of every region have combined. */
+        uint64_t vertex_count, index_count;
+        /** @brief The size of the whole file, in bytes. */
+        uint64_t file_size;
+    };
+
+    /** @brief A page of an atlas file. */
+    struct atlas_page {
+        /** @brief The page dimension, in pixels, of the first level. */
+        uint32_t width, height;
+        /**
+         * @brief The pixel format, one of the `atlas_format_*` constants: either 8-bit RGBA or single channel pixels,
+         * 8-bit indices into a palette, or 4x4 pixel blocks of a GPU block compressed format, all stored row by row from
+         * the top-left corner. Blocks past the right or bottom edge of a level are partially used.
+         */
+        uint32_t format;
+        /**
+         * @brief The number of mip levels, at least `1`. Level `i` is `max(1, width >> i)` x `max(1, height >> i)`
+         * pixels, tightly packed right after level `i - 1`. The first level comes right after the palette of indexed
+         * pages, which is `atlas_palette_colors` 8-bit RGBA colors.
+         */
+        uint32_t levels;
+        /** @brief The offset of the page from the start of the file, a multiple of `atlas_alignment`. */
+        uint64_t offset;
+        /** @brief The size of the palette and every level combined, in bytes. */
+        uint64_t size;
+    };
+
+    /** @brief A named region of an atlas page. */
+    struct atlas_region {
+        /** @brief The name hash, so that most misses don't have to compare names. */
+        uint64_t hash;
+        /** @brief Where the name is, relative to `atlas_header::names_offset`. */
+        uint32_t name_offset, name_length;
+        /** @brief The page index, which is also the layer of the texture array of an `atlas_flag_array` atlas. */
+        uint32_t page;
+        /** @brief The region in the first level of the page, in pixels. */
+        uint32_t x, y, width, height;
+        /** @brief `atlas_region_flipped` if the sprite was rotated 90 degrees clockwise to fit. */
+        uint32_t flags;
+        /**
+         * @brief Where the region was in the original sprite, before fully transparent borders were trimmed off. The
+         * offset is that of the unrotated region.
+         */
+        uint32_t offset_x, offset_y;
+        /** @brief The size of the original sprite. */
+        uint32_t source_width, source_height;
+        /**
+         * @brief Where the vertices and indices of the region mesh start in their tables, and how many there are; all
+         * `0` if the atlas was packed without meshes. A mesh covers the opaque pixels of the region more tightly than
+         * its rectangle does. Every vertex is the position in pixels of the unrotated original sprite, followed by the
+         * texture coordinates in the page, from `0` to `1` starting at the top-left corner. Every 3 indices make a
+         * triangle, counting from the first vertex of the region.
+         */
+        uint32_t first_vertex, vertex_count, first_index, index_count;
+    };
+
+    constexpr char atlas_magic[4] = {'A', 'V', 'A', 'T'};
+    constexpr uint32_t atlas_version = 3;
+    /** @brief The alignment of page pixels in the file; the usual memory page size, so mapped pixels are too. */
+    constexpr uint64_t atlas_alignment = 4096;
+    constexpr uint32_t atlas_region_flipped = 1;
+    /**
+     * @brief Marks an atlas whose pages all have the same size, format and level count, so that they can be the layers
+     * of one texture array, and sprites of every page can be drawn without switching textures.
+     */
+    constexpr uint32_t atlas_flag_array = 1;
+    /**
+     * @brief Page formats: 8-bit RGBA pixels, blocks of BC1 (DXT1, 1-bit alpha), BC3 (DXT5) or BC7 (BPTC), 8-bit
+     * single channel pixels, e.g. of signed distance fields, and 8-bit palette indices.
+     */
+    constexpr uint32_t atlas_format_rgba8 = 0, atlas_format_bc1 = 1, atlas_format_bc3 = 2, atlas_format_bc7 = 3, atlas_format_r8 = 4, atlas_format_indexed8 = 5;
+    /** @brief How many colors the palette of an indexed page has; entries past those the page uses are transparent black. */
+    constexpr uint32_t atlas_palette_colors = 256;
+    /** @brief How many `float`s a mesh vertex takes: X and Y, then U and V. */
+    constexpr uint32_t atlas_vertex_floats = 4;
+
+    /**
+     * @brief A read-only view of a binary atlas file in memory. Construction only validates the tables, so that looking
+     * regions up afterwards is a constant time operation that doesn't allocate, and pixels can be handed straight to
+     * the graphics API.
+     */
+    class atlas_view {
+        const unsigned char *data = nullptr;
+        const atlas_header *header = nullptr;
+        const atlas_page *pages = nullptr;
+        const uint32_t *displacements = nullptr;
+        const atlas_region *regions = nullptr;
+        const char *names = nullptr;
+        const float *vertex_data = nullptr;
+        const uint16_t *index_data = nullptr;
+
+        public:
+        /** @brief Default constructor, creates a view of an empty atlas. */
+        atlas_view() = default;
+        /**
+         * @brief Validates an atlas file in memory. An exception is thrown if it isn't one, or is truncated or damaged.
+         *
+         * @param data The file contents. Must stay alive and unchanged as long as this view is used, and be aligned to
+         *             at least 8 bytes.
+         * @param size The size of `data`, in bytes.
+         */
+        atlas_view(const void *data, size_t size): data(static_cast<const unsigned char *>(data)) {
+            auto fail = [](const char *why) {
+                throw std::runtime_error(std::string("Invalid atlas file: ").append(why).append("."));
+            };
+
+            auto fits = [size](uint64_t offset, uint64_t count, uint64_t item_size) {
+                return offset <= size && count <= (size - offset) / item_size;
+            };
+
+            if(reinterpret_cast<uintptr_t>(data) % alignof(atlas_header)) fail("misaligned data");
+            if(size < sizeof(atlas_header)) fail("truncated header");
+
+            header = reinterpret_cast<const atlas_header *>(data);
+            for(int i = 0; i < 4; ++i) if(header->magic[i] != atlas_magic[i]) fail("bad magic");
+            if(header->version != atlas_version) fail("unsupported version");
+            if(header->file_size != size) fail("truncated file");
+            if(header->region_count && !header->bucket_count) fail("no hash buckets");
+            if(header->flags & ~atlas_flag_array) fail("unknown flags");
+
+            if(
+                header->pages_offset % alignof(atlas_page) || header->buckets_offset % alignof(uint32_t) || header->regions_offset % alignof(atlas_region) ||
+                header->vertices_offset % alignof(float) || header->indices_offset % alignof(uint16_t) ||
+                !fits(header->pages_offset, header->page_count, sizeof(atlas_page)) ||
+                !fits(header->buckets_offset, header->bucket_count, sizeof(uint32_t)) ||
+                !fits(header->regions_offset, header->region_count, sizeof(atlas_region)) ||
+                !fits(header->names_offset, header->names_size, 1) ||
+                !fits(header->vertices_offset, header->vertex_count, atlas_vertex_floats * sizeof(float)) ||
+                !fits(header->indices_offset, header->index_count, sizeof(uint16_t))
+            ) fail("table out of bounds");
+
+            pages = reinterpret_cast<const atlas_page *>(this->data + header->pages_offset);
+            displacements = reinterpret_cast<const uint32_t *>(this->data + header->buckets_offset);
+            regions = reinterpret_cast<const atlas_region *>(this->data + header->regions_offset);
+            names = reinterpret_cast<const char *>(this->data + header->names_offset);
+            vertex_data = reinterpret_cast<const float *>(this->data + header->vertices_offset);
+            index_data = reinterpret_cast<const uint16_t *>(this->data + header->indices_offset);
+
+            for(uint32_t i = 0; i < header->page_count; ++i) {
+                const atlas_page &page = pages[i];
+                if(page.format > atlas_format_indexed8 || page.levels < 1 || page.levels > 32 || !page.width || !page.height) fail("bad page");
+                if(page.offset % atlas_alignment || !fits(page.offset, page.size, 1)) fail("page out of bounds");
+
+                if(page.size != page_size(page)) fail("bad page size");
+
+                const atlas_page &first = pages[0];
+                if((header->flags & atlas_flag_array) && (page.width != first.width || page.height != first.height || page.format != first.format || page.levels != first.levels)) fail("array layers differ");
+            }
+
+            for(uint32_t i = 0; i < header->region_count; ++i) {
+                const atlas_region &region = regions[i];
+                if(region.page >= header->page_count) fail("region page out of bounds");
+                if(region.name_offset > header->names_size || region.name_length > header->names_size - region.name_offset) fail("region name out of bounds");
+
+                const atlas_page &page = pages[region.page];
+                if(region.x > page.width || region.width > page.width - region.x || region.y > page.height || region.height > page.height - region.y) fail("region out of bounds");
+
+                uint32_t width = region.flags & atlas_region_flipped ? region.height : region.width, height = region.flags & atlas_region_flipped ? region.width : region.height;
+                if(region.offset_x > region.source_width || width > region.source_width - region.offset_x || region.offset_y > region.source_height || height > region.source_height - region.offset_y) fail("region source out of bounds");
+
+                if(
+                    region.first_vertex > header->vertex_count || region.vertex_count > header->vertex_count - region.first_vertex ||
+                    region.first_index > header->index_count || region.index_count > header->index_count - region.first_index
+                ) fail("region mesh out of bounds");
+
+                if(region.index_count % 3) fail("bad region mesh");
+                for(uint32_t j = 0; j < region.index_count; ++j) if(index_data[region.first_index + j] >= region.vertex_count) fail("bad region mesh");
+            }
+        }
+
+        /** @return Which perfect hash bucket a name hash falls in. */
+        static inline uint32_t bucket_of(uint64_t hash, uint32_t bucket_count) {
+            return static_cast<uint32_t>(((hash >> 32) * bucket_count) >> 32);
+        }
+
+        /** @return Which region slot a name hash goes to, given the displacement of its bucket. */
+        static inline uint32_t slot_of(uint64_t hash, uint32_t displacement, uint32_t region_count) {
+            uint64_t x = hash ^ (displacement * 0x9E3779B97F4A7C15ull);
+            x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+            x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+            return static_cast<uint32_t>((x ^ (x >> 31)) % region_count);
+        }
+
+        /** @return How many bytes a 4x4 pixel block of a page format takes, `0` if it isn't block compressed. */
+        static inline uint64_t block_size(uint32_t format) {
+            if(format == atlas_format_bc1) return 8;
+            return format == atlas_format_bc3 || format == atlas_format_bc7 ? 16 : 0;
+        }
+
+        /** @return The size of a mip level of a page, in bytes. */
+        static inline uint64_t level_size(const atlas_page &page, uint32_t level) {
+            uint64_t width = page.width >> level, height = page.height >> level;
+            width = width ? width : 1;
+            height = height ? height : 1;
+
+            if(page.format == atlas_format_rgba8) return width * height * 4;
+            if(page.format == atlas_format_r8 || page.format == atlas_format_indexed8) return width * height;
+            return (width + 3) / 4 * ((height + 3) / 4) * block_size(page.format);
+        }
+
+        inline size_t page_count() const {
+            return header ? header->page_count : 0;
+        }
+
+        inline const atlas_page &page(size_t index) const {
+            return pages[index];
+        }
+
+        /** @return Whether the pages are the layers of one texture array, as `atlas_flag_array` says. */
+        inline bool is_array() const {
+            return header && header->flags & atlas_flag_array;
+        }
+
+        /** @return The size of the palette of a page format, in bytes, `0` if it isn't indexed. */
+        static inline uint64_t palette_size(uint32_t format) {
+            return format == atlas_format_indexed8 ? atlas_palette_colors * 4 : 0;
+        }
+
+        /** @return The size of a page, its palette and every mip level, in bytes. */
+        static inline uint64_t page_size(const atlas_page &page) {
+            uint64_t size = palette_size(page.format);
+            for(uint32_t level = 0; level < page.levels && level < 32; ++level) size += level_size(page, level);
+            return size;
+        }
+
+        /** @return The `atlas_palette_colors` colors of an indexed page, as 8-bit RGBA. */
+        inline const unsigned char *palette(const atlas_page &page) const {
+            return data + page.offset;
+        }
+
+        /** @return The pixels of a mip level of a page, or its indices or blocks if it's indexed or block compressed. */
+        inline const unsigned char *pixels(const atlas_page &page, uint32_t level = 0) const {
+            const unsigned char *pixels = data + page.offset + palette_size(page.format);
+            for(uint32_t i = 0; i < level; ++i) pixels += level_size(page, i);
+            return pixels;
+        }
+
+        inline size_t region_count() const {
+            return header ? header->region_count : 0;
+        }
+
+        /** @return A region, by slot; slots follow no particular order. */
+        inline const atlas_region &region(size_t slot) const {
+            return regions[slot];
+        }
+
+        inline std::string_view name(const atlas_region &region) const {
+            return std::string_view(names + region.name_offset, region.name_length);
+        }
+
+        /**
+         * @return The `region.vertex_count * atlas_vertex_floats` floats of the vertices of a region mesh, to be uploaded
+         *         as they are, e.g. with `mesh::set_vertices()`.
+         */
+        inline const float *vertices(const atlas_region &region) const {
+            return vertex_data + static_cast<size_t>(region.first_vertex) * atlas_vertex_floats;
+        }
+
+        /** @return The `region.index_count` indices of a region mesh, e.g. for `mesh::set_elements()`. */
+        inline const uint16_t *indices(const atlas_region &region) const {
+            return index_data + region.first_index;
+        }
+
+        /**
+         * @brief Looks a region up by name.
+         *
+         * @param name The region name.
+         * @return The region, or `nullptr` if there is none with that name.
+         */
+        inline const atlas_region *find(std::string_view name) const {
+            if(!region_count()) return nullptr;
+
+            uint64_t hash = hash64(name.data(), name.size(), header->seed);
+            const atlas_region &region = regions[slot_of(hash, displacements[bucket_of(hash, header->bucket_count)], header->region_count)];
+            return region.hash == hash && this->name(region) == name ? &region : nullptr;
+        }
+    };
+}
+
+#endif // !AV_UTIL_GRAPHICS_ATLASFILE_HPP
@@ -0,0 +1,22 @@
+#ifndef AV_UTIL_GRAPHICS_BLOCKDECODER_HPP
+#define AV_UTIL_GRAPHICS_BLOCKDECODER_HPP
+
+#include <cstdint>
+
+namespace av {
+    /**
+     * @brief Decodes a block compressed mip level of an atlas page into 8-bit RGBA pixels, for drivers that can't
+     * sample its format. BC1 blocks use 1-bit alpha when their first color isn't greater than their second, and BC3
+     * color blocks never do. BC7 blocks of the single subset modes 4, 5 and 6, which are all the packer writes, are
+     * decoded; others are left transparent black.
+     *
+     * @param format The page format, `atlas_format_bc1`, `atlas_format_bc3` or `atlas_format_bc7`.
+     * @param blocks The blocks of the level, as laid out in the page.
+     * @param width  The level width, in pixels.
+     * @param height The level height, in pixels.
+     * @param pixels Where to write the `width * height * 4` bytes of pixels, row by row from the top-left corner.
+     */
+    void decode_blocks(uint32_t format, const unsigned char *blocks, int width, int height, unsigned char *pixels);
+}
+
+#endif // !AV_UTIL_GRAPHICS_BLOCKDECODER_HPP
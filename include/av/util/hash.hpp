@@ -0,0 +1,146 @@
+#ifndef AV_UTIL_HASH_HPP
+#define AV_UTIL_HASH_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+namespace av {
+    /**
+     * @brief A streaming 64-bit non-cryptographic hash, computing the same digest as XXH64 does over the concatenation
+     * of everything fed to it. Meant for content addressing, where speed matters and collisions are only a concern by
+     * chance. Multi-byte input is read in little endian, as XXH64 specifies; the digest is therefore only the same
+     * across little endian machines.
+     */
+    class hasher {
+        static constexpr uint64_t prime1 = 11400714785074694791ull;
+        static constexpr uint64_t prime2 = 14029467366897019727ull;
+        static constexpr uint64_t prime3 = 1609587929392839161ull;
+        static constexpr uint64_t prime4 = 9650029242287828579ull;
+        static constexpr uint64_t prime5 = 2870177450012600261ull;
+
+        uint64_t seed;
+        uint64_t lanes[4];
+        /** @brief Input that doesn't make up a whole stripe of 32 bytes yet. */
+        unsigned char buffer[32];
+        size_t buffered = 0;
+        uint64_t total = 0;
+
+        static inline uint64_t rotl(uint64_t x, int r) {
+            return (x << r) | (x >> (64 - r));
+        }
+
+        static inline uint64_t read64(const unsigned char *p) {
+            uint64_t v;
+            std::memcpy(&v, p, sizeof(v));
+            return v;
+        }
+
+        static inline uint32_t read32(const unsigned char *p) {
+            uint32_t v;
+            std::memcpy(&v, p, sizeof(v));
+            return v;
+        }
+
+        static inline uint64_t round(uint64_t acc, uint64_t input) {
+            return rotl(acc + input * prime2, 31) * prime1;
+        }
+
+        static inline uint64_t merge(uint64_t acc, uint64_t lane) {
+            return (acc ^ round(0, lane)) * prime1 + prime4;
+        }
+
+        inline void stripe(const unsigned char *p) {
+            for(int i = 0; i < 4; ++i) lanes[i] = round(lanes[i], read64(p + i * 8));
+        }
+
+        public:
+        /** @brief Starts a new digest with the given seed. */
+        hasher(uint64_t seed = 0): seed(seed) {
+            lanes[0] = seed + prime1 + prime2;
+            lanes[1] = seed + prime2;
+            lanes[2] = seed;
+            lanes[3] = seed - prime1;
+        }
+
+        /** @brief Feeds raw bytes. */
+        hasher &update(const void *data, size_t size) {
+            const unsigned char *p = static_cast<const unsigned char *>(data);
+            total += size;
+
+            if(buffered + size < 32) {
+                std::memcpy(buffer + buffered, p, size);
+                buffered += size;
+                return *this;
+            }
+
+            if(buffered) {
+                size_t fill = 32 - buffered;
+                std::memcpy(buffer + buffered, p, fill);
+                stripe(buffer);
+
+                p += fill;
+                size -= fill;
+                buffered = 0;
+            }
+
+            for(; size >= 32; p += 32, size -= 32) stripe(p);
+
+            std::memcpy(buffer, p, size);
+            buffered = size;
+            return *this;
+        }
+
+        /** @brief Feeds the object representation of a trivially copyable value. */
+        template<typename T>
+        std::enable_if_t<std::is_trivially_copyable_v<T>, hasher &> update(const T &value) {
+            return update(&value, sizeof(T));
+        }
+
+        /** @brief Feeds a string, prefixed by its length so consecutive strings can't be confused for each other. */
+        hasher &update(const std::string &str) {
+            update(static_cast<uint64_t>(str.size()));
+            return update(str.data(), str.size());
+        }
+
+        /** @return The digest of everything fed so far. Feeding may go on afterwards. */
+        uint64_t digest() const {
+            uint64_t h;
+            if(total >= 32) {
+                h = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) + rotl(lanes[3], 18);
+                for(int i = 0; i < 4; ++i) h = merge(h, lanes[i]);
+            } else {
+                h = seed + prime5;
+            }
+
+            h += total;
+
+            const unsigned char *p = buffer;
+            size_t size = buffered;
+            for(; size >= 8; p += 8, size -= 8) h = rotl(h ^ round(0, read64(p)), 27) * prime1 + prime4;
+            if(size >= 4) {
+                h = rotl(h ^ (read32(p) * prime1), 23) * prime2 + prime3;
+                p += 4;
+                size -= 4;
+            }
+
+            for(; size; ++p, --size) h = rotl(h ^ (*p * prime5), 11) * prime1;
+
+            h ^= h >> 33;
+            h *= prime2;
+            h ^= h >> 29;
+            h *= prime3;
+            h ^= h >> 32;
+            return h;
+        }
+    };
+
+    /** @return The XXH64 digest of the given bytes. */
+    inline uint64_t hash64(const void *data, size_t size, uint64_t seed = 0) {
+        return hasher(seed).update(data, size).digest();
+    }
+}
+
+#endif // !AV_UTIL_HASH_HPP
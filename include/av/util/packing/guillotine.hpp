@@ -0,0 +1,425 @@
+#ifndef AV_UTIL_PACKING_GUILLOTINE_HPP
+#define AV_UTIL_PACKING_GUILLOTINE_HPP
+
+#include <av/util/packing/rect.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace av {
+    /**
+     * @brief Packs rectangles by cutting them out of free rectangles with a single straight cut each way, so that free
+     * rectangles never overlap. It packs looser than `max_rects_bin_pack`, but a placement only splits one free
+     * rectangle in two instead of every free rectangle it overlaps.
+     *
+     * The leftover space is cut along its shorter side, leaving the larger piece as big as possible, and pieces that
+     * line up with a neighbour on a whole edge are merged back together.
+     */
+    class guillotine_bin_pack {
+        public:
+        /** @brief Specifies the different heuristic rules that can be used when deciding where to place a new rectangle. */
+        enum class heuristic {
+            /** @brief Positions the rectangle against the short side of a free rectangle into which it fits the best */
+            best_short_side_fit,
+            /** @brief Positions the rectangle against the long side of a free rectangle into which it fits the best. */
+            best_long_side_fit,
+            /** @brief Positions the rectangle into the smallest free rect into which it fits. */
+            best_area_fit
+        };
+
+        /** @brief Every heuristic, the default first. */
+        static constexpr heuristic heuristics[] = {heuristic::best_short_side_fit, heuristic::best_long_side_fit, heuristic::best_area_fit};
+
+        guillotine_bin_pack(): bin_width(0), bin_height(0), allow_flip(true) {}
+
+        /**
+         * @brief Instantiates a bin of the given size.
+         * @param allow_flip Specifies whether the packing algorithm is allowed to rotate the input rectangles by 90 degrees
+         * to consider a better placement.
+         */
+        guillotine_bin_pack(int width, int height, bool allow_flip = true) {
+            init(width, height, allow_flip);
+        }
+
+        /**
+         * @brief Initializes the packer to an empty bin of width x height units. Call whenever you need to restart with a
+         * new bin.
+         * @param width The bin width;
+         * @param height The bin height;
+         * @param allow_flip Specifies whether the packing algorithm is allowed to rotate the input rectangles by 90 degrees
+         * to consider a better placement.
+         */
+        void init(int width, int height, bool allow_flip = true) {
+            this->allow_flip = allow_flip;
+            bin_width = width;
+            bin_height = height;
+
+            used_rects.clear();
+            used_area = 0;
+            free_rects.clear();
+            free_seqs.clear();
+            free_slots.clear();
+
+            if(width > 0 && height > 0) add_free({0, 0, width, height});
+        }
+
+        /**
+         * @brief Inserts the given list of rectangles in an offline/batch mode, possibly rotated.
+         *
+         * @param rects The list of rectangles to insert. This vector will be destroyed in the process.
+         * @param dst [out] This list will contain the packed rectangles. The indices will not correspond to that of rects.
+         * @param method The rectangle placement rule to use when packing.
+         */
+        void insert(std::vector<rect_size> &rects, std::vector<rect> &dst, heuristic method) {
+            std::vector<int> dst_ids;
+            insert(rects, dst, dst_ids, method);
+        }
+
+        /**
+         * @brief Inserts the given list of rectangles in an offline/batch mode, possibly rotated, always placing the
+         * rectangle with the best position next and keeping track of where each of them went.
+         *
+         * @param rects   The list of rectangles to insert. Rectangles that didn't fit in the bin are left in here, and
+         *                everything else is removed.
+         * @param dst     [out] This list will contain the packed rectangles.
+         * @param dst_ids [out] This list will contain the `rect_size::id` each of the packed rectangles came from, in
+         *                the same order as `dst`.
+         * @param method  The rectangle placement rule to use when packing.
+         */
+        void insert(std::vector<rect_size> &rects, std::vector<rect> &dst, std::vector<int> &dst_ids, heuristic method) {
+            dst.clear();
+            dst_ids.clear();
+
+            switch(method) {
+                case heuristic::best_short_side_fit: insert_cached(rects, dst, dst_ids, short_side_scoring{}); break;
+                case heuristic::best_long_side_fit: insert_cached(rects, dst, dst_ids, long_side_scoring{}); break;
+                case heuristic::best_area_fit: insert_cached(rects, dst, dst_ids, area_scoring{}); break;
+            }
+        }
+
+        /**
+         * Inserts a single rectangle into the bin, possibly rotated.
+         *
+         * @param width The rectangle width.
+         * @param height The rectangle height.
+         * @param method The packing method. See `heuristic` documentation for details.
+         * @return The inserted rectangle, or an empty one if it doesn't fit.
+         */
+        rect insert(int width, int height, heuristic method) {
+            renumber();
+
+            fit best;
+            switch(method) {
+                case heuristic::best_short_side_fit: best = find_fit(width, height, short_side_scoring{}); break;
+                case heuristic::best_long_side_fit: best = find_fit(width, height, long_side_scoring{}); break;
+                case heuristic::best_area_fit: best = find_fit(width, height, area_scoring{}); break;
+            }
+
+            if(best.node.height == 0) return best.node;
+
+            place(best);
+            return best.node;
+        }
+
+        /**
+         * @brief Gives the space of a packed rectangle back, merging it with the free rectangles it shares a whole edge
+         * with. Space freed next to rectangles that are still packed may stay split up, so a bin that rectangles come
+         * and go from slowly fragments; repacking what's left into a fresh bin undoes that.
+         *
+         * @param node A rectangle returned by `insert()` that wasn't removed yet.
+         * @return Whether the rectangle was packed in this bin.
+         */
+        bool remove(const rect &node) {
+            auto found = std::find_if(used_rects.begin(), used_rects.end(), [&](const rect &used) {
+                return used.x == node.x && used.y == node.y && used.width == node.width && used.height == node.height;
+            });
+
+            if(found == used_rects.end()) return false;
+
+            *found = used_rects.back();
+            used_rects.pop_back();
+            used_area -= static_cast<uint64_t>(node.width) * node.height;
+
+            renumber();
+            add_free(node);
+            merge_free(free_rects.size() - 1);
+            return true;
+        }
+
+        /**
+         * @brief Gives the bin more free space, merging it with the free rectangles it shares a whole edge with, such as
+         * space that another packer gave up on. A bin initialized to no size only packs into space given this way.
+         *
+         * @param area A rectangle that doesn't overlap any free or packed rectangle of this bin.
+         */
+        void add_free_area(const rect &area) {
+            renumber();
+            add_free(area);
+            merge_free(free_rects.size() - 1);
+        }
+
+        /** @return The bin width. */
+        inline int get_width() const {
+            return bin_width;
+        }
+        /** @return The bin height. */
+        inline int get_height() const {
+            return bin_height;
+        }
+        /** @return The rectangles packed so far. */
+        inline const std::vector<rect> &get_used_rects() const {
+            return used_rects;
+        }
+        /** @return The free rectangles, which don't overlap each other, in no particular order. */
+        inline const std::vector<rect> &get_free_rects() const {
+            return free_rects;
+        }
+
+        /** @return The ratio of used surface area to the total bin area. */
+        double occupancy() const {
+            return static_cast<double>(used_area) / (static_cast<uint64_t>(bin_width) * bin_height);
+        }
+
+        private:
+        int bin_width;
+        int bin_height;
+
+        bool allow_flip;
+
+        std::vector<rect> used_rects;
+        uint64_t used_area;
+
+        std::vector<rect> free_rects;
+        /** @brief The sequence number of each of `free_rects`, counting every free rectangle ever created since `init()`. */
+        std::vector<size_t> free_seqs;
+        /** @brief The position in `free_rects` of every free rectangle by sequence number, or `npos` if it's gone. */
+        std::vector<size_t> free_slots;
+
+        /** @brief Marks the absence of a position. */
+        static constexpr size_t npos = std::numeric_limits<size_t>::max();
+
+        /** @brief A candidate position for a rectangle, along with its scores. */
+        struct fit {
+            /** @brief Where the rectangle would be placed, or an empty `rect` if it doesn't fit anywhere. */
+            rect node = {};
+            int64_t score1 = std::numeric_limits<int64_t>::max();
+            int64_t score2 = std::numeric_limits<int64_t>::max();
+            /** @brief `seq * 2 + flipped`, where `seq` is the sequence number of the free rectangle in `free_seqs`. */
+            size_t order = npos;
+
+            /** @return Whether this position scores better than the other one, breaking ties by `order`. */
+            inline bool better_than(const fit &other) const {
+                if(score1 != other.score1) return score1 < other.score1;
+                if(score2 != other.score2) return score2 < other.score2;
+                return order < other.order;
+            }
+        };
+
+        /** @brief Scoring of `heuristic::best_short_side_fit`; the shorter leftover side first, then the longer one. */
+        struct short_side_scoring {
+            inline void score(const rect &free, int width, int height, int64_t &short_fit, int64_t &long_fit) const {
+                int leftover_x = free.width - width, leftover_y = free.height - height;
+                short_fit = std::min(leftover_x, leftover_y);
+                long_fit = std::max(leftover_x, leftover_y);
+            }
+        };
+
+        /** @brief Scoring of `heuristic::best_long_side_fit`; the longer leftover side first, then the shorter one. */
+        struct long_side_scoring {
+            inline void score(const rect &free, int width, int height, int64_t &long_fit, int64_t &short_fit) const {
+                int leftover_x = free.width - width, leftover_y = free.height - height;
+                long_fit = std::max(leftover_x, leftover_y);
+                short_fit = std::min(leftover_x, leftover_y);
+            }
+        };
+
+        /** @brief Scoring of `heuristic::best_area_fit`; the leftover area first, then the shorter leftover side. */
+        struct area_scoring {
+            inline void score(const rect &free, int width, int height, int64_t &area_fit, int64_t &short_fit) const {
+                area_fit = static_cast<int64_t>(free.width) * free.height - static_cast<int64_t>(width) * height;
+                short_fit = std::min(free.width - width, free.height - height);
+            }
+        };
+
+        /** @brief Offers the free rectangle at the given slot to the best position so far, in either orientation. */
+        template<typename T_scoring>
+        void offer(fit &best, size_t slot, int width, int height, const T_scoring &scoring) const {
+            const rect &free = free_rects[slot];
+            auto visit = [&](int w, int h, bool flipped) {
+                fit candidate;
+                candidate.node = {free.x, free.y, w, h};
+                candidate.order = free_seqs[slot] * 2 + flipped;
+                scoring.score(free, w, h, candidate.score1, candidate.score2);
+
+                if(candidate.better_than(best)) best = candidate;
+            };
+
+            if(free.width >= width && free.height >= height) visit(width, height, false);
+            if(allow_flip && width != height && free.width >= height && free.height >= width) visit(height, width, true);
+        }
+
+        /** @brief Finds the best position among every free rectangle. */
+        template<typename T_scoring>
+        fit find_fit(int width, int height, const T_scoring &scoring) const {
+            fit best;
+            for(size_t slot = 0; slot < free_rects.size(); ++slot) offer(best, slot, width, height, scoring);
+            return best;
+        }
+
+        /** @brief Finds the best position among the free rectangles created from the given sequence number onwards. */
+        template<typename T_scoring>
+        fit find_fit_since(int width, int height, size_t first_seq, const T_scoring &scoring) const {
+            fit best;
+            for(size_t seq = first_seq; seq < free_slots.size(); ++seq) {
+                if(free_slots[seq] != npos) offer(best, free_slots[seq], width, height, scoring);
+            }
+
+            return best;
+        }
+
+        /**
+         * @brief Numbers the free rectangles from scratch once most sequence numbers are of rectangles that are gone,
+         * so that `free_slots` doesn't keep growing in a bin that's inserted into and removed from indefinitely. Only
+         * called between placements, as the batch `insert()` relies on sequence numbers staying put.
+         */
+        void renumber() {
+            if(free_slots.size() < free_rects.size() * 2 + 64) return;
+
+            free_slots.resize(free_rects.size());
+            for(size_t slot = 0; slot < free_rects.size(); ++slot) {
+                free_seqs[slot] = slot;
+                free_slots[slot] = slot;
+            }
+        }
+
+        /** @brief Appends a free rectangle to `free_rects`, giving it the next sequence number. */
+        void add_free(const rect &r) {
+            free_slots.push_back(free_rects.size());
+            free_seqs.push_back(free_slots.size() - 1);
+            free_rects.push_back(r);
+        }
+
+        /** @brief Removes a free rectangle from `free_rects`, moving the last one in its place. */
+        void remove_free(size_t slot) {
+            free_slots[free_seqs[slot]] = npos;
+            free_rects[slot] = free_rects.back();
+            free_seqs[slot] = free_seqs.back();
+            free_rects.pop_back();
+            free_seqs.pop_back();
+
+            if(slot < free_rects.size()) free_slots[free_seqs[slot]] = slot;
+        }
+
+        /**
+         * @brief Merges the free rectangle at the given slot with any other free rectangle it shares a whole edge with,
+         * repeatedly, so the merged rectangle can merge further.
+         */
+        void merge_free(size_t slot) {
+            for(bool merged = true; merged;) {
+                merged = false;
+                for(size_t i = 0; i < free_rects.size() && !merged; ++i) {
+                    if(i == slot) continue;
+
+                    const rect &a = free_rects[slot], &b = free_rects[i];
+                    rect joined;
+                    if(a.x == b.x && a.width == b.width && (a.y + a.height == b.y || b.y + b.height == a.y)) {
+                        joined = {a.x, std::min(a.y, b.y), a.width, a.height + b.height};
+                    } else if(a.y == b.y && a.height == b.height && (a.x + a.width == b.x || b.x + b.width == a.x)) {
+                        joined = {std::min(a.x, b.x), a.y, a.width + b.width, a.height};
+                    } else {
+                        continue;
+                    }
+
+                    // Remove the higher slot first, so that the lower one stays where it is.
+                    remove_free(std::max(slot, i));
+                    remove_free(std::min(slot, i));
+                    add_free(joined);
+
+                    slot = free_rects.size() - 1;
+                    merged = true;
+                }
+            }
+        }
+
+        /** @brief Cuts a position out of its free rectangle, which must still be there. */
+        void place(const fit &position) {
+            size_t slot = free_slots[position.order / 2];
+            rect free = free_rects[slot];
+            const rect &node = position.node;
+            remove_free(slot);
+
+            // Cut along the shorter leftover side, leaving the larger piece whole.
+            int leftover_x = free.width - node.width, leftover_y = free.height - node.height;
+            bool horizontal = leftover_x <= leftover_y;
+
+            rect bottom = {free.x, free.y + node.height, horizontal ? free.width : node.width, free.height - node.height};
+            rect right = {free.x + node.width, free.y, free.width - node.width, horizontal ? node.height : free.height};
+
+            size_t first_seq = free_slots.size();
+            if(bottom.width > 0 && bottom.height > 0) add_free(bottom);
+            if(right.width > 0 && right.height > 0) add_free(right);
+
+            // Merging moves free rectangles around, so go over the pieces by sequence number.
+            size_t end_seq = free_slots.size();
+            for(size_t seq = first_seq; seq < end_seq; ++seq) {
+                if(free_slots[seq] != npos) merge_free(free_slots[seq]);
+            }
+
+            used_rects.push_back(node);
+            used_area += static_cast<uint64_t>(node.width) * node.height;
+        }
+
+        /**
+         * @brief Inserts the given list of rectangles in an offline/batch mode, keeping every pending rectangle's best
+         * position around between placements.
+         *
+         * A placement only replaces the free rectangle it was cut out of, and those its pieces merged with, so any
+         * other free rectangle keeps its score. A rectangle whose best position was in a replaced free rectangle is
+         * searched from scratch; any other one only needs to be compared with the free rectangles created since. That
+         * includes rectangles that didn't fit anywhere, since merged free rectangles can be larger than their pieces.
+         *
+         * @param scoring The placement scoring rule; one of the `*_scoring` structs.
+         */
+        template<typename T_scoring>
+        void insert_cached(std::vector<rect_size> &rects, std::vector<rect> &dst, std::vector<int> &dst_ids, const T_scoring &scoring) {
+            std::vector<fit> fits(rects.size());
+            for(size_t i = 0; i < rects.size(); ++i) fits[i] = find_fit(rects[i].width, rects[i].height, scoring);
+
+            while(true) {
+                size_t best = rects.size();
+                for(size_t i = 0; i < rects.size(); ++i) {
+                    if(fits[i].node.height && (best == rects.size() || fits[i].better_than(fits[best]))) best = i;
+                }
+
+                if(best == rects.size()) return;
+
+                fit position = fits[best];
+                dst.push_back(position.node);
+                dst_ids.push_back(rects[best].id);
+
+                rects[best] = rects.back();
+                fits[best] = fits.back();
+                rects.pop_back();
+                fits.pop_back();
+
+                // Free rectangles created by this placement are the ones with the highest sequence numbers.
+                size_t first_seq = free_slots.size();
+                place(position);
+
+                for(size_t i = 0; i < rects.size(); ++i) {
+                    fit &f = fits[i];
+                    if(f.node.height && free_slots[f.order / 2] == npos) {
+                        f = find_fit(rects[i].width, rects[i].height, scoring);
+                    } else {
+                        fit added = find_fit_since(rects[i].width, rects[i].height, first_seq, scoring);
+                        if(added.better_than(f)) f = added;
+                    }
+                }
+            }
+        }
+    };
+}
+
+#endif // !AV_UTIL_PACKING_GUILLOTINE_HPP
@@ -0,0 +1,34 @@
+#ifndef AV_UTIL_PACKING_RECT_HPP
+#define AV_UTIL_PACKING_RECT_HPP
+
+#include <algorithm>
+
+namespace av {
+    struct rect_size {
+        int width;
+        int height;
+        /** @brief User-defined identifier, reported back by the batch `insert()` for every packed rectangle. */
+        int id = -1;
+    };
+
+    struct rect {
+        int x;
+        int y;
+        int width;
+        int height;
+        
+        bool contained_in(const rect &other) const {
+            return
+                x >= other.x && y >= other.y &&
+                x + width <= other.x + other.width &&
+                y + height <= other.y + other.height;
+        }
+    };
+
+    inline int common_length(int i1start, int i1end, int i2start, int i2end) {
+        if(i1end < i2start || i2end < i1start) return 0;
+        return std::min(i1end, i2end) - std::max(i1start, i2start);
+    }
+}
+
+#endif // !AV_UTIL_PACKING_RECT_HPP
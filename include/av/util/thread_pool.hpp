@@ -0,0 +1,177 @@
+#ifndef AV_UTIL_THREADPOOL_HPP
+#define AV_UTIL_THREADPOOL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace av {
+    /**
+     * @brief A fixed-size pool of worker threads consuming a shared task queue. Non copy-constructible; the workers are
+     * joined on destruction after the remaining tasks are drained.
+     */
+    class thread_pool {
+        /** @brief The worker threads. */
+        std::vector<std::thread> workers;
+        /** @brief Submitted tasks that haven't been picked up by any worker yet. */
+        std::deque<std::function<void()>> tasks;
+        /** @brief The thread lock to lock access to `tasks`, `active` and `stopping`. */
+        std::mutex thread_lock;
+        /** @brief Notified whenever a task is submitted or the pool is stopping. */
+        std::condition_variable task_available;
+        /** @brief Notified whenever a worker finishes a task. */
+        std::condition_variable task_done;
+        /** @brief How many tasks are currently being run by the workers. */
+        size_t active;
+        /** @brief Whether the workers should exit once the queue is empty. */
+        bool stopping;
+        /** @brief The first exception thrown by a task submitted with `submit(std::function<void()> &&)`. */
+        std::exception_ptr error;
+
+        public:
+        thread_pool(const thread_pool &) = delete;
+        /**
+         * @brief Spawns the worker threads.
+         * @param threads How many workers to spawn. `0` means one per hardware thread.
+         */
+        thread_pool(size_t threads = 0): active(0), stopping(false) {
+            if(!threads) threads = std::max(1u, std::thread::hardware_concurrency());
+
+            workers.reserve(threads);
+            for(size_t i = 0; i < threads; ++i) workers.emplace_back([this]() { work(); });
+        }
+
+        /** @brief Drains the queue and joins all the worker threads. */
+        ~thread_pool() {
+            {
+                std::lock_guard<std::mutex> guard(thread_lock);
+                stopping = true;
+            }
+
+            task_available.notify_all();
+            for(std::thread &worker : workers) worker.join();
+        }
+
+        /** @return How many worker threads this pool has. */
+        inline size_t size() const {
+            return workers.size();
+        }
+
+        /**
+         * @brief Submits a task to be run by any of the workers. Exceptions thrown by the task are rethrown by `wait()`.
+         * @param task The task.
+         */
+        void submit(std::function<void()> &&task) {
+            {
+                std::lock_guard<std::mutex> guard(thread_lock);
+                tasks.push_back(std::move(task));
+            }
+
+            task_available.notify_one();
+        }
+
+        /**
+         * @brief Blocks until every submitted task has finished, then rethrows the first exception any of them threw.
+         * Must not be called from within a task.
+         */
+        void wait() {
+            std::unique_lock<std::mutex> guard(thread_lock);
+            task_done.wait(guard, [this]() { return tasks.empty() && !active; });
+
+            if(error) std::rethrow_exception(std::exchange(error, nullptr));
+        }
+
+        /**
+         * @brief Invokes `func(i)` for every `i` in `[0, count)` across the workers and blocks until all of them have
+         * returned. The calling thread takes indices as well, so this may safely be nested inside another task of the
+         * same pool. The first exception thrown by `func` is rethrown here.
+         *
+         * @param count How many indices to invoke the function with.
+         * @param func  The function, in a signature of `void(size_t)`.
+         */
+        template<typename T_func>
+        void for_each(size_t count, T_func &&func) {
+            if(!count) return;
+
+            struct state {
+                std::atomic<size_t> next{0};
+                size_t done = 0;
+                std::mutex lock;
+                std::condition_variable finished;
+                std::exception_ptr error;
+            };
+
+            std::shared_ptr<state> shared = std::make_shared<state>();
+            std::function<void(size_t)> body = std::forward<T_func>(func);
+
+            // The body is only referenced while there are indices left to take, which the caller outlives.
+            auto run = [shared, &body, count]() {
+                size_t ran = 0;
+                std::exception_ptr error;
+
+                for(size_t i; (i = shared->next.fetch_add(1)) < count; ++ran) {
+                    try {
+                        body(i);
+                    } catch(...) {
+                        if(!error) error = std::current_exception();
+                    }
+                }
+
+                if(!ran) return;
+
+                std::lock_guard<std::mutex> guard(shared->lock);
+                if(error && !shared->error) shared->error = error;
+                if((shared->done += ran) == count) shared->finished.notify_all();
+            };
+
+            size_t helpers = std::min(count, workers.size() + 1) - 1;
+            for(size_t i = 0; i < helpers; ++i) submit(run);
+            run();
+
+            std::unique_lock<std::mutex> guard(shared->lock);
+            shared->finished.wait(guard, [&]() { return shared->done == count; });
+
+            if(shared->error) std::rethrow_exception(shared->error);
+        }
+
+        private:
+        /** @brief The worker loop; takes tasks off the queue until the pool is stopping and the queue is empty. */
+        void work() {
+            std::unique_lock<std::mutex> guard(thread_lock);
+            while(true) {
+                task_available.wait(guard, [this]() { return stopping || !tasks.empty(); });
+                if(tasks.empty()) return;
+
+                std::function<void()> task = std::move(tasks.front());
+                tasks.pop_front();
+
+                ++active;
+                guard.unlock();
+
+                std::exception_ptr thrown;
+                try {
+                    task();
+                } catch(...) {
+                    thrown = std::current_exception();
+                }
+
+                guard.lock();
+                if(thrown && !error) error = thrown;
+
+                --active;
+                task_done.notify_all();
+            }
+        }
+    };
+}
+
+#endif // !AV_UTIL_THREADPOOL_HPP
@@ -0,0 +1,221 @@
+#include <av/core/graphics/atlas.hpp>
+#include <av/util/graphics/block_decoder.hpp>
+#include <av/util/log.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace av {
+    namespace {
+        // Block compressed formats come from extensions, which the generated loader leaves out.
+        constexpr GLenum compressed_rgba_s3tc_dxt1 = 0x83F1, compressed_rgba_s3tc_dxt5 = 0x83F3, compressed_rgba_bptc_unorm = 0x8E8C;
+
+        bool has_extension(const char *name) {
+            int count = 0;
+            glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+            for(int i = 0; i < count; ++i) if(!std::strcmp(reinterpret_cast<const char *>(glGetStringi(GL_EXTENSIONS, i)), name)) return true;
+            return false;
+        }
+
+        /** @return The OpenGL internal format of a block compressed page format, or `0` if the driver can't sample it. */
+        GLenum compressed_format(uint32_t format) {
+            bool bptc = GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 2) || has_extension("GL_ARB_texture_compression_bptc");
+            switch(format) {
+                case atlas_format_bc1: return has_extension("GL_EXT_texture_compression_s3tc") ? compressed_rgba_s3tc_dxt1 : 0;
+                case atlas_format_bc3: return has_extension("GL_EXT_texture_compression_s3tc") ? compressed_rgba_s3tc_dxt5 : 0;
+                case atlas_format_bc7: return bptc ? compressed_rgba_bptc_unorm : 0;
+                default: return 0;
+            }
+        }
+
+        /** @brief How the pixels of a page format are handed to OpenGL, and sampled. */
+        struct upload_format {
+            /** @brief The OpenGL block compressed format blocks are uploaded in as they are, or `0` to decode them. */
+            GLenum compressed;
+            /** @brief The internal format and the pixel format of pixels, decoded from blocks if need be. */
+            GLenum internal, pixels;
+            /** @brief The filter to sample with, without and with mip levels. Indices can't be blended. */
+            GLenum filter, mip_filter;
+        };
+
+        upload_format upload_format_of(uint32_t format) {
+            bool single = format == atlas_format_r8 || format == atlas_format_indexed8, indexed = format == atlas_format_indexed8;
+            return {
+                atlas_view::block_size(format) ? compressed_format(format) : 0,
+                static_cast<GLenum>(single ? GL_R8 : GL_RGBA8), static_cast<GLenum>(single ? GL_RED : GL_RGBA),
+                static_cast<GLenum>(indexed ? GL_NEAREST : GL_LINEAR), static_cast<GLenum>(indexed ? GL_NEAREST_MIPMAP_NEAREST : GL_LINEAR_MIPMAP_LINEAR)
+            };
+        }
+
+        /**
+         * @brief Uploads a mip level of a page to the bound texture, or to a layer of the bound texture array.
+         *
+         * @param layer   The layer, of which the level must have been allocated, or `-1` for a texture.
+         * @param decoded Space for the pixels of blocks the driver can't sample.
+         */
+        void upload_level(const atlas_view &view, const atlas_page &page, uint32_t level, const upload_format &format, int layer, std::vector<unsigned char> &decoded) {
+            int width = std::max(1, static_cast<int>(page.width >> level)), height = std::max(1, static_cast<int>(page.height >> level));
+            const unsigned char *pixels = view.pixels(page, level);
+            if(format.compressed) {
+                int size = static_cast<int>(atlas_view::level_size(page, level));
+                if(layer < 0) {
+                    glCompressedTexImage2D(GL_TEXTURE_2D, level, format.compressed, width, height, 0, size, pixels);
+                } else {
+                    glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, width, height, 1, format.compressed, size, pixels);
+                }
+
+                return;
+            }
+
+            if(atlas_view::block_size(page.format)) {
+                decoded.resize(static_cast<size_t>(width) * height * 4);
+                decode_blocks(page.format, pixels, width, height, decoded.data());
+                pixels = decoded.data();
+            }
+
+            if(layer < 0) {
+                glTexImage2D(GL_TEXTURE_2D, level, format.internal, width, height, 0, format.pixels, GL_UNSIGNED_BYTE, pixels);
+            } else {
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, width, height, 1, format.pixels, GL_UNSIGNED_BYTE, pixels);
+            }
+        }
+    }
+
+    atlas::atlas(const std::string &path):
+        mapping(nullptr),
+        mapping_size(0) {
+#ifdef _WIN32
+        mapping_handle = nullptr;
+
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if(file == INVALID_HANDLE_VALUE) throw std::runtime_error(std::string("Couldn't open '").append(path).append("'."));
+
+        LARGE_INTEGER size;
+        if(!GetFileSizeEx(file, &size)) {
+            CloseHandle(file);
+            throw std::runtime_error(std::string("Couldn't stat '").append(path).append("'."));
+        }
+
+        mapping_size = static_cast<size_t>(size.QuadPart);
+        if(mapping_size) {
+            mapping_handle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if(mapping_handle) mapping = MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+        }
+
+        CloseHandle(file);
+        if(mapping_size && !mapping) {
+            if(mapping_handle) CloseHandle(mapping_handle);
+            throw std::runtime_error(std::string("Couldn't map '").append(path).append("'."));
+        }
+#else
+        int file = open(path.c_str(), O_RDONLY);
+        if(file < 0) throw std::runtime_error(std::string("Couldn't open '").append(path).append("'."));
+
+        struct stat info;
+        if(fstat(file, &info) < 0) {
+            close(file);
+            throw std::runtime_error(std::string("Couldn't stat '").append(path).append("'."));
+        }
+
+        mapping_size = static_cast<size_t>(info.st_size);
+        if(mapping_size) {
+            mapping = mmap(nullptr, mapping_size, PROT_READ, MAP_PRIVATE, file, 0);
+            if(mapping == MAP_FAILED) mapping = nullptr;
+        }
+
+        // The mapping keeps the file alive on its own.
+        close(file);
+        if(mapping_size && !mapping) throw std::runtime_error(std::string("Couldn't map '").append(path).append("'."));
+#endif
+
+        try {
+            view = atlas_view(mapping, mapping_size);
+        } catch(...) {
+#ifdef _WIN32
+            if(mapping) UnmapViewOfFile(mapping);
+            if(mapping_handle) CloseHandle(mapping_handle);
+#else
+            if(mapping) munmap(mapping, mapping_size);
+#endif
+            throw;
+        }
+
+        // A texture array atlas has one texture, and one palette texture, for every page at once.
+        target = view.is_array() ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+        size_t count = view.is_array() ? std::min<size_t>(view.page_count(), 1) : view.page_count();
+        int layers = view.is_array() ? static_cast<int>(view.page_count()) : 1;
+
+        textures.resize(count);
+        palettes.resize(count);
+        if(count) glGenTextures(static_cast<int>(count), textures.data());
+
+        // Rows of RGBA pixels always hold to the default unpack alignment of 4, but single channel rows don't.
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        std::vector<unsigned char> decoded;
+        for(size_t i = 0; i < count; ++i) {
+            const atlas_page &page = view.page(i);
+            upload_format format = upload_format_of(page.format);
+            if(atlas_view::block_size(page.format) && !format.compressed) log::msg<log_level::warn>("The driver can't sample the format of page %zu of '%s'; decoding it.", i, path.c_str());
+
+            // Every layer has its palette in its own row.
+            if(page.format == atlas_format_indexed8) {
+                glGenTextures(1, &palettes[i]);
+                glBindTexture(GL_TEXTURE_2D, palettes[i]);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, atlas_palette_colors, layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+                for(int layer = 0; layer < layers; ++layer) glTexSubImage2D(GL_TEXTURE_2D, 0, 0, layer, atlas_palette_colors, 1, GL_RGBA, GL_UNSIGNED_BYTE, view.palette(view.page(i + layer)));
+            }
+
+            glBindTexture(target, textures[i]);
+            glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(target, GL_TEXTURE_MAG_FILTER, format.filter);
+            glTexParameteri(target, GL_TEXTURE_MIN_FILTER, page.levels > 1 ? format.mip_filter : format.filter);
+            glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, static_cast<int>(page.levels) - 1);
+
+            for(uint32_t level = 0; level < page.levels; ++level) {
+                // The whole level of a texture array is allocated at once, and then filled in layer by layer.
+                if(view.is_array()) {
+                    int width = std::max(1, static_cast<int>(page.width >> level)), height = std::max(1, static_cast<int>(page.height >> level));
+                    if(format.compressed) {
+                        glCompressedTexImage3D(target, level, format.compressed, width, height, layers, 0, static_cast<int>(atlas_view::level_size(page, level) * layers), nullptr);
+                    } else {
+                        glTexImage3D(target, level, format.internal, width, height, layers, 0, format.pixels, GL_UNSIGNED_BYTE, nullptr);
+                    }
+                }
+
+                for(int layer = 0; layer < layers; ++layer) upload_level(view, view.page(i + layer), level, format, view.is_array() ? layer : -1, decoded);
+            }
+        }
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindTexture(target, 0);
+        log::msg("Loaded atlas '%s' with %zu pages and %zu regions.", path.c_str(), view.page_count(), view.region_count());
+    }
+
+    atlas::~atlas() {
+        if(!textures.empty()) glDeleteTextures(static_cast<int>(textures.size()), textures.data());
+        for(unsigned int palette : palettes) if(palette) glDeleteTextures(1, &palette);
+
+#ifdef _WIN32
+        if(mapping) UnmapViewOfFile(mapping);
+        if(mapping_handle) CloseHandle(mapping_handle);
+#else
+        if(mapping) munmap(mapping, mapping_size);
+#endif
+    }
+}
@@ -0,0 +1,264 @@
+#include <av/core/graphics/dynamic_atlas.hpp>
+#include <av/util/log.hpp>
+#include <av/util/thread_pool.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+namespace av {
+    namespace {
+        /** @brief The heuristic regions are packed with, both at runtime and when repacking. */
+        constexpr guillotine_bin_pack::heuristic packing = guillotine_bin_pack::heuristic::best_short_side_fit;
+
+        /** @brief Copies RGBA pixels into the middle of a larger buffer, extruding their edges over the border. */
+        void extrude(const uint8_t *pixels, int width, int height, int padding, std::vector<uint8_t> &out) {
+            int out_width = width + padding * 2, out_height = height + padding * 2;
+            size_t row_size = static_cast<size_t>(width) * 4, out_row_size = static_cast<size_t>(out_width) * 4;
+            out.resize(out_row_size * out_height);
+
+            for(int y = 0; y < out_height; ++y) {
+                const uint8_t *src = pixels + static_cast<size_t>(std::clamp(y - padding, 0, height - 1)) * row_size;
+                uint8_t *dst = out.data() + static_cast<size_t>(y) * out_row_size;
+
+                for(int x = 0; x < padding; ++x) std::memcpy(dst + static_cast<size_t>(x) * 4, src, 4);
+                std::memcpy(dst + static_cast<size_t>(padding) * 4, src, row_size);
+                for(int x = padding + width; x < out_width; ++x) std::memcpy(dst + static_cast<size_t>(x) * 4, src + row_size - 4, 4);
+            }
+        }
+
+        /** @brief Creates a texture of the given size with undefined contents, and leaves it bound. */
+        unsigned int create_texture(int width, int height) {
+            unsigned int texture;
+            glGenTextures(1, &texture);
+
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+            return texture;
+        }
+    }
+
+    dynamic_atlas::dynamic_atlas(int width, int height, int padding):
+        width(width),
+        height(height),
+        padding(padding),
+        texture(create_texture(width, height)),
+        bin(width, height, false),
+        newest(npos),
+        oldest(npos),
+        live_count(0),
+        frame(0),
+        generation(0) {
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    dynamic_atlas::~dynamic_atlas() {
+        glDeleteTextures(1, &texture);
+    }
+
+    uint32_t dynamic_atlas::slot_of(handle region_handle) const {
+        uint32_t slot = static_cast<uint32_t>(region_handle), version = static_cast<uint32_t>(region_handle >> 32);
+        if(slot >= regions.size() || !regions[slot].live || regions[slot].version != version) return npos;
+
+        return slot;
+    }
+
+    rect dynamic_atlas::padded(const rect &area) const {
+        return {area.x - padding, area.y - padding, area.width + padding * 2, area.height + padding * 2};
+    }
+
+    void dynamic_atlas::unlink(uint32_t slot) {
+        region &r = regions[slot];
+        (r.newer == npos ? newest : regions[r.newer].older) = r.older;
+        (r.older == npos ? oldest : regions[r.older].newer) = r.newer;
+        r.newer = r.older = npos;
+    }
+
+    void dynamic_atlas::link_newest(uint32_t slot) {
+        region &r = regions[slot];
+        r.newer = npos;
+        r.older = newest;
+
+        (newest == npos ? oldest : regions[newest].newer) = slot;
+        newest = slot;
+    }
+
+    void dynamic_atlas::release(uint32_t slot) {
+        region &r = regions[slot];
+        bin.remove(padded(r.area));
+        unlink(slot);
+
+        r.live = false;
+        if(!++r.version) r.version = 1;
+
+        free_slots.push_back(slot);
+        --live_count;
+    }
+
+    dynamic_atlas::handle dynamic_atlas::insert(int width, int height, const uint8_t *pixels) {
+        int padded_width = width + padding * 2, padded_height = height + padding * 2;
+        if(width <= 0 || height <= 0 || padded_width > this->width || padded_height > this->height) return 0;
+
+        // Regions used this frame are the newest, so eviction stops once it reaches them.
+        rect node = bin.insert(padded_width, padded_height, packing);
+        while(!node.height && oldest != npos && regions[oldest].last_used < frame) {
+            release(oldest);
+            node = bin.insert(padded_width, padded_height, packing);
+        }
+
+        if(!node.height) return 0;
+
+        uint32_t slot;
+        if(!free_slots.empty()) {
+            slot = free_slots.back();
+            free_slots.pop_back();
+        } else {
+            slot = static_cast<uint32_t>(regions.size());
+            regions.push_back({});
+            regions.back().version = 1;
+        }
+
+        region &r = regions[slot];
+        r.area = {node.x + padding, node.y + padding, width, height};
+        r.last_used = frame;
+        r.live = true;
+        link_newest(slot);
+        ++live_count;
+
+        // Rows are 4-byte RGBA pixels, so the default unpack alignment of 4 always holds.
+        const uint8_t *upload = pixels;
+        if(padding) {
+            extrude(pixels, width, height, padding, staging);
+            upload = staging.data();
+        }
+
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, node.x, node.y, padded_width, padded_height, GL_RGBA, GL_UNSIGNED_BYTE, upload);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        return (static_cast<handle>(r.version) << 32) | slot;
+    }
+
+    void dynamic_atlas::remove(handle region_handle) {
+        uint32_t slot = slot_of(region_handle);
+        if(slot != npos) release(slot);
+    }
+
+    const rect *dynamic_atlas::use(handle region_handle) {
+        uint32_t slot = slot_of(region_handle);
+        if(slot == npos) return nullptr;
+
+        region &r = regions[slot];
+        r.last_used = frame;
+        if(newest != slot) {
+            unlink(slot);
+            link_newest(slot);
+        }
+
+        return &r.area;
+    }
+
+    void dynamic_atlas::defragment(thread_pool &pool) {
+        if(job) return;
+
+        job = std::make_shared<defrag_job>();
+        job->versions.assign(regions.size(), 0);
+        job->sizes.reserve(live_count);
+
+        for(uint32_t slot = oldest; slot != npos; slot = regions[slot].newer) {
+            const region &r = regions[slot];
+            job->sizes.push_back({r.area.width + padding * 2, r.area.height + padding * 2, static_cast<int>(slot)});
+            job->versions[slot] = r.version;
+        }
+
+        // The job is shared, so it may finish after the atlas is gone.
+        pool.submit([shared = job, width = width, height = height]() {
+            shared->bin.init(width, height, false);
+            shared->bin.insert(shared->sizes, shared->placed, shared->ids, packing);
+            shared->done.store(true, std::memory_order_release);
+        });
+    }
+
+    bool dynamic_atlas::apply_defrag() {
+        defrag_job &done = *job;
+        if(!done.sizes.empty()) return false;
+
+        // Regions removed since give their space back, and regions inserted since are packed around the rest.
+        guillotine_bin_pack &fresh = done.bin;
+        std::vector<rect> targets(regions.size(), rect{0, 0, 0, 0});
+        for(size_t i = 0; i < done.placed.size(); ++i) {
+            uint32_t slot = static_cast<uint32_t>(done.ids[i]);
+            if(regions[slot].live && regions[slot].version == done.versions[slot]) {
+                targets[slot] = done.placed[i];
+            } else {
+                fresh.remove(done.placed[i]);
+            }
+        }
+
+        for(uint32_t slot = oldest; slot != npos; slot = regions[slot].newer) {
+            if(targets[slot].height) continue;
+
+            const rect &area = regions[slot].area;
+            targets[slot] = fresh.insert(area.width + padding * 2, area.height + padding * 2, packing);
+            if(!targets[slot].height) return false;
+        }
+
+        unsigned int moved = create_texture(width, height);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        int read_binding, draw_binding;
+        glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &read_binding);
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &draw_binding);
+        bool scissor = glIsEnabled(GL_SCISSOR_TEST);
+        if(scissor) glDisable(GL_SCISSOR_TEST);
+
+        unsigned int framebuffers[2];
+        glGenFramebuffers(2, framebuffers);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffers[0]);
+        glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffers[1]);
+        glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, moved, 0);
+
+        for(uint32_t slot = oldest; slot != npos; slot = regions[slot].newer) {
+            region &r = regions[slot];
+            rect from = padded(r.area), &to = targets[slot];
+
+            glBlitFramebuffer(
+                from.x, from.y, from.x + from.width, from.y + from.height,
+                to.x, to.y, to.x + to.width, to.y + to.height,
+                GL_COLOR_BUFFER_BIT, GL_NEAREST
+            );
+
+            r.area = {to.x + padding, to.y + padding, r.area.width, r.area.height};
+        }
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, read_binding);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, draw_binding);
+        glDeleteFramebuffers(2, framebuffers);
+        if(scissor) glEnable(GL_SCISSOR_TEST);
+
+        glDeleteTextures(1, &texture);
+        texture = moved;
+        bin = std::move(fresh);
+        ++generation;
+
+        return true;
+    }
+
+    void dynamic_atlas::update() {
+        ++frame;
+        if(!job || !job->done.load(std::memory_order_acquire)) return;
+
+        if(apply_defrag()) {
+            log::msg<log_level::debug>("Defragmented a %dx%d dynamic atlas to %.2f%% occupancy with %zu regions.", width, height, bin.occupancy() * 100.0, live_count);
+        } else {
+            log::msg<log_level::debug>("Dropped the defragmentation of a %dx%d dynamic atlas, as its regions no longer fit.", width, height);
+        }
+
+        job.reset();
+    }
+}
@@ -6,6 +6,7 @@ namespace av {
     const vert_attribute vert_attribute::pos_2D = vert_attribute::create<2, GL_FLOAT>("a_pos");
     const vert_attribute vert_attribute::color = vert_attribute::create<4, GL_FLOAT>("a_col");
     const vert_attribute vert_attribute::color_packed = vert_attribute::create<4, GL_UNSIGNED_BYTE, true>("a_col");
+    const vert_attribute vert_attribute::layer = vert_attribute::create<1, GL_FLOAT>("a_layer");
 
     int vert_attribute::count_size() const {
         switch(type) {
@@ -20,14 +21,8 @@ namespace av {
         }
     }
 
-    mesh::mesh(std::initializer_list<vert_attribute> attributes):
-        vertex_size([&]() -> size_t {
-        size_t size = 0;
-        for(const vert_attribute &attribute : attributes) size += attribute.size;
-        return size;
-    }()),
-
-        attributes(attributes),
+    mesh_buffers::mesh_buffers(size_t vertex_size):
+        vertex_size(vertex_size),
         max_vertices(0),
         max_elements(0),
         has_elements(false),
@@ -46,24 +41,35 @@ namespace av {
         return index_buffer;
     }()) {}
 
-    mesh::~mesh() {
+    mesh_buffers::~mesh_buffers() {
         glDeleteBuffers(1, &vertex_buffer);
         glDeleteBuffers(1, &element_buffer);
     }
 
-    void mesh::render(const shader &program, int primitive_type, size_t offset, size_t count, bool auto_bind) const {
-        if(auto_bind) bind(program);
-
+    void mesh_buffers::draw(int primitive_type, size_t offset, size_t count) const {
         if(has_elements) {
             glDrawElements(primitive_type, count, GL_UNSIGNED_SHORT, reinterpret_cast<void*>(offset));
         } else {
             glDrawArrays(primitive_type, offset, count);
         }
+    }
 
+    mesh<>::mesh(std::initializer_list<vert_attribute> attributes):
+        mesh_buffers([&]() -> size_t {
+        size_t size = 0;
+        for(const vert_attribute &attribute : attributes) size += attribute.size;
+        return size;
+    }()),
+
+        attributes(attributes) {}
+
+    void mesh<>::render(const shader &program, int primitive_type, size_t offset, size_t count, bool auto_bind) const {
+        if(auto_bind) bind(program);
+        draw(primitive_type, offset, count);
         if(auto_bind) unbind(program);
     }
 
-    void mesh::bind(const shader &program) const {
+    void mesh<>::bind(const shader &program) const {
         glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
 
         size_t off = 0;
@@ -79,7 +85,7 @@ namespace av {
         if(has_elements) glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, element_buffer);
     }
 
-    void mesh::unbind(const shader &program) const {
+    void mesh<>::unbind(const shader &program) const {
         for(const vert_attribute &attr : attributes) glDisableVertexAttribArray(program.attribute_loc(attr.name));
 
         glBindBuffer(GL_ARRAY_BUFFER, 0);
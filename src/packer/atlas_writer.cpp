@@ -0,0 +1,244 @@
+#include <packer/atlas_writer.hpp>
+#include <av/util/hash.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_set>
+
+namespace av {
+    namespace {
+        /** @brief The displacement of every bucket and the slot of every name, for a given seed. */
+        struct perfect_hash {
+            uint64_t seed;
+            std::vector<uint64_t> hashes;
+            std::vector<uint32_t> displacements;
+            std::vector<uint32_t> slots;
+        };
+
+        /** @return Whether a displacement was found for every bucket; only fails on the rare unlucky seed. */
+        bool build_hash(const std::vector<atlas_entry> &entries, perfect_hash &hash) {
+            uint32_t count = static_cast<uint32_t>(entries.size());
+            uint32_t bucket_count = std::max<uint32_t>(1, (count + 3) / 4);
+
+            hash.hashes.resize(count);
+            hash.displacements.assign(bucket_count, 0);
+            hash.slots.resize(count);
+
+            std::vector<std::vector<uint32_t>> buckets(bucket_count);
+            for(uint32_t i = 0; i < count; ++i) {
+                const std::string &name = entries[i].name;
+                hash.hashes[i] = hash64(name.data(), name.size(), hash.seed);
+                buckets[atlas_view::bucket_of(hash.hashes[i], bucket_count)].push_back(i);
+            }
+
+            // Larger buckets are harder to place, so they go first while most slots are still free.
+            std::vector<uint32_t> order(bucket_count);
+            for(uint32_t i = 0; i < bucket_count; ++i) order[i] = i;
+            std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return buckets[a].size() > buckets[b].size(); });
+
+            std::vector<char> taken(count);
+            std::vector<uint32_t> candidate;
+            uint64_t attempts = std::min<uint64_t>(UINT32_MAX, std::max<uint64_t>(1 << 16, 64ull * count));
+
+            for(uint32_t b : order) {
+                const std::vector<uint32_t> &members = buckets[b];
+                if(members.empty()) break;
+
+                bool placed = false;
+                for(uint64_t d = 0; d < attempts && !placed; ++d) {
+                    candidate.clear();
+                    placed = true;
+                    for(uint32_t i : members) {
+                        uint32_t slot = atlas_view::slot_of(hash.hashes[i], static_cast<uint32_t>(d), count);
+                        if(taken[slot] || std::find(candidate.begin(), candidate.end(), slot) != candidate.end()) {
+                            placed = false;
+                            break;
+                        }
+
+                        candidate.push_back(slot);
+                    }
+
+                    if(placed) hash.displacements[b] = static_cast<uint32_t>(d);
+                }
+
+                if(!placed) return false;
+                for(size_t k = 0; k < members.size(); ++k) {
+                    taken[candidate[k]] = 1;
+                    hash.slots[members[k]] = candidate[k];
+                }
+            }
+
+            return true;
+        }
+
+        inline uint64_t align(uint64_t offset, uint64_t alignment) {
+            return (offset + alignment - 1) / alignment * alignment;
+        }
+    }
+
+    atlas_writer::atlas_writer(const std::string &path, const std::vector<atlas_page> &pages, const std::vector<atlas_entry> &entries, uint32_t flags):
+        path(path),
+        temp_path(path + ".tmp"),
+        out(temp_path, std::ios::binary),
+        pages(pages) {
+        if(!out) throw std::runtime_error(std::string("Couldn't write '").append(temp_path).append("'."));
+
+        std::unordered_set<std::string_view> names;
+        for(const atlas_entry &entry : entries) {
+            if(!names.insert(entry.name).second) throw std::runtime_error(std::string("Duplicate region name '").append(entry.name).append("'."));
+        }
+
+        perfect_hash hash;
+        for(hash.seed = 0; !build_hash(entries, hash); ++hash.seed);
+
+        std::memcpy(header.magic, atlas_magic, sizeof(header.magic));
+        header.version = atlas_version;
+        header.flags = flags;
+        header.page_count = static_cast<uint32_t>(pages.size());
+        header.region_count = static_cast<uint32_t>(entries.size());
+        header.bucket_count = static_cast<uint32_t>(hash.displacements.size());
+        header.seed = hash.seed;
+
+        header.pages_offset = sizeof(atlas_header);
+        header.buckets_offset = header.pages_offset + pages.size() * sizeof(atlas_page);
+        header.regions_offset = align(header.buckets_offset + hash.displacements.size() * sizeof(uint32_t), alignof(atlas_region));
+        header.names_offset = header.regions_offset + entries.size() * sizeof(atlas_region);
+
+        std::vector<atlas_region> regions(entries.size());
+        for(size_t i = 0; i < entries.size(); ++i) {
+            const atlas_entry &entry = entries[i];
+            atlas_region &region = regions[hash.slots[i]];
+
+            region.hash = hash.hashes[i];
+            region.name_offset = static_cast<uint32_t>(header.names_size);
+            region.name_length = static_cast<uint32_t>(entry.name.size());
+            region.page = static_cast<uint32_t>(entry.page);
+            region.x = entry.region.x;
+            region.y = entry.region.y;
+            region.width = entry.region.width;
+            region.height = entry.region.height;
+            region.flags = entry.flipped ? atlas_region_flipped : 0;
+            region.offset_x = entry.bounds.x;
+            region.offset_y = entry.bounds.y;
+            region.source_width = entry.source_width;
+            region.source_height = entry.source_height;
+            region.first_vertex = static_cast<uint32_t>(header.vertex_count);
+            region.vertex_count = static_cast<uint32_t>(entry.vertices.size() / atlas_vertex_floats);
+            region.first_index = static_cast<uint32_t>(header.index_count);
+            region.index_count = static_cast<uint32_t>(entry.indices.size());
+
+            header.names_size += entry.name.size();
+            header.vertex_count += region.vertex_count;
+            header.index_count += region.index_count;
+        }
+
+        header.vertices_offset = align(header.names_offset + header.names_size, alignof(float));
+        header.indices_offset = header.vertices_offset + header.vertex_count * atlas_vertex_floats * sizeof(float);
+
+        // Until pages are written, their records only serve to take up space.
+        write(&header, sizeof(header));
+        write(this->pages.data(), this->pages.size() * sizeof(atlas_page));
+        write(hash.displacements.data(), hash.displacements.size() * sizeof(uint32_t));
+        pad(header.regions_offset);
+        write(regions.data(), regions.size() * sizeof(atlas_region));
+        for(const atlas_entry &entry : entries) write(entry.name.data(), entry.name.size());
+
+        pad(header.vertices_offset);
+        for(const atlas_entry &entry : entries) write(entry.vertices.data(), entry.vertices.size() * sizeof(float));
+        for(const atlas_entry &entry : entries) write(entry.indices.data(), entry.indices.size() * sizeof(uint16_t));
+    }
+
+    void atlas_writer::write(const void *data, uint64_t size) {
+        out.write(static_cast<const char *>(data), size);
+        position += size;
+    }
+
+    void atlas_writer::pad(uint64_t offset) {
+        static const char zeros[atlas_alignment] = {};
+        while(position < offset) write(zeros, std::min(offset - position, atlas_alignment));
+    }
+
+    const atlas_page &atlas_writer::begin_page(uint32_t width, uint32_t height, uint32_t levels, uint32_t format) {
+        if(written >= pages.size()) throw std::runtime_error("Too many atlas pages.");
+
+        atlas_page &page = pages[written++];
+        if(page.width != width || page.height != height || page.levels != levels) throw std::runtime_error("Atlas page doesn't match its record.");
+        if((header.flags & atlas_flag_array) && (page.width != pages[0].width || page.height != pages[0].height || (written > 1 && format != pages[0].format))) {
+            throw std::runtime_error("Atlas array layers must share a size and format.");
+        }
+
+        page.format = format;
+        page.offset = align(position, atlas_alignment);
+        page.size = atlas_view::page_size(page);
+
+        pad(page.offset);
+        return page;
+    }
+
+    void atlas_writer::write_page(const std::vector<image> &levels) {
+        const atlas_page &page = begin_page(levels.front().width, levels.front().height, static_cast<uint32_t>(levels.size()), atlas_format_rgba8);
+        for(uint32_t level = 0; level < page.levels; ++level) {
+            assert(levels[level].pixels.size() == atlas_view::level_size(page, level));
+            write(levels[level].pixels.data(), levels[level].pixels.size());
+        }
+    }
+
+    void atlas_writer::write_page(uint32_t width, uint32_t height, uint32_t format, const std::vector<std::vector<unsigned char>> &levels, const std::vector<unsigned char> &palette) {
+        const atlas_page &page = begin_page(width, height, static_cast<uint32_t>(levels.size()), format);
+        if(palette.size() != atlas_view::palette_size(format)) throw std::runtime_error("Atlas page doesn't match its record.");
+
+        write(palette.data(), palette.size());
+        for(uint32_t level = 0; level < page.levels; ++level) {
+            if(levels[level].size() != atlas_view::level_size(page, level)) throw std::runtime_error("Atlas page doesn't match its record.");
+            write(levels[level].data(), levels[level].size());
+        }
+    }
+
+    void atlas_writer::copy_page(std::istream &from, const atlas_page &page) {
+        begin_page(page.width, page.height, page.levels, page.format);
+        if(!from.seekg(page.offset)) throw std::runtime_error("Couldn't read the atlas page to copy.");
+
+        std::vector<char> buffer(1 << 20);
+        for(uint64_t left = page.size; left;) {
+            uint64_t chunk = std::min<uint64_t>(left, buffer.size());
+            if(!from.read(buffer.data(), chunk)) throw std::runtime_error("Couldn't read the atlas page to copy.");
+
+            write(buffer.data(), chunk);
+            left -= chunk;
+        }
+    }
+
+    void atlas_writer::finish() {
+        if(written != pages.size()) throw std::runtime_error("Missing atlas pages.");
+
+        header.file_size = position;
+        out.seekp(0);
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char *>(pages.data()), pages.size() * sizeof(atlas_page));
+        out.close();
+        if(!out) throw std::runtime_error(std::string("Couldn't write '").append(temp_path).append("'."));
+
+        std::filesystem::rename(temp_path, path);
+    }
+
+    std::vector<atlas_page> atlas_writer::read_pages(std::istream &from) {
+        atlas_header header;
+        if(!from.seekg(0) || !from.read(reinterpret_cast<char *>(&header), sizeof(header))) throw std::runtime_error("Truncated atlas header.");
+        if(std::memcmp(header.magic, atlas_magic, sizeof(header.magic)) || header.version != atlas_version) throw std::runtime_error("Not an atlas of this version.");
+
+        std::vector<atlas_page> pages(header.page_count);
+        if(!from.seekg(header.pages_offset) || !from.read(reinterpret_cast<char *>(pages.data()), pages.size() * sizeof(atlas_page))) throw std::runtime_error("Truncated atlas pages.");
+
+        for(const atlas_page &page : pages) {
+            if(page.format > atlas_format_indexed8 || page.size != atlas_view::page_size(page) || page.offset + page.size > header.file_size) throw std::runtime_error("Invalid atlas page.");
+        }
+
+        return pages;
+    }
+}
@@ -0,0 +1,115 @@
+#ifndef AV_PACKER_ATLASWRITER_HPP
+#define AV_PACKER_ATLASWRITER_HPP
+
+#include <packer/image.hpp>
+#include <av/util/graphics/atlas_file.hpp>
+#include <av/util/packing/rect.hpp>
+
+#include <cstdint>
+#include <fstream>
+#include <istream>
+#include <string>
+#include <vector>
+
+namespace av {
+    /** @brief A named region to write to a binary atlas. */
+    struct atlas_entry {
+        std::string name;
+        size_t page;
+        rect region;
+        bool flipped;
+        /** @brief The unrotated region within the original sprite, and the original sprite size. */
+        rect bounds;
+        int source_width, source_height;
+        /** @brief The region mesh, laid out as `atlas_region` describes, or nothing for none. */
+        std::vector<float> vertices;
+        std::vector<uint16_t> indices;
+    };
+
+    /**
+     * @brief Writes a binary atlas file, as read by `atlas_view`, one page at a time so that only the pages being
+     * written have to be in memory. The region names are indexed with a minimal perfect hash, built by hashing every
+     * name into a bucket and then finding, largest bucket first, a displacement that sends all of the names of a bucket
+     * to free slots.
+     *
+     * The file is written next to its final path and only replaces it in `finish()`, so the previous atlas at that path
+     * stays readable until then, e.g. to copy unchanged pages from. Every page can be in its own format, which is only
+     * settled once it's written, so the header and page records are written again at that point too.
+     */
+    class atlas_writer {
+        /** @brief The final path, and the path being written to until `finish()`. */
+        std::string path, temp_path;
+        std::ofstream out;
+        atlas_header header = {};
+        /** @brief Every page record, of which the format, offset and size are filled in as the page is written. */
+        std::vector<atlas_page> pages;
+        /** @brief How many pages were written so far; they must be written in order. */
+        size_t written = 0;
+        /** @brief How many bytes were written so far. */
+        uint64_t position = 0;
+
+        void write(const void *data, uint64_t size);
+        /** @brief Writes zeros up to the given offset. */
+        void pad(uint64_t offset);
+        /** @brief Pads up to the next page, checking that it has the given size, and fills in the rest of its record. */
+        const atlas_page &begin_page(uint32_t width, uint32_t height, uint32_t levels, uint32_t format);
+
+        public:
+        atlas_writer(const atlas_writer &) = delete;
+        /**
+         * @brief Writes everything that comes before the pixels. An exception is thrown if the file couldn't be written.
+         *
+         * @param path    The output file path.
+         * @param pages   The pages, of which only `width`, `height` and `levels` are used.
+         * @param entries The regions. Names must be unique, and pages must be indices into `pages`.
+         * @param flags   The `atlas_flag_*` constants of the atlas. With `atlas_flag_array`, every page must be written
+         *                in the same format, and be the same size.
+         */
+        atlas_writer(const std::string &path, const std::vector<atlas_page> &pages, const std::vector<atlas_entry> &entries, uint32_t flags = 0);
+
+        /**
+         * @brief Writes the next page, of 8-bit RGBA pixels.
+         *
+         * @param levels The mip levels of the page, from the full size page down, each level being half the size of
+         *               the previous one as made by `image::downsample()`. Must match the page given at construction.
+         */
+        void write_page(const std::vector<image> &levels);
+
+        /**
+         * @brief Writes the next page, already encoded in another format, e.g. by `encode_blocks()`.
+         *
+         * @param width   The page width.
+         * @param height  The page height.
+         * @param format  The `atlas_format_*` constant of the page.
+         * @param levels  The mip levels of the page, each as large as `atlas_view::level_size()` says. Must match the
+         *                page given at construction.
+         * @param palette The `atlas_palette_colors` 8-bit RGBA colors of an indexed page, or nothing for other formats.
+         */
+        void write_page(uint32_t width, uint32_t height, uint32_t format, const std::vector<std::vector<unsigned char>> &levels, const std::vector<unsigned char> &palette = {});
+
+        /**
+         * @brief Writes the next page by copying a page of another atlas file.
+         *
+         * @param from The other atlas file.
+         * @param page The page record of the other atlas file, as returned by `read_pages()`. Must match the page
+         *             given at construction, but for its format, which is kept.
+         */
+        void copy_page(std::istream &from, const atlas_page &page);
+
+        /**
+         * @brief Writes the page records, now that they're complete, and replaces the file at the output path with the
+         * written one, once every page was written.
+         */
+        void finish();
+
+        /**
+         * @brief Reads the page records of an atlas file, without the rest of it.
+         *
+         * @param from The atlas file.
+         * @return The page records. An exception is thrown if the file isn't an atlas of this version.
+         */
+        static std::vector<atlas_page> read_pages(std::istream &from);
+    };
+}
+
+#endif // !AV_PACKER_ATLASWRITER_HPP
@@ -0,0 +1,501 @@
+#include <packer/block_encoder.hpp>
+#include <packer/simd.hpp>
+#include <av/util/graphics/atlas_file.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace av {
+    namespace {
+        /** @brief The pixels of a block, channel by channel so that a vector holds a channel of several pixels. */
+        struct block {
+            int32_t channels[4][16];
+            /** @brief `-1` for the pixels whose color counts, `0` for those left fully transparent; alpha always counts. */
+            int32_t active[16];
+        };
+
+        /** @brief The colors a block interpolates between its endpoints, for its pixels to pick from. */
+        struct palette {
+            int32_t colors[16][4];
+            int count;
+        };
+
+        /** @brief Two ends of a line through the colors of a block, as unquantized endpoints. */
+        using line = float[2][4];
+
+        /** @brief Writes the bits of a 16-byte block, from the lowest bit of the first byte up. */
+        class bit_writer {
+            unsigned char *out;
+            int position = 0;
+
+            public:
+            bit_writer(unsigned char *out): out(out) {
+                std::memset(out, 0, 16);
+            }
+
+            void write(uint32_t value, int count) {
+                for(int i = 0; i < count; ++i, ++position) out[position >> 3] |= static_cast<unsigned char>((value >> i & 1) << (position & 7));
+            }
+        };
+
+        inline float clamp_channel(double value) {
+            return static_cast<float>(std::clamp(value, 0.0, 255.0));
+        }
+
+        /** @brief Reads the block at the given position, repeating the edge pixels past the edges. */
+        void load_block(const image &pixels, int x, int y, block &b) {
+            for(int row = 0; row < 4; ++row) {
+                const unsigned char *src = pixels.pixels.data() + static_cast<size_t>(std::min(y + row, pixels.height - 1)) * pixels.width * 4;
+                for(int column = 0; column < 4; ++column) {
+                    const unsigned char *pixel = src + static_cast<size_t>(std::min(x + column, pixels.width - 1)) * 4;
+                    for(int c = 0; c < 4; ++c) b.channels[c][row * 4 + column] = pixel[c];
+                }
+            }
+        }
+
+        /**
+         * @brief Picks the closest palette entry of every pixel over a range of channels, with every lane of a vector
+         * comparing a pixel against the same entry.
+         *
+         * @return The squared error, without the color of inactive pixels.
+         */
+        int64_t select(const block &b, const palette &p, int first, int count, uint8_t (&indices)[16]) {
+            int64_t total = 0;
+            for(int i = 0; i < 16; i += simd::vint::lanes) {
+                simd::vint active = simd::load(b.active + i), values[4];
+                for(int c = 0; c < count; ++c) values[c] = simd::load(b.channels[first + c] + i);
+
+                simd::vint best = simd::set1(std::numeric_limits<int32_t>::max()), picked = simd::set1(0);
+                for(int k = 0; k < p.count; ++k) {
+                    simd::vint error = simd::set1(0);
+                    for(int c = 0; c < count; ++c) {
+                        simd::vint difference = simd::set1(p.colors[k][first + c]) - values[c];
+                        if(first + c < 3) difference = difference & active;
+                        error = error + difference * difference;
+                    }
+
+                    // Only strictly better entries replace the pick, so that ties go to the first one.
+                    simd::vint better = best > error;
+                    best = simd::min(best, error);
+                    picked = picked + ((simd::set1(k) - picked) & better);
+                }
+
+                int32_t errors[simd::vint::lanes], picks[simd::vint::lanes];
+                simd::store(errors, best);
+                simd::store(picks, picked);
+                for(int lane = 0; lane < simd::vint::lanes; ++lane) {
+                    indices[i + lane] = static_cast<uint8_t>(picks[lane]);
+                    total += errors[lane];
+                }
+            }
+
+            return total;
+        }
+
+        /** @brief Finds the ends of the principal axis of the active pixels over the first channels. */
+        void fit_line(const block &b, int count, line &ends) {
+            double mean[4] = {};
+            int active = 0;
+            for(int i = 0; i < 16; ++i) {
+                if(!b.active[i]) continue;
+
+                for(int c = 0; c < count; ++c) mean[c] += b.channels[c][i];
+                ++active;
+            }
+
+            for(int c = 0; c < count; ++c) mean[c] /= std::max(active, 1);
+
+            double covariance[4][4] = {};
+            for(int i = 0; i < 16; ++i) {
+                if(!b.active[i]) continue;
+
+                for(int c = 0; c < count; ++c) {
+                    for(int d = 0; d < count; ++d) covariance[c][d] += (b.channels[c][i] - mean[c]) * (b.channels[d][i] - mean[d]);
+                }
+            }
+
+            // Power iteration, starting from the channel that varies the most.
+            double axis[4] = {};
+            int widest = 0;
+            for(int c = 1; c < count; ++c) if(covariance[c][c] > covariance[widest][widest]) widest = c;
+            axis[widest] = 1.0;
+
+            for(int iteration = 0; iteration < 8; ++iteration) {
+                double next[4] = {}, length = 0.0;
+                for(int c = 0; c < count; ++c) {
+                    for(int d = 0; d < count; ++d) next[c] += covariance[c][d] * axis[d];
+                    length += next[c] * next[c];
+                }
+
+                if(length <= 0.0) break;
+                for(int c = 0; c < count; ++c) axis[c] = next[c] / std::sqrt(length);
+            }
+
+            double low = 0.0, high = 0.0;
+            for(int i = 0; i < 16; ++i) {
+                if(!b.active[i]) continue;
+
+                double t = 0.0;
+                for(int c = 0; c < count; ++c) t += (b.channels[c][i] - mean[c]) * axis[c];
+                low = std::min(low, t);
+                high = std::max(high, t);
+            }
+
+            for(int c = 0; c < 4; ++c) {
+                ends[0][c] = c < count ? clamp_channel(mean[c] + axis[c] * low) : 0.0f;
+                ends[1][c] = c < count ? clamp_channel(mean[c] + axis[c] * high) : 0.0f;
+            }
+        }
+
+        /**
+         * @brief Refits the ends of a line to the active pixels by least squares, given how far towards the second end
+         * the palette entry every pixel picked is. Alpha is fit to every pixel.
+         *
+         * @return Whether there was a single best fit; there isn't if every pixel picked the same weight.
+         */
+        bool refit(const block &b, int count, const uint8_t (&indices)[16], const float *weights, line &ends) {
+            // The sums over the active pixels for color, then over every pixel for alpha.
+            double aa[2] = {}, ab[2] = {}, bb[2] = {}, xa[4] = {}, xb[4] = {};
+            for(int i = 0; i < 16; ++i) {
+                double w = weights[indices[i]], v = 1.0 - w;
+                for(int set = b.active[i] ? 0 : 1; set < 2; ++set) {
+                    aa[set] += v * v;
+                    ab[set] += v * w;
+                    bb[set] += w * w;
+                }
+
+                for(int c = 0; c < count; ++c) {
+                    if(c < 3 && !b.active[i]) continue;
+
+                    xa[c] += v * b.channels[c][i];
+                    xb[c] += w * b.channels[c][i];
+                }
+            }
+
+            for(int set = 0; set < (count > 3 ? 2 : 1); ++set) if(std::abs(aa[set] * bb[set] - ab[set] * ab[set]) < 1e-6) return false;
+
+            for(int c = 0; c < count; ++c) {
+                int set = c < 3 ? 0 : 1;
+                double determinant = aa[set] * bb[set] - ab[set] * ab[set];
+                ends[0][c] = clamp_channel((bb[set] * xa[c] - ab[set] * xb[c]) / determinant);
+                ends[1][c] = clamp_channel((aa[set] * xb[c] - ab[set] * xa[c]) / determinant);
+            }
+
+            return true;
+        }
+
+        inline uint16_t pack565(const float (&color)[4]) {
+            auto quantize = [](float value, int max) { return static_cast<uint16_t>(std::lround(value * max / 255.0f)); };
+            return static_cast<uint16_t>(quantize(color[0], 31) << 11 | quantize(color[1], 63) << 5 | quantize(color[2], 31));
+        }
+
+        inline void unpack565(uint16_t color, int32_t (&out)[4]) {
+            int32_t r = color >> 11 & 31, g = color >> 5 & 63, b = color & 31;
+            out[0] = r << 3 | r >> 2;
+            out[1] = g << 2 | g >> 4;
+            out[2] = b << 3 | b >> 2;
+            out[3] = 255;
+        }
+
+        /**
+         * @brief Encodes the colors of a block into a BC1 color block.
+         *
+         * @param punch_through Whether pixels under half opacity may be left fully transparent, which BC3 color blocks
+         *                      can't do as they always use 4 colors. Without it, only the color of fully transparent
+         *                      pixels is left out, as their alpha block hides it.
+         */
+        void encode_color(block &b, bool punch_through, unsigned char *out) {
+            for(int i = 0; i < 16; ++i) b.active[i] = b.channels[3][i] < (punch_through ? 128 : 1) ? 0 : -1;
+            bool transparent = punch_through && std::any_of(std::begin(b.active), std::end(b.active), [](int32_t active) { return !active; });
+
+            uint16_t best_colors[2] = {};
+            uint8_t best_indices[16] = {};
+            int64_t best_error = std::numeric_limits<int64_t>::max();
+
+            if(std::any_of(std::begin(b.active), std::end(b.active), [](int32_t active) { return active; })) {
+                static constexpr float four[] = {0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f}, three[] = {0.0f, 1.0f, 0.5f};
+
+                line ends;
+                fit_line(b, 3, ends);
+                for(int attempt = 0; attempt < 3; ++attempt) {
+                    // The 4-color mode needs the first color to be greater than the second, and the 3-color mode not.
+                    uint16_t colors[2] = {pack565(ends[0]), pack565(ends[1])};
+                    if(transparent ? colors[0] > colors[1] : colors[0] < colors[1]) {
+                        std::swap(colors[0], colors[1]);
+                        std::swap(ends[0], ends[1]);
+                    }
+
+                    palette p;
+                    unpack565(colors[0], p.colors[0]);
+                    unpack565(colors[1], p.colors[1]);
+                    for(int c = 0; c < 3; ++c) {
+                        int32_t first = p.colors[0][c], second = p.colors[1][c];
+                        p.colors[2][c] = transparent ? (first + second) / 2 : (2 * first + second) / 3;
+                        p.colors[3][c] = (first + 2 * second) / 3;
+                    }
+
+                    // Equal colors can't use the 4-color mode, but every pixel picks the first one anyway.
+                    p.count = transparent ? 3 : colors[0] == colors[1] ? 1 : 4;
+
+                    uint8_t indices[16];
+                    int64_t error = select(b, p, 0, 3, indices);
+                    if(error < best_error) {
+                        best_error = error;
+                        std::copy(std::begin(colors), std::end(colors), best_colors);
+                        std::copy(std::begin(indices), std::end(indices), best_indices);
+                    }
+
+                    if(!error || !refit(b, 3, indices, transparent ? three : four, ends)) break;
+                }
+            }
+
+            uint32_t bits = 0;
+            for(int i = 0; i < 16; ++i) bits |= static_cast<uint32_t>(b.active[i] ? best_indices[i] : 3) << (i * 2);
+
+            out[0] = static_cast<unsigned char>(best_colors[0]);
+            out[1] = static_cast<unsigned char>(best_colors[0] >> 8);
+            out[2] = static_cast<unsigned char>(best_colors[1]);
+            out[3] = static_cast<unsigned char>(best_colors[1] >> 8);
+            for(int i = 0; i < 4; ++i) out[4 + i] = static_cast<unsigned char>(bits >> (i * 8));
+        }
+
+        /** @brief Encodes the alpha of a block into a BC3 alpha block. */
+        void encode_alpha(const block &b, unsigned char *out) {
+            int low = 255, high = 0, inner_low = 255, inner_high = 0;
+            for(int32_t alpha : b.channels[3]) {
+                low = std::min(low, alpha);
+                high = std::max(high, alpha);
+                if(alpha == 0 || alpha == 255) continue;
+
+                inner_low = std::min(inner_low, alpha);
+                inner_high = std::max(inner_high, alpha);
+            }
+
+            if(inner_low > inner_high) inner_low = inner_high = 0;
+
+            // 8 values between the extremes if the first is greater, or 6 between the values that aren't 0 nor 255.
+            palette eight, six;
+            int ends[2][2] = {{high, low}, {inner_low, inner_high}};
+            eight.count = six.count = 8;
+            for(int i = 0; i < 8; ++i) {
+                eight.colors[i][3] = i < 2 ? ends[0][i] : ((8 - i) * high + (i - 1) * low) / 7;
+                six.colors[i][3] = i < 2 ? ends[1][i] : i < 6 ? ((6 - i) * inner_low + (i - 1) * inner_high) / 5 : i == 6 ? 0 : 255;
+            }
+
+            uint8_t indices[2][16];
+            int64_t errors[2] = {select(b, eight, 3, 1, indices[0]), select(b, six, 3, 1, indices[1])};
+            int best = errors[1] < errors[0] ? 1 : 0;
+
+            uint64_t bits = 0;
+            for(int i = 0; i < 16; ++i) bits |= static_cast<uint64_t>(indices[best][i]) << (i * 3);
+
+            out[0] = static_cast<unsigned char>(ends[best][0]);
+            out[1] = static_cast<unsigned char>(ends[best][1]);
+            for(int i = 0; i < 6; ++i) out[2 + i] = static_cast<unsigned char>(bits >> (i * 8));
+        }
+
+        /**
+         * @brief Quantizes a BC7 mode 6 endpoint to 7 bits per channel and a shared lowest bit, the one that fits best.
+         *
+         * @param opaque Whether the block is fully opaque, which it must stay, so the lowest bit must be 1.
+         */
+        void quantize_bc7(const float (&end)[4], bool opaque, uint32_t (&channels)[4], uint32_t &low) {
+            float best = std::numeric_limits<float>::infinity();
+            for(uint32_t bit = opaque ? 1 : 0; bit < 2; ++bit) {
+                uint32_t candidate[4];
+                float error = 0.0f;
+                for(int c = 0; c < 4; ++c) {
+                    candidate[c] = static_cast<uint32_t>(std::clamp(std::lround((end[c] - bit) / 2.0f), 0l, 127l));
+                    float difference = static_cast<float>(candidate[c] * 2 + bit) - end[c];
+                    error += difference * difference;
+                }
+
+                if(error < best) {
+                    best = error;
+                    low = bit;
+                    std::copy(std::begin(candidate), std::end(candidate), channels);
+                }
+            }
+        }
+
+        /** @return A BC7 color between two endpoints, given the weight of the second one out of 64. */
+        inline int32_t blend(int32_t a, int32_t b, int weight) {
+            return ((64 - weight) * a + weight * b + 32) >> 6;
+        }
+
+        constexpr int bc7_weights2[] = {0, 21, 43, 64};
+        constexpr int bc7_weights4[] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+        constexpr float bc7_fractions2[] = {0.0f, 21 / 64.0f, 43 / 64.0f, 1.0f};
+        constexpr float bc7_fractions4[] = {
+            0.0f, 4 / 64.0f, 9 / 64.0f, 13 / 64.0f, 17 / 64.0f, 21 / 64.0f, 26 / 64.0f, 30 / 64.0f,
+            34 / 64.0f, 38 / 64.0f, 43 / 64.0f, 47 / 64.0f, 51 / 64.0f, 55 / 64.0f, 60 / 64.0f, 1.0f
+        };
+
+        /**
+         * @brief Encodes a block into a BC7 mode 5 block: 7-bit color and 8-bit alpha endpoints, each with their own
+         * 4 levels, so that alpha doesn't have to follow the color.
+         *
+         * @return The squared error.
+         */
+        int64_t encode_bc7_mode5(block &b, unsigned char *out) {
+            uint32_t best_colors[2][3] = {};
+            uint8_t best_indices[2][16] = {};
+            int64_t best_error = std::numeric_limits<int64_t>::max();
+
+            line ends;
+            fit_line(b, 3, ends);
+            for(int attempt = 0; attempt < 3; ++attempt) {
+                uint32_t colors[2][3];
+                palette p;
+                p.count = 4;
+                for(int e = 0; e < 2; ++e) for(int c = 0; c < 3; ++c) colors[e][c] = static_cast<uint32_t>(std::lround(ends[e][c] * 127 / 255.0f));
+
+                for(int k = 0; k < 4; ++k) {
+                    for(int c = 0; c < 3; ++c) {
+                        int32_t first = static_cast<int32_t>(colors[0][c] << 1 | colors[0][c] >> 6), second = static_cast<int32_t>(colors[1][c] << 1 | colors[1][c] >> 6);
+                        p.colors[k][c] = blend(first, second, bc7_weights2[k]);
+                    }
+                }
+
+                uint8_t indices[16];
+                int64_t error = select(b, p, 0, 3, indices);
+                if(error < best_error) {
+                    best_error = error;
+                    std::memcpy(best_colors, colors, sizeof(colors));
+                    std::copy(std::begin(indices), std::end(indices), best_indices[0]);
+                }
+
+                if(!error || !refit(b, 3, indices, bc7_fractions2, ends)) break;
+            }
+
+            // Alpha endpoints are exact, so its extremes are always worth keeping.
+            int32_t alphas[2] = {255, 0};
+            for(int32_t alpha : b.channels[3]) {
+                alphas[0] = std::min(alphas[0], alpha);
+                alphas[1] = std::max(alphas[1], alpha);
+            }
+
+            palette p;
+            p.count = 4;
+            for(int k = 0; k < 4; ++k) p.colors[k][3] = blend(alphas[0], alphas[1], bc7_weights2[k]);
+            best_error += select(b, p, 3, 1, best_indices[1]);
+
+            // The first index of each set is stored without its top bit, which swapping the endpoints clears.
+            if(best_indices[0][0] & 2) {
+                std::swap(best_colors[0], best_colors[1]);
+                for(uint8_t &index : best_indices[0]) index = static_cast<uint8_t>(3 - index);
+            }
+
+            if(best_indices[1][0] & 2) {
+                std::swap(alphas[0], alphas[1]);
+                for(uint8_t &index : best_indices[1]) index = static_cast<uint8_t>(3 - index);
+            }
+
+            bit_writer bits(out);
+            bits.write(1 << 5, 6);
+            bits.write(0, 2);
+            for(int c = 0; c < 3; ++c) for(int e = 0; e < 2; ++e) bits.write(best_colors[e][c], 7);
+            for(int e = 0; e < 2; ++e) bits.write(static_cast<uint32_t>(alphas[e]), 8);
+            for(int set = 0; set < 2; ++set) for(int i = 0; i < 16; ++i) bits.write(best_indices[set][i], i ? 2 : 1);
+
+            return best_error;
+        }
+
+        /**
+         * @brief Encodes a block into a BC7 mode 6 block: RGBA endpoints with 16 levels between them.
+         *
+         * @return The squared error.
+         */
+        int64_t encode_bc7_mode6(block &b, unsigned char *out) {
+            bool opaque = std::all_of(std::begin(b.channels[3]), std::end(b.channels[3]), [](int32_t alpha) { return alpha == 255; });
+
+            uint32_t best_channels[2][4] = {}, best_low[2] = {};
+            uint8_t best_indices[16] = {};
+            int64_t best_error = std::numeric_limits<int64_t>::max();
+
+            line ends;
+            fit_line(b, 4, ends);
+
+            // Fully transparent pixels only need the alpha of the line to reach 0.
+            if(std::any_of(std::begin(b.active), std::end(b.active), [](int32_t active) { return !active; })) ends[ends[0][3] > ends[1][3] ? 1 : 0][3] = 0.0f;
+
+            for(int attempt = 0; attempt < 3; ++attempt) {
+                uint32_t channels[2][4], low[2];
+                quantize_bc7(ends[0], opaque, channels[0], low[0]);
+                quantize_bc7(ends[1], opaque, channels[1], low[1]);
+
+                palette p;
+                p.count = 16;
+                for(int k = 0; k < 16; ++k) {
+                    for(int c = 0; c < 4; ++c) {
+                        int32_t first = static_cast<int32_t>(channels[0][c] * 2 + low[0]), second = static_cast<int32_t>(channels[1][c] * 2 + low[1]);
+                        p.colors[k][c] = blend(first, second, bc7_weights4[k]);
+                    }
+                }
+
+                uint8_t indices[16];
+                int64_t error = select(b, p, 0, 4, indices);
+                if(error < best_error) {
+                    best_error = error;
+                    std::memcpy(best_channels, channels, sizeof(channels));
+                    std::memcpy(best_low, low, sizeof(low));
+                    std::copy(std::begin(indices), std::end(indices), best_indices);
+                }
+
+                if(!error || !refit(b, 4, indices, bc7_fractions4, ends)) break;
+            }
+
+            // The first index is stored without its top bit, which swapping the endpoints clears.
+            if(best_indices[0] & 8) {
+                std::swap(best_channels[0], best_channels[1]);
+                std::swap(best_low[0], best_low[1]);
+                for(uint8_t &index : best_indices) index = static_cast<uint8_t>(15 - index);
+            }
+
+            bit_writer bits(out);
+            bits.write(1 << 6, 7);
+            for(int c = 0; c < 4; ++c) for(int e = 0; e < 2; ++e) bits.write(best_channels[e][c], 7);
+            bits.write(best_low[0], 1);
+            bits.write(best_low[1], 1);
+            for(int i = 0; i < 16; ++i) bits.write(best_indices[i], i ? 4 : 3);
+
+            return best_error;
+        }
+
+        /** @brief Encodes a block into whichever of BC7 mode 5 and 6 fits it best, leaving out the color of fully transparent pixels. */
+        void encode_bc7(block &b, unsigned char *out) {
+            for(int i = 0; i < 16; ++i) b.active[i] = b.channels[3][i] ? -1 : 0;
+
+            unsigned char mode5[16];
+            int64_t mode5_error = encode_bc7_mode5(b, mode5);
+            if(encode_bc7_mode6(b, out) > mode5_error) std::memcpy(out, mode5, sizeof(mode5));
+        }
+    }
+
+    std::vector<unsigned char> encode_blocks(const image &pixels, uint32_t format, thread_pool &pool) {
+        size_t block_size = atlas_view::block_size(format);
+        size_t columns = static_cast<size_t>(pixels.width + 3) / 4, rows = static_cast<size_t>(pixels.height + 3) / 4;
+        std::vector<unsigned char> blocks(columns * rows * block_size);
+
+        pool.for_each(rows, [&](size_t row) {
+            block b;
+            unsigned char *out = blocks.data() + row * columns * block_size;
+            for(size_t column = 0; column < columns; ++column, out += block_size) {
+                load_block(pixels, static_cast<int>(column * 4), static_cast<int>(row * 4), b);
+
+                if(format == atlas_format_bc1) {
+                    encode_color(b, true, out);
+                } else if(format == atlas_format_bc3) {
+                    encode_alpha(b, out);
+                    encode_color(b, false, out + 8);
+                } else {
+                    encode_bc7(b, out);
+                }
+            }
+        });
+
+        return blocks;
+    }
+}
@@ -0,0 +1,34 @@
+#ifndef AV_PACKER_BLOCKENCODER_HPP
+#define AV_PACKER_BLOCKENCODER_HPP
+
+#include <packer/image.hpp>
+#include <av/util/thread_pool.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace av {
+    /**
+     * @brief Encodes an image into 4x4 pixel blocks of a GPU block compressed format, as an atlas page level holds them.
+     * Blocks are independent, so rows of blocks are encoded on every thread of a pool.
+     *
+     * Every block is fitted the same way: the line through its colors is found by principal component analysis, its
+     * ends are quantized to the endpoint precision of the format, and the pixels pick the closest palette entry with
+     * SIMD. The endpoints are then refitted by least squares from what the pixels picked, and requantized, keeping
+     * whichever try has the least squared error.
+     * - BC1 blocks with pixels under half opacity use the 3-color mode, where those pixels are fully transparent.
+     * - BC3 alpha uses 8 interpolated values between its extremes, or 6 and exact `0` and `255` if that fits better.
+     * - BC7 blocks are written in mode 6, a single subset of RGBA endpoints and 16 levels between them, or in mode 5,
+     *   where alpha is fitted apart from the colors, if that fits better.
+     *
+     * Pixels past the edges of the image repeat the edge pixels, so that they don't affect the fit.
+     *
+     * @param pixels The image.
+     * @param format The block compressed format, `atlas_format_bc1`, `atlas_format_bc3` or `atlas_format_bc7`.
+     * @param pool   The pool to encode on, from the calling thread or any of its tasks.
+     * @return The blocks, row by row from the top-left corner.
+     */
+    std::vector<unsigned char> encode_blocks(const image &pixels, uint32_t format, thread_pool &pool);
+}
+
+#endif // !AV_PACKER_BLOCKENCODER_HPP
@@ -0,0 +1,114 @@
+#include <packer/cache.hpp>
+
+#include <fstream>
+#include <ios>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+namespace av {
+    pack_cache pack_cache::load(const std::string &path) {
+        std::ifstream in(path);
+        if(!in) return {};
+
+        std::string line, kind;
+        int file_version = 0;
+        if(!std::getline(in, line) || !(std::istringstream(line) >> kind >> file_version) || kind != "avpack-cache" || file_version != version) return {};
+
+        pack_cache cache;
+        while(std::getline(in, line)) {
+            std::istringstream ss(line);
+            ss >> kind;
+
+            bool valid = true;
+            if(kind == "layout") {
+                valid = static_cast<bool>(ss >> std::hex >> cache.layout_key);
+            } else if(kind == "page") {
+                size_t index;
+                page_entry page;
+                valid = ss >> index >> page.width >> page.height >> std::hex >> page.key >> std::dec && index == cache.pages.size();
+                if(valid) cache.pages.push_back(std::move(page));
+            } else if(kind == "output") {
+                size_t index;
+                std::string file;
+                valid = ss >> index && std::getline(ss >> std::ws, file) && index < cache.pages.size();
+                if(valid) cache.pages[index].files.push_back(std::move(file));
+            } else if(kind == "atlas") {
+                size_t variant;
+                uint64_t key;
+                valid = ss >> variant >> std::hex >> key >> std::dec && variant == cache.atlases.size();
+                if(valid) cache.atlases.push_back(key);
+            } else if(kind == "file") {
+                file_entry file;
+                std::string file_path;
+                size_t outlines = 0;
+                valid =
+                    ss >> std::hex >> file.hash >> std::dec >> file.size >> file.mtime >> file.width >> file.height &&
+                    ss >> file.bounds.x >> file.bounds.y >> file.bounds.width >> file.bounds.height >> std::hex >> file.pixel_hash >> file.trace_key >> std::dec &&
+                    ss >> outlines;
+
+                for(size_t i = 0, vertices; valid && i < outlines; ++i) {
+                    valid = ss >> vertices && vertices <= 0xffff;
+                    if(!valid) break;
+
+                    std::vector<outline_point> &outline = file.outlines.emplace_back(vertices);
+                    for(outline_point &point : outline) valid = valid && ss >> point.x >> point.y;
+                }
+
+                valid = valid && std::getline(ss >> std::ws, file_path);
+                if(valid) cache.files[file_path] = file;
+            } else if(kind == "sprite") {
+                sprite_entry sprite;
+                std::string name;
+                valid = ss >> sprite.page >> sprite.region.x >> sprite.region.y >> sprite.region.width >> sprite.region.height >> sprite.flipped && std::getline(ss >> std::ws, name);
+                if(valid) cache.sprites[name] = sprite;
+            } else {
+                valid = false;
+            }
+
+            // A damaged cache is as good as none.
+            if(!valid) return {};
+        }
+
+        return cache;
+    }
+
+    void pack_cache::save(const std::string &path) const {
+        std::ofstream out(path);
+        if(!out) throw std::runtime_error(std::string("Couldn't write '").append(path).append("'."));
+
+        // Outline vertices aren't always whole numbers, and have to read back exactly.
+        out.precision(std::numeric_limits<float>::max_digits10);
+        out << "avpack-cache " << version << '\n';
+        out << "layout " << std::hex << layout_key << std::dec << '\n';
+
+        for(size_t i = 0; i < pages.size(); ++i) {
+            const page_entry &page = pages[i];
+            out << "page " << i << ' ' << page.width << ' ' << page.height << ' ' << std::hex << page.key << std::dec << '\n';
+            for(const std::string &file : page.files) out << "output " << i << ' ' << file << '\n';
+        }
+
+        for(size_t v = 0; v < atlases.size(); ++v) out << "atlas " << v << ' ' << std::hex << atlases[v] << std::dec << '\n';
+
+        for(const auto &[file_path, file] : files) {
+            const rect &b = file.bounds;
+            out << "file " << std::hex << file.hash << std::dec << ' ' << file.size << ' ' << file.mtime << ' ' << file.width << ' ' << file.height << ' '
+                << b.x << ' ' << b.y << ' ' << b.width << ' ' << b.height << ' ' << std::hex << file.pixel_hash << ' ' << file.trace_key << std::dec << ' '
+                << file.outlines.size() << ' ';
+
+            for(const std::vector<outline_point> &outline : file.outlines) {
+                out << outline.size() << ' ';
+                for(const outline_point &point : outline) out << point.x << ' ' << point.y << ' ';
+            }
+
+            out << file_path << '\n';
+        }
+
+        for(const auto &[name, sprite] : sprites) {
+            const rect &r = sprite.region;
+            out << "sprite " << sprite.page << ' ' << r.x << ' ' << r.y << ' ' << r.width << ' ' << r.height << ' ' << sprite.flipped << ' ' << name << '\n';
+        }
+
+        if(!out) throw std::runtime_error(std::string("Couldn't write '").append(path).append("'."));
+    }
+}
@@ -0,0 +1,99 @@
+#ifndef AV_PACKER_CACHE_HPP
+#define AV_PACKER_CACHE_HPP
+
+#include <packer/outline.hpp>
+#include <av/util/packing/rect.hpp>
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace av {
+    /**
+     * @brief What a previous packer run produced, so that an unchanged input doesn't have to be decoded, packed or
+     * encoded again. Everything is keyed by content hashes; file sizes and modification times only serve to skip
+     * hashing files that weren't touched.
+     *
+     * Stored as a text file starting with a `avpack-cache <version>` line, followed by lines of either
+     * `layout <key>`, `page <index> <width> <height> <key>`, `output <page> <file>`, `atlas <variant> <key>`,
+     * `file <hash> <size> <mtime> <width> <height> <bounds x> <bounds y> <bounds width> <bounds height> <pixel hash>
+     * <trace key> <outline count> <vertex count> <x> <y>... <path>`, with a vertex count and vertices for every outline
+     * or `sprite <page> <x> <y> <width> <height> <flipped> <name>`. A page has an `output` line for every resolution
+     * variant, in order. Keys and hashes are hexadecimal; paths and names run until the end of the line.
+     */
+    struct pack_cache {
+        /** @brief An input file, by path. */
+        struct file_entry {
+            /** @brief The hash of the file contents. */
+            uint64_t hash = 0;
+            /** @brief The file size and modification time the hash was computed at. */
+            uint64_t size = 0;
+            int64_t mtime = 0;
+            /** @brief The image dimensions. */
+            int width = 0, height = 0;
+            /**
+             * @brief The part of the image that isn't fully transparent, at least one pixel, grown by as much as distance
+             * fields reach if there are any.
+             */
+            rect bounds = {};
+            /** @brief The hash of the pixels within `bounds`, so that identical sprites can be found without decoding. */
+            uint64_t pixel_hash = 0;
+            /** @brief The hash of the settings `bounds` and `outlines` were found with, `0` for the defaults. */
+            uint64_t trace_key = 0;
+            /**
+             * @brief The polygon around the opaque pixels of every resolution variant, made by `trace_outline()` and
+             * relative to the bounds as aligned for that variant.
+             */
+            std::vector<std::vector<outline_point>> outlines;
+        };
+
+        /** @brief An output page, by index. */
+        struct page_entry {
+            /** @brief The page dimensions, in layout units, which are pixels of the smallest variant. */
+            int width = 0, height = 0;
+            /** @brief The hash of everything that went into the page; the page is unchanged as long as this is. */
+            uint64_t key = 0;
+            /** @brief The page file path of every variant, relative to the cache. */
+            std::vector<std::string> files;
+        };
+
+        /** @brief Where a sprite went, by name. */
+        struct sprite_entry {
+            size_t page = 0;
+            rect region = {};
+            bool flipped = false;
+        };
+
+        /** @brief The version written in the first line; caches of other versions are ignored. */
+        static constexpr int version = 5;
+
+        /** @brief The hash of everything that went into the placement of the sprites. */
+        uint64_t layout_key = 0;
+        std::vector<page_entry> pages;
+        /**
+         * @brief The hash of the region table of the binary atlas of every variant, in order, or nothing for other
+         * formats. An atlas whose pages are all unchanged is still rewritten if this changed.
+         */
+        std::vector<uint64_t> atlases;
+        std::map<std::string, file_entry> files;
+        std::map<std::string, sprite_entry> sprites;
+
+        /**
+         * @brief Reads a cache file.
+         *
+         * @param path The cache file path.
+         * @return The cache, or an empty one if the file doesn't exist or isn't a valid cache of this version.
+         */
+        static pack_cache load(const std::string &path);
+
+        /**
+         * @brief Writes this cache to a file.
+         *
+         * @param path The cache file path. An exception is thrown if it couldn't be written.
+         */
+        void save(const std::string &path) const;
+    };
+}
+
+#endif // !AV_PACKER_CACHE_HPP
@@ -0,0 +1,116 @@
+#include <packer/distance_field.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace av {
+    namespace {
+        /** @brief The squared distance of pixels no feature pixel reached yet, larger than any within an image. */
+        constexpr float unreached = 1e20f;
+
+        /** @brief Scratch space of `transform()`, reused for every row or column a task handles. */
+        struct envelope {
+            /** @brief The sample every parabola of the lower envelope is rooted at. */
+            std::vector<int> roots;
+            /** @brief Where every parabola of the lower envelope starts being the lowest, and where the last one ends. */
+            std::vector<float> edges;
+
+            envelope(int count): roots(count), edges(static_cast<size_t>(count) + 1) {}
+        };
+
+        /**
+         * @brief The one dimensional squared distance transform: builds the lower envelope of the parabolas rooted at
+         * every sample from left to right, then reads every sample's distance off it.
+         *
+         * @param f       The samples, `0` for feature pixels and `unreached` for others, or the squared distances along
+         *                the other axis.
+         * @param count   How many samples there are.
+         * @param d       [out] The squared distance of every sample. Must not overlap `f`.
+         * @param scratch Space for the envelope, for at least `count` samples.
+         */
+        void transform(const float *f, int count, float *d, envelope &scratch) {
+            int *roots = scratch.roots.data();
+            float *edges = scratch.edges.data();
+
+            int k = 0;
+            roots[0] = 0;
+            edges[0] = -std::numeric_limits<float>::infinity();
+            edges[1] = std::numeric_limits<float>::infinity();
+
+            for(int q = 1; q < count; ++q) {
+                // The first parabola is never hidden, since it starts at negative infinity.
+                float s;
+                while(true) {
+                    int r = roots[k];
+                    s = ((f[q] + static_cast<float>(q) * q) - (f[r] + static_cast<float>(r) * r)) / (2.0f * static_cast<float>(q - r));
+                    if(s > edges[k]) break;
+                    --k;
+                }
+
+                ++k;
+                roots[k] = q;
+                edges[k] = s;
+                edges[k + 1] = std::numeric_limits<float>::infinity();
+            }
+
+            k = 0;
+            for(int q = 0; q < count; ++q) {
+                while(edges[k + 1] < static_cast<float>(q)) ++k;
+
+                float offset = static_cast<float>(q - roots[k]);
+                d[q] = offset * offset + f[roots[k]];
+            }
+        }
+    }
+
+    image distance_field(const image &pixels, int spread, thread_pool &pool) {
+        // A frame of outside pixels stands for everything past the edges of the image.
+        int width = pixels.width + 2, height = pixels.height + 2;
+
+        // The squared distance of every pixel to the nearest inside and outside pixel, along its column first.
+        std::vector<float> to_inside(static_cast<size_t>(width) * height), to_outside(to_inside.size());
+        pool.for_each(static_cast<size_t>(width), [&](size_t column) {
+            int x = static_cast<int>(column);
+            std::vector<float> inside(height), outside(height), d(height);
+            envelope scratch(height);
+
+            for(int y = 0; y < height; ++y) {
+                bool in = x > 0 && y > 0 && x <= pixels.width && y <= pixels.height && pixels.pixels[(static_cast<size_t>(y - 1) * pixels.width + x - 1) * 4 + 3] >= 128;
+                inside[y] = in ? 0.0f : unreached;
+                outside[y] = in ? unreached : 0.0f;
+            }
+
+            transform(inside.data(), height, d.data(), scratch);
+            for(int y = 0; y < height; ++y) to_inside[static_cast<size_t>(y) * width + x] = d[y];
+
+            transform(outside.data(), height, d.data(), scratch);
+            for(int y = 0; y < height; ++y) to_outside[static_cast<size_t>(y) * width + x] = d[y];
+        });
+
+        image result(pixels.width, pixels.height);
+        float scale = 0.5f / static_cast<float>(std::max(spread, 1));
+        pool.for_each(static_cast<size_t>(pixels.height), [&](size_t row) {
+            size_t y = row + 1;
+            std::vector<float> inside(width), outside(width);
+            envelope scratch(width);
+
+            transform(&to_inside[y * width], width, inside.data(), scratch);
+            transform(&to_outside[y * width], width, outside.data(), scratch);
+
+            unsigned char *dst = result.pixels.data() + row * pixels.width * 4;
+            for(int x = 1; x <= pixels.width; ++x, dst += 4) {
+                // Either distance is 0, on the side the pixel is on; the edge is half a pixel closer than the nearest
+                // pixel on the other side.
+                float distance = inside[x] == 0.0f ? std::sqrt(outside[x]) - 0.5f : 0.5f - std::sqrt(inside[x]);
+                float alpha = std::clamp(0.5f + distance * scale, 0.0f, 1.0f);
+
+                dst[0] = dst[1] = dst[2] = 255;
+                dst[3] = static_cast<unsigned char>(alpha * 255.0f + 0.5f);
+            }
+        });
+
+        return result;
+    }
+}
@@ -0,0 +1,27 @@
+#ifndef AV_PACKER_DISTANCEFIELD_HPP
+#define AV_PACKER_DISTANCEFIELD_HPP
+
+#include <packer/image.hpp>
+#include <av/util/thread_pool.hpp>
+
+namespace av {
+    /**
+     * @brief Turns the alpha mask of an image into a signed distance field, with the exact Euclidean distance transform
+     * of Felzenszwalb and Huttenlocher: a pass down every column and then one along every row, each of which takes
+     * linear time and runs on every thread of a pool.
+     *
+     * Pixels of at least half opacity are inside the shape, and pixels past the edges of the image are outside. Every
+     * pixel gets the distance from its center to the edge between the two, which is halfway between neighbouring
+     * inside and outside pixels.
+     *
+     * @param pixels The image.
+     * @param spread How far the field reaches on either side of the edge, in pixels.
+     * @param pool   The pool to transform on, from the calling thread or any of its tasks.
+     * @return White pixels of the same size, whose alpha is `0.5` on the edge, rising to `1` at `spread` pixels inside
+     *         and falling to `0` at `spread` pixels outside. Alpha is averaged as is by `image::downsample()` and
+     *         `image::resize()`, so the field can be scaled like any other image.
+     */
+    image distance_field(const image &pixels, int spread, thread_pool &pool);
+}
+
+#endif // !AV_PACKER_DISTANCEFIELD_HPP
@@ -0,0 +1,89 @@
+#ifndef AV_PACKER_EDGEINDEX_HPP
+#define AV_PACKER_EDGEINDEX_HPP
+
+#include <av/util/packing/rect.hpp>
+
+#include <algorithm>
+#include <vector>
+
+namespace av {
+    /**
+     * @brief An index over the sides of packed rectangles, answering how much of a rectangle's outline they touch
+     * without comparing against all of them.
+     *
+     * Sides are bucketed by the line they lie on, and by which side of their rectangle they are. Packed rectangles
+     * don't overlap, so the sides in a bucket don't either, and are kept sorted; the length a rectangle shares with a
+     * bucket is then found by binary searching for the first side it reaches and adding up the sides it spans.
+     */
+    class edge_index {
+        private:
+        /** @brief A side, by where it starts and ends along its line. */
+        struct span {
+            int start, end;
+        };
+
+        /** @brief The sides lying on a line, sorted and disjoint. */
+        using line = std::vector<span>;
+
+        /**
+         * @brief The vertical sides by x coordinate, left sides in the first and right sides in the second, and the
+         * horizontal sides by y coordinate, top sides in the first and bottom sides in the second.
+         */
+        std::vector<line> vertical[2], horizontal[2];
+
+        /** @brief Adds a side to a line, keeping it sorted. */
+        static void add(line &l, int start, int end) {
+            auto at = std::lower_bound(l.begin(), l.end(), start, [](const span &s, int start) { return s.start < start; });
+            l.insert(at, {start, end});
+        }
+
+        /** @return How long the sides on a line overlap the given range for. */
+        static int overlap(const line &l, int start, int end) {
+            // Sides are disjoint, so they end in the same order they start in.
+            auto at = std::upper_bound(l.begin(), l.end(), start, [](int start, const span &s) { return start < s.end; });
+
+            int length = 0;
+            for(; at != l.end() && at->start < end; ++at) length += std::min(at->end, end) - std::max(at->start, start);
+            return length;
+        }
+
+        public:
+        /**
+         * @brief Removes every side, and sizes the index for rectangles in a bin.
+         *
+         * @param width  The bin width.
+         * @param height The bin height.
+         */
+        void reset(int width, int height) {
+            for(int side = 0; side < 2; ++side) {
+                for(line &l : vertical[side]) l.clear();
+                for(line &l : horizontal[side]) l.clear();
+
+                vertical[side].resize(static_cast<size_t>(width) + 1);
+                horizontal[side].resize(static_cast<size_t>(height) + 1);
+            }
+        }
+
+        /** @brief Adds the sides of a packed rectangle, which must lie in the bin and not overlap any other one. */
+        void insert(const rect &r) {
+            add(vertical[0][r.x], r.y, r.y + r.height);
+            add(vertical[1][r.x + r.width], r.y, r.y + r.height);
+            add(horizontal[0][r.y], r.x, r.x + r.width);
+            add(horizontal[1][r.y + r.height], r.x, r.x + r.width);
+        }
+
+        /**
+         * @return The total length the given rectangle shares with the sides of the packed rectangles that face it;
+         *         the same as adding up `common_length()` against every one of them.
+         */
+        int contact(int x, int y, int width, int height) const {
+            return
+                overlap(vertical[0][x + width], y, y + height) +
+                overlap(vertical[1][x], y, y + height) +
+                overlap(horizontal[0][y + height], x, x + width) +
+                overlap(horizontal[1][y], x, x + width);
+        }
+    };
+}
+
+#endif // !AV_PACKER_EDGEINDEX_HPP
@@ -0,0 +1,258 @@
+#ifndef AV_PACKER_FREERECTINDEX_HPP
+#define AV_PACKER_FREERECTINDEX_HPP
+
+#include <packer/simd.hpp>
+#include <av/util/packing/rect.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace av {
+    /**
+     * @brief An acceleration structure over a list of free rectangles. Rectangles are bucketed by the binary logarithm
+     * of their width and height, so a query for rectangles that can hold a given size only visits the buckets that may
+     * contain one, instead of the whole list. Buckets are stored as structure-of-arrays padded to whole `simd::vint`s,
+     * so `query_scored()` can score a block of rectangles at once.
+     */
+    class free_rect_index {
+        public:
+        /** @brief How many size classes there are per axis. Anything `2^(levels - 1)` or larger shares the last one. */
+        static constexpr int levels = 16;
+
+        private:
+        /**
+         * @brief Rectangles of one width class and one height class, as copies of their components, in no particular
+         * order. The arrays are padded past `count` with rectangles of negative dimensions, so nothing fits in those.
+         */
+        struct bucket {
+            std::vector<int32_t> xs, ys, widths, heights;
+            /** @brief The identifier each rectangle was inserted with. */
+            std::vector<size_t> ids;
+            /** @brief How many rectangles there are, not counting the padding. */
+            size_t count = 0;
+
+            /** @return The size of the arrays, including the padding. */
+            inline size_t size() const {
+                return ids.size();
+            }
+
+            inline void set(size_t slot, const rect &r, size_t id) {
+                xs[slot] = r.x;
+                ys[slot] = r.y;
+                widths[slot] = r.width;
+                heights[slot] = r.height;
+                ids[slot] = id;
+            }
+
+            /** @return The slot the rectangle went in. */
+            inline size_t push_back(const rect &r, size_t id) {
+                if(count == size()) {
+                    size_t padded = size() + simd::vint::lanes;
+                    xs.resize(padded, 0);
+                    ys.resize(padded, 0);
+                    widths.resize(padded, -1);
+                    heights.resize(padded, -1);
+                    ids.resize(padded, 0);
+                }
+
+                set(count, r, id);
+                return count++;
+            }
+
+            /** @brief Moves the last rectangle to the given slot and pads its old one. */
+            inline void erase(size_t slot) {
+                size_t last = --count;
+                xs[slot] = xs[last];
+                ys[slot] = ys[last];
+                widths[slot] = widths[last];
+                heights[slot] = heights[last];
+                ids[slot] = ids[last];
+
+                set(last, {0, 0, -1, -1}, 0);
+            }
+        };
+
+        /** @brief Where a rectangle is kept. */
+        struct location {
+            uint32_t bucket;
+            uint32_t slot;
+        };
+
+        /** @brief All the buckets, indexed by `width_level * levels + height_level`. */
+        bucket buckets[levels * levels];
+        /** @brief For each width class, a mask of the height classes that have non-empty buckets. */
+        uint32_t occupied[levels] = {};
+        /** @brief The location of every rectangle, by identifier. */
+        std::vector<location> locations;
+
+        public:
+        /** @return The size class of the given dimension. */
+        static inline int level(int dim) {
+            int lvl = 0;
+            while(dim > 1 && lvl < levels - 1) {
+                dim >>= 1;
+                ++lvl;
+            }
+
+            return lvl;
+        }
+
+        /** @brief Removes every rectangle, keeping the memory around. */
+        void clear() {
+            for(int w = 0; w < levels; ++w) {
+                for(uint32_t mask = occupied[w]; mask; mask &= mask - 1) {
+                    bucket &b = buckets[w * levels + __builtin_ctz(mask)];
+                    while(b.count) b.erase(b.count - 1);
+                }
+
+                occupied[w] = 0;
+            }
+
+            locations.clear();
+        }
+
+        /**
+         * @brief Adds a rectangle to the index.
+         *
+         * @param r  The rectangle.
+         * @param id The identifier to report it with. Must not be in the index already; the index keeps a location for
+         *           every identifier up to the largest one, so they should be dense.
+         */
+        void insert(const rect &r, size_t id) {
+            int w = level(r.width), h = level(r.height);
+            size_t index = w * levels + h;
+
+            if(locations.size() <= id) locations.resize(id + 1);
+            locations[id] = {static_cast<uint32_t>(index), static_cast<uint32_t>(buckets[index].push_back(r, id))};
+            occupied[w] |= 1u << h;
+        }
+
+        /** @brief Removes the rectangle inserted with the given identifier from the index. */
+        void erase(size_t id) {
+            location loc = locations[id];
+            bucket &b = buckets[loc.bucket];
+
+            b.erase(loc.slot);
+            if(loc.slot < b.count) locations[b.ids[loc.slot]].slot = loc.slot;
+            if(!b.count) occupied[loc.bucket / levels] &= ~(1u << (loc.bucket % levels));
+        }
+
+        /**
+         * @brief Visits every rectangle that is at least `width` x `height` large, in no particular order.
+         *
+         * @param width  The minimum width.
+         * @param height The minimum height.
+         * @param func   The visitor, in a signature of `void(const rect &, size_t)`, receiving the rectangle and the
+         *               identifier it was inserted with.
+         */
+        template<typename T_func>
+        void query(int width, int height, T_func &&func) const {
+            query(width, height, [](int, int) { return true; }, std::forward<T_func>(func));
+        }
+
+        /**
+         * @brief Visits every rectangle that is at least `width` x `height` large, skipping whole buckets rejected by
+         * `accept`. Buckets are visited from the smallest size classes up, so the tightest fits tend to come first.
+         *
+         * @param width  The minimum width.
+         * @param height The minimum height.
+         * @param accept The bucket filter, in a signature of `bool(int, int)`, receiving the smallest width and height
+         *               a rectangle in the bucket may have. Called right before visiting each bucket, so it may depend
+         *               on what has been visited so far.
+         * @param func   The visitor, in a signature of `void(const rect &, size_t)`, receiving the rectangle and the
+         *               identifier it was inserted with.
+         */
+        template<typename T_accept, typename T_func>
+        void query(int width, int height, T_accept &&accept, T_func &&func) const {
+            int min_w = level(width), min_h = level(height);
+            for(int w = min_w; w < levels; ++w) {
+                uint32_t mask = occupied[w] >> min_h;
+                for(int h = min_h; mask; ++h, mask >>= 1) {
+                    if(!(mask & 1) || !accept(std::max(width, 1 << w), std::max(height, 1 << h))) continue;
+
+                    const bucket &b = buckets[w * levels + h];
+                    for(size_t i = 0; i < b.size(); ++i) {
+                        if(b.widths[i] >= width && b.heights[i] >= height) func(rect{b.xs[i], b.ys[i], b.widths[i], b.heights[i]}, b.ids[i]);
+                    }
+                }
+            }
+        }
+
+        /**
+         * @brief Scores every rectangle that can hold `width` x `height`, upright or flipped, a whole `simd::vint` of
+         * rectangles in both orientations at a time. Only candidates whose primary score doesn't exceed `bound` are
+         * reported, so the visitor only sees the few that may matter.
+         *
+         * @param width   The minimum width, when upright.
+         * @param height  The minimum height, when upright.
+         * @param flip    Whether to also try the flipped orientation.
+         * @param scoring The scoring rule, with a static `score()` template that works on both `int` and `simd::vint`.
+         * @param accept  The bucket filter, in a signature of `bool(int, int, bool)`, receiving the smallest width and
+         *                height a rectangle in the bucket may have and whether the orientation is flipped.
+         * @param bound   The primary score bound, in a signature of `int()`. Read once per block.
+         * @param func    The visitor, in a signature of `void(int, int, size_t, bool, int, int)`, receiving the
+         *                position, the identifier it was inserted with, whether the orientation is flipped, and
+         *                both scores.
+         */
+        template<typename T_scoring, typename T_accept, typename T_bound, typename T_func>
+        void query_scored(int width, int height, bool flip, const T_scoring &scoring, T_accept &&accept, T_bound &&bound, T_func &&func) const {
+            using simd::vint;
+
+            flip = flip && width != height;
+            int up_w = level(width), up_h = level(height);
+            int min_w = flip ? std::min(up_w, up_h) : up_w, min_h = flip ? std::min(up_w, up_h) : up_h;
+
+            vint w = simd::set1(width), h = simd::set1(height);
+            int32_t score1[2][vint::lanes], score2[2][vint::lanes];
+
+            for(int wl = min_w; wl < levels; ++wl) {
+                uint32_t mask = occupied[wl] >> min_h;
+                for(int hl = min_h; mask; ++hl, mask >>= 1) {
+                    if(!(mask & 1)) continue;
+
+                    bool upright = wl >= up_w && hl >= up_h && accept(std::max(width, 1 << wl), std::max(height, 1 << hl), false);
+                    bool flipped = flip && wl >= up_h && hl >= up_w && accept(std::max(height, 1 << wl), std::max(width, 1 << hl), true);
+                    if(!upright && !flipped) continue;
+
+                    const bucket &b = buckets[wl * levels + hl];
+                    for(size_t i = 0; i < b.size(); i += vint::lanes) {
+                        vint rw = simd::load(&b.widths[i]), rh = simd::load(&b.heights[i]);
+                        vint x = simd::load(&b.xs[i]), y = simd::load(&b.ys[i]);
+                        vint limit = simd::set1(bound());
+
+                        uint32_t hits[2] = {0, 0};
+                        if(upright) {
+                            vint s1, s2;
+                            scoring.score(x, y, rw, rh, w, h, s1, s2);
+                            hits[0] = simd::mask(((rw >= w) & (rh >= h)) & (limit >= s1));
+
+                            simd::store(score1[0], s1);
+                            simd::store(score2[0], s2);
+                        }
+
+                        if(flipped) {
+                            vint s1, s2;
+                            scoring.score(x, y, rw, rh, h, w, s1, s2);
+                            hits[1] = simd::mask(((rw >= h) & (rh >= w)) & (limit >= s1));
+
+                            simd::store(score1[1], s1);
+                            simd::store(score2[1], s2);
+                        }
+
+                        for(int f = 0; f < 2; ++f) {
+                            for(uint32_t hit = hits[f]; hit; hit &= hit - 1) {
+                                int lane = __builtin_ctz(hit);
+                                func(b.xs[i + lane], b.ys[i + lane], b.ids[i + lane], f == 1, score1[f][lane], score2[f][lane]);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    };
+}
+
+#endif // !AV_PACKER_FREERECTINDEX_HPP
@@ -0,0 +1,244 @@
+#ifndef AV_PACKER_FREERECTTREE_HPP
+#define AV_PACKER_FREERECTTREE_HPP
+
+#include <av/util/packing/rect.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace av {
+    /**
+     * @brief A spatial index over free rectangles, answering which of them intersect or contain a given rectangle
+     * without comparing against all of them.
+     *
+     * Both questions are dominance queries on the corners of the rectangles: a rectangle contains another if its left
+     * and top sides are smaller and its right and bottom sides larger, and intersects it if they are on the other side
+     * of the opposite sides. Rectangles are thus kept in k-d trees splitting on those four coordinates, where every
+     * node knows the bounds of its subtree, and a whole subtree is skipped once its bounds can't satisfy the query.
+     *
+     * The trees are static, and updates are handled by keeping a logarithmic amount of them: the `k`th tree holds
+     * `2^k` insertions worth of rectangles, and an insertion merges every tree below the first empty one into it, like
+     * incrementing a binary counter. Erased rectangles are only marked dead until they outnumber the live ones, at
+     * which point everything is rebuilt. Both insertion and erasure are thus amortized `O(log^2 n)`.
+     */
+    class free_rect_tree {
+        private:
+        /** @brief A rectangle by its sides, with the identifier it was inserted with. */
+        struct item {
+            int32_t left, top, right, bottom;
+            size_t id;
+        };
+
+        /** @brief The smallest left and top and the largest right and bottom sides in a subtree. */
+        struct bounds {
+            int32_t left, top, right, bottom;
+        };
+
+        /** @brief A static k-d tree, laid out implicitly: node `n` covers a range whose halves are nodes `2n` and `2n + 1`. */
+        struct tree {
+            std::vector<item> items;
+            /** @brief The bounds of every node, with the root at 1. */
+            std::vector<bounds> nodes;
+        };
+
+        /** @brief How many items a leaf may hold before it's split. */
+        static constexpr size_t leaf_size = 8;
+
+        /** @brief The trees, of which the `k`th is either empty or holds `2^k` insertions worth of items. */
+        std::vector<tree> trees;
+        /** @brief Whether the rectangle with the given identifier is in the index. */
+        std::vector<bool> alive;
+        /** @brief Items that are still in the trees, but were erased. */
+        size_t dead = 0;
+        /** @brief Rectangles that are in the index. */
+        size_t live = 0;
+        /** @brief The items of a tree being built, kept around to avoid reallocating. */
+        std::vector<item> scratch;
+
+        public:
+        /** @brief Removes every rectangle. */
+        void clear() {
+            for(tree &t : trees) {
+                t.items.clear();
+                t.nodes.clear();
+            }
+
+            alive.clear();
+            dead = live = 0;
+        }
+
+        /**
+         * @brief Adds a rectangle to the index.
+         *
+         * @param r  The rectangle.
+         * @param id The identifier to report it with. Must not be in the index already; the index keeps a flag for
+         *           every identifier up to the largest one, so they should be dense.
+         */
+        void insert(const rect &r, size_t id) {
+            if(alive.size() <= id) alive.resize(id + 1, false);
+            alive[id] = true;
+            ++live;
+
+            scratch.clear();
+            scratch.push_back({r.x, r.y, r.x + r.width, r.y + r.height, id});
+
+            size_t k = 0;
+            for(; k < trees.size() && !trees[k].items.empty(); ++k) collect(trees[k]);
+            if(k == trees.size()) trees.emplace_back();
+
+            build(trees[k]);
+        }
+
+        /** @brief Removes the rectangle inserted with the given identifier from the index. */
+        void erase(size_t id) {
+            alive[id] = false;
+            --live;
+
+            if(++dead <= live + leaf_size) return;
+
+            scratch.clear();
+            for(tree &t : trees) collect(t);
+
+            // Put everything in the tree it'd be in if the live items were inserted from scratch.
+            size_t k = 0;
+            while((size_t(1) << k) < scratch.size()) ++k;
+            if(k >= trees.size()) trees.resize(k + 1);
+
+            build(trees[k]);
+        }
+
+        /** @return Whether the rectangle inserted with the given identifier is in the index. */
+        inline bool contains(size_t id) const {
+            return id < alive.size() && alive[id];
+        }
+
+        /**
+         * @brief Visits every rectangle that shares a nonzero area with the given one, in no particular order.
+         *
+         * @param r    The rectangle.
+         * @param func The visitor, in a signature of `void(size_t)`, receiving the identifier of each rectangle.
+         */
+        template<typename T_func>
+        void query_intersecting(const rect &r, T_func &&func) const {
+            int32_t right = r.x + r.width, bottom = r.y + r.height;
+            query([&](int32_t l, int32_t t, int32_t rt, int32_t b) {
+                return l < right && t < bottom && rt > r.x && b > r.y;
+            }, std::forward<T_func>(func));
+        }
+
+        /**
+         * @brief Visits every rectangle that contains the given one, in no particular order.
+         *
+         * @param r    The rectangle.
+         * @param func The visitor, in a signature of `void(size_t)`, receiving the identifier of each rectangle.
+         */
+        template<typename T_func>
+        void query_containing(const rect &r, T_func &&func) const {
+            int32_t right = r.x + r.width, bottom = r.y + r.height;
+            query([&](int32_t l, int32_t t, int32_t rt, int32_t b) {
+                return l <= r.x && t <= r.y && rt >= right && b >= bottom;
+            }, std::forward<T_func>(func));
+        }
+
+        private:
+        /** @brief Moves the live items of a tree to `scratch`, emptying it. */
+        void collect(tree &t) {
+            for(const item &i : t.items) {
+                if(alive[i.id]) {
+                    scratch.push_back(i);
+                } else {
+                    --dead;
+                }
+            }
+
+            t.items.clear();
+            t.nodes.clear();
+        }
+
+        /** @brief Builds a tree out of `scratch`. */
+        void build(tree &t) {
+            std::swap(t.items, scratch);
+
+            size_t depth = 0;
+            while((leaf_size << depth) < t.items.size()) ++depth;
+
+            t.nodes.resize(size_t(2) << depth);
+            build(t, 1, 0, t.items.size());
+        }
+
+        void build(tree &t, size_t node, size_t begin, size_t end) {
+            bounds &b = t.nodes[node];
+            b = {INT32_MAX, INT32_MAX, INT32_MIN, INT32_MIN};
+            for(size_t i = begin; i < end; ++i) {
+                const item &it = t.items[i];
+                b.left = std::min(b.left, it.left);
+                b.top = std::min(b.top, it.top);
+                b.right = std::max(b.right, it.right);
+                b.bottom = std::max(b.bottom, it.bottom);
+            }
+
+            if(end - begin <= leaf_size) return;
+
+            // Split on whichever side varies the most, i.e. the one that tells the halves apart the best. The spread of
+            // a side is measured on the bounds, which is only an approximation for right and bottom sides, but a
+            // cheap one.
+            int32_t min_right = INT32_MAX, min_bottom = INT32_MAX, max_left = INT32_MIN, max_top = INT32_MIN;
+            for(size_t i = begin; i < end; ++i) {
+                const item &it = t.items[i];
+                max_left = std::max(max_left, it.left);
+                max_top = std::max(max_top, it.top);
+                min_right = std::min(min_right, it.right);
+                min_bottom = std::min(min_bottom, it.bottom);
+            }
+
+            int32_t spreads[4] = {max_left - b.left, max_top - b.top, b.right - min_right, b.bottom - min_bottom};
+            int32_t item::*sides[4] = {&item::left, &item::top, &item::right, &item::bottom};
+            int32_t item::*side = sides[std::max_element(spreads, spreads + 4) - spreads];
+
+            size_t mid = begin + (end - begin) / 2;
+            std::nth_element(t.items.begin() + begin, t.items.begin() + mid, t.items.begin() + end, [side](const item &a, const item &b) {
+                return a.*side < b.*side;
+            });
+
+            build(t, node * 2, begin, mid);
+            build(t, node * 2 + 1, mid, end);
+        }
+
+        /** @brief Visits the identifier of every live item whose sides satisfy `pred`, pruning subtrees whose bounds don't. */
+        template<typename T_pred, typename T_func>
+        void query(T_pred &&pred, T_func &&func) const {
+            struct range {
+                size_t node, begin, end;
+            };
+
+            range stack[64];
+            for(const tree &t : trees) {
+                if(t.items.empty()) continue;
+
+                size_t top = 0;
+                stack[top++] = {1, 0, t.items.size()};
+                while(top) {
+                    range r = stack[--top];
+
+                    const bounds &b = t.nodes[r.node];
+                    if(!pred(b.left, b.top, b.right, b.bottom)) continue;
+
+                    if(r.end - r.begin <= leaf_size) {
+                        for(size_t i = r.begin; i < r.end; ++i) {
+                            const item &it = t.items[i];
+                            if(alive[it.id] && pred(it.left, it.top, it.right, it.bottom)) func(it.id);
+                        }
+                    } else {
+                        size_t mid = r.begin + (r.end - r.begin) / 2;
+                        stack[top++] = {r.node * 2 + 1, mid, r.end};
+                        stack[top++] = {r.node * 2, r.begin, mid};
+                    }
+                }
+            }
+        }
+    };
+}
+
+#endif // !AV_PACKER_FREERECTTREE_HPP
@@ -0,0 +1,331 @@
+#include <packer/image.hpp>
+#include <packer/simd.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb/stb_image.h>
+
+namespace av {
+    namespace {
+        image from_stb(unsigned char *data, int width, int height, const std::string &name) {
+            if(!data) throw std::runtime_error(std::string("Couldn't decode '").append(name).append("': ").append(stbi_failure_reason()));
+
+            image result;
+            result.width = width;
+            result.height = height;
+            result.pixels.assign(data, data + static_cast<size_t>(width) * height * 4);
+
+            stbi_image_free(data);
+            return result;
+        }
+
+        /**
+         * @return A bit mask of which of the `vint::lanes` pixels at `px` have a non-zero alpha. The alpha is the top
+         * byte of each pixel, so its low 7 bits are carried into the sign bit by adding `0x7F`, and its top bit already
+         * is the sign bit.
+         */
+        inline uint32_t alpha_mask(const int32_t *px) {
+            simd::vint v = simd::load(px);
+            return simd::mask(v | ((v & simd::set1(0x7F000000)) + simd::set1(0x7F000000)));
+        }
+
+        /** @return The index of the first pixel in `[from, to)` with a non-zero alpha, or `to` if there is none. */
+        int first_opaque(const int32_t *row, int from, int to) {
+            int x = from;
+            for(; x + simd::vint::lanes <= to; x += simd::vint::lanes) {
+                uint32_t mask = alpha_mask(row + x);
+                if(mask) return x + __builtin_ctz(mask);
+            }
+
+            for(; x < to; ++x) if(static_cast<uint32_t>(row[x]) >> 24) return x;
+            return to;
+        }
+
+        /** @return The index of the last pixel in `[from, to)` with a non-zero alpha, or `from - 1` if there is none. */
+        int last_opaque(const int32_t *row, int from, int to) {
+            int x = to;
+            for(; x - simd::vint::lanes >= from; x -= simd::vint::lanes) {
+                uint32_t mask = alpha_mask(row + x - simd::vint::lanes);
+                if(mask) return x - simd::vint::lanes + 31 - __builtin_clz(mask);
+            }
+
+            for(--x; x >= from; --x) if(static_cast<uint32_t>(row[x]) >> 24) return x;
+            return from - 1;
+        }
+
+        /** @brief Conversions between 8-bit sRGB and linear light. */
+        struct srgb_tables {
+            /** @brief Every 8-bit sRGB value, in linear light. */
+            float to_linear[256];
+            /** @brief Linear light values in steps of 1/4095, in 8-bit sRGB. */
+            unsigned char to_srgb[4096];
+
+            srgb_tables() {
+                for(int i = 0; i < 256; ++i) {
+                    float c = i / 255.0f;
+                    to_linear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+                }
+
+                for(int i = 0; i < 4096; ++i) {
+                    float c = i / 4095.0f;
+                    c = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+                    to_srgb[i] = static_cast<unsigned char>(std::clamp(c * 255.0f + 0.5f, 0.0f, 255.0f));
+                }
+            }
+        };
+
+        const srgb_tables &tables() {
+            static const srgb_tables instance;
+            return instance;
+        }
+
+        /** @brief Converts a row of 8-bit sRGB pixels to linear light with premultiplied alpha. */
+        void linearize(const unsigned char *src, int width, float *dst) {
+            const float *to_linear = tables().to_linear;
+            for(int x = 0; x < width; ++x, src += 4, dst += 4) {
+                simd::vfloat4 color = simd::set(to_linear[src[0]], to_linear[src[1]], to_linear[src[2]], 1.0f);
+                simd::store(dst, color * simd::splat(src[3] / 255.0f));
+            }
+        }
+
+        /** @brief Converts a linear light pixel with premultiplied alpha back to 8-bit sRGB. */
+        void encode(const float *src, unsigned char *dst) {
+            float alpha = src[3];
+            if(alpha <= 0.0f) {
+                std::memset(dst, 0, 4);
+                return;
+            }
+
+            const unsigned char *to_srgb = tables().to_srgb;
+            for(int c = 0; c < 3; ++c) dst[c] = to_srgb[static_cast<int>(std::min(src[c] / alpha, 1.0f) * 4095.0f + 0.5f)];
+            dst[3] = static_cast<unsigned char>(std::min(alpha, 1.0f) * 255.0f + 0.5f);
+        }
+
+        /** @return The weight of `resample_filter::lanczos3` at the given distance. */
+        float lanczos3(float x) {
+            constexpr float pi = 3.14159265358979f;
+
+            x = std::abs(x);
+            if(x < 1e-6f) return 1.0f;
+            if(x >= 3.0f) return 0.0f;
+
+            float px = pi * x;
+            return 3.0f * std::sin(px) * std::sin(px / 3.0f) / (px * px);
+        }
+
+        /** @return The weight of `resample_filter::mitchell` at the given distance. */
+        float mitchell(float x) {
+            constexpr float b = 1.0f / 3.0f, c = 1.0f / 3.0f;
+
+            x = std::abs(x);
+            if(x < 1.0f) return ((12.0f - 9.0f * b - 6.0f * c) * x * x * x + (-18.0f + 12.0f * b + 6.0f * c) * x * x + (6.0f - 2.0f * b)) / 6.0f;
+            if(x < 2.0f) return ((-b - 6.0f * c) * x * x * x + (6.0f * b + 30.0f * c) * x * x + (-12.0f * b - 48.0f * c) * x + (8.0f * b + 24.0f * c)) / 6.0f;
+            return 0.0f;
+        }
+
+        /**
+         * @brief The source pixels and weights every destination pixel along one axis is made of, with the same
+         * number of taps for each, so that they can be stored flat.
+         */
+        struct filter_taps {
+            int taps;
+            /** @brief `taps` source pixel indices for every destination pixel, clamped to the edges. */
+            std::vector<int> indices;
+            /** @brief `taps` weights for every destination pixel, adding up to 1. */
+            std::vector<float> weights;
+
+            filter_taps(int src_size, int dst_size, resample_filter filter) {
+                float radius = filter_radius(filter);
+                float scale = static_cast<float>(src_size) / dst_size, stretch = std::max(1.0f, scale);
+                float support = radius * stretch;
+
+                taps = static_cast<int>(std::ceil(support)) * 2 + 1;
+                indices.resize(static_cast<size_t>(dst_size) * taps);
+                weights.resize(static_cast<size_t>(dst_size) * taps);
+
+                for(int i = 0; i < dst_size; ++i) {
+                    float center = (i + 0.5f) * scale;
+                    int first = static_cast<int>(std::floor(center - support));
+
+                    float sum = 0.0f;
+                    for(int t = 0; t < taps; ++t) {
+                        float distance = (first + t + 0.5f - center) / stretch;
+                        float weight = filter == resample_filter::lanczos3 ? lanczos3(distance) : mitchell(distance);
+
+                        size_t at = static_cast<size_t>(i) * taps + t;
+                        indices[at] = std::clamp(first + t, 0, src_size - 1);
+                        weights[at] = weight;
+                        sum += weight;
+                    }
+
+                    for(int t = 0; t < taps; ++t) weights[static_cast<size_t>(i) * taps + t] /= sum;
+                }
+            }
+        };
+    }
+
+    image image::load(const std::string &path) {
+        int width, height, channels;
+        unsigned char *data = stbi_load(path.c_str(), &width, &height, &channels, 4);
+        return from_stb(data, width, height, path);
+    }
+
+    image image::decode(const unsigned char *data, size_t size, const std::string &name) {
+        int width, height, channels;
+        unsigned char *pixels = stbi_load_from_memory(data, static_cast<int>(size), &width, &height, &channels, 4);
+        return from_stb(pixels, width, height, name);
+    }
+
+    bool image::info(const unsigned char *data, size_t size, int &width, int &height) {
+        int channels;
+        return stbi_info_from_memory(data, static_cast<int>(size), &width, &height, &channels);
+    }
+
+    rect image::opaque_bounds() const {
+        const int32_t *px = reinterpret_cast<const int32_t *>(pixels.data());
+        auto row = [&](int y) { return px + static_cast<size_t>(y) * width; };
+
+        int top = 0;
+        while(top < height && first_opaque(row(top), 0, width) == width) ++top;
+        if(top == height) return {0, 0, 0, 0};
+
+        int bottom = height - 1;
+        while(first_opaque(row(bottom), 0, width) == width) --bottom;
+
+        // Every other row only has to be scanned up to the bounds found so far.
+        int left = width, right = -1;
+        for(int y = top; y <= bottom; ++y) {
+            left = first_opaque(row(y), 0, left);
+            right = std::max(right, last_opaque(row(y), right + 1, width));
+        }
+
+        return {left, top, right - left + 1, bottom - top + 1};
+    }
+
+    image image::crop(const rect &area) const {
+        assert(area.x >= 0 && area.y >= 0 && area.x + area.width <= width && area.y + area.height <= height);
+
+        image result(area.width, area.height);
+        for(int row = 0; row < area.height; ++row) {
+            std::memcpy(
+                result.pixels.data() + static_cast<size_t>(row) * area.width * 4,
+                pixels.data() + (static_cast<size_t>(area.y + row) * width + area.x) * 4,
+                static_cast<size_t>(area.width) * 4
+            );
+        }
+
+        return result;
+    }
+
+    void image::blit(const image &src, int x, int y, bool flipped) {
+        const unsigned int *from = reinterpret_cast<const unsigned int *>(src.pixels.data());
+        unsigned int *to = reinterpret_cast<unsigned int *>(pixels.data());
+
+        if(!flipped) {
+            assert(x >= 0 && y >= 0 && x + src.width <= width && y + src.height <= height);
+
+            for(int row = 0; row < src.height; ++row) {
+                std::memcpy(to + static_cast<size_t>(y + row) * width + x, from + static_cast<size_t>(row) * src.width, src.width * 4);
+            }
+        } else {
+            assert(x >= 0 && y >= 0 && x + src.height <= width && y + src.width <= height);
+
+            // Rotated clockwise: destination column `col` is source row `src.height - 1 - col`.
+            for(int row = 0; row < src.width; ++row) {
+                unsigned int *dst_row = to + static_cast<size_t>(y + row) * width + x;
+                for(int col = 0; col < src.height; ++col) {
+                    dst_row[col] = from[static_cast<size_t>(src.height - 1 - col) * src.width + row];
+                }
+            }
+        }
+    }
+
+    void image::extrude(const rect &area, int amount) {
+        unsigned int *px = reinterpret_cast<unsigned int *>(pixels.data());
+        auto row = [&](int y) { return px + static_cast<size_t>(y) * width; };
+
+        int left = std::max(0, area.x - amount), right = std::min(width, area.x + area.width + amount);
+        int top = std::max(0, area.y - amount), bottom = std::min(height, area.y + area.height + amount);
+
+        // Sides first, so that the rows above and below can be copied whole from the first and last row.
+        for(int y = area.y; y < area.y + area.height; ++y) {
+            unsigned int *r = row(y);
+            std::fill(r + left, r + area.x, r[area.x]);
+            std::fill(r + area.x + area.width, r + right, r[area.x + area.width - 1]);
+        }
+
+        for(int y = top; y < area.y; ++y) std::memcpy(row(y) + left, row(area.y) + left, static_cast<size_t>(right - left) * 4);
+        for(int y = area.y + area.height; y < bottom; ++y) std::memcpy(row(y) + left, row(area.y + area.height - 1) + left, static_cast<size_t>(right - left) * 4);
+    }
+
+    image image::downsample() const {
+        image result(std::max(1, width / 2), std::max(1, height / 2));
+        std::vector<float> top(static_cast<size_t>(width) * 4), bottom(static_cast<size_t>(width) * 4);
+
+        for(int y = 0; y < result.height; ++y) {
+            linearize(pixels.data() + static_cast<size_t>(std::min(y * 2, height - 1)) * width * 4, width, top.data());
+            linearize(pixels.data() + static_cast<size_t>(std::min(y * 2 + 1, height - 1)) * width * 4, width, bottom.data());
+
+            unsigned char *dst = result.pixels.data() + static_cast<size_t>(y) * result.width * 4;
+            for(int x = 0; x < result.width; ++x, dst += 4) {
+                size_t x0 = static_cast<size_t>(x) * 2 * 4, x1 = static_cast<size_t>(std::min(x * 2 + 1, width - 1)) * 4;
+                simd::vfloat4 sum = simd::load(&top[x0]) + simd::load(&top[x1]) + simd::load(&bottom[x0]) + simd::load(&bottom[x1]);
+
+                float average[4];
+                simd::store(average, sum * simd::splat(0.25f));
+                encode(average, dst);
+            }
+        }
+
+        return result;
+    }
+
+    float filter_radius(resample_filter filter) {
+        return filter == resample_filter::lanczos3 ? 3.0f : 2.0f;
+    }
+
+    image image::resize(int width, int height, resample_filter filter) const {
+        filter_taps columns(this->width, width, filter), rows(this->height, height, filter);
+
+        std::vector<float> source(static_cast<size_t>(this->width) * 4);
+        std::vector<float> across(static_cast<size_t>(width) * this->height * 4);
+        for(int y = 0; y < this->height; ++y) {
+            linearize(pixels.data() + static_cast<size_t>(y) * this->width * 4, this->width, source.data());
+
+            float *dst = across.data() + static_cast<size_t>(y) * width * 4;
+            for(int x = 0; x < width; ++x, dst += 4) {
+                const int *index = &columns.indices[static_cast<size_t>(x) * columns.taps];
+                const float *weight = &columns.weights[static_cast<size_t>(x) * columns.taps];
+
+                simd::vfloat4 sum = simd::splat(0.0f);
+                for(int t = 0; t < columns.taps; ++t) sum = sum + simd::load(&source[static_cast<size_t>(index[t]) * 4]) * simd::splat(weight[t]);
+                simd::store(dst, sum);
+            }
+        }
+
+        // Ringing can overshoot below zero, which `encode()` doesn't expect; overshooting above is clamped there.
+        image result(width, height);
+        for(int y = 0; y < height; ++y) {
+            const int *index = &rows.indices[static_cast<size_t>(y) * rows.taps];
+            const float *weight = &rows.weights[static_cast<size_t>(y) * rows.taps];
+
+            unsigned char *dst = result.pixels.data() + static_cast<size_t>(y) * width * 4;
+            for(int x = 0; x < width; ++x, dst += 4) {
+                simd::vfloat4 sum = simd::splat(0.0f);
+                for(int t = 0; t < rows.taps; ++t) sum = sum + simd::load(&across[(static_cast<size_t>(index[t]) * width + x) * 4]) * simd::splat(weight[t]);
+
+                float color[4];
+                simd::store(color, simd::max(sum, simd::splat(0.0f)));
+                encode(color, dst);
+            }
+        }
+
+        return result;
+    }
+}
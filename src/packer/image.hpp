@@ -0,0 +1,122 @@
+#ifndef AV_PACKER_IMAGE_HPP
+#define AV_PACKER_IMAGE_HPP
+
+#include <av/util/packing/rect.hpp>
+
+#include <string>
+#include <vector>
+
+namespace av {
+    /** @brief The filters `image::resize()` can resample with. */
+    enum class resample_filter {
+        /** @brief A windowed sinc with 3 lobes; the sharpest, at the cost of slight ringing around hard edges. */
+        lanczos3,
+        /** @brief The Mitchell-Netravali cubic with `B = C = 1/3`; softer, with hardly any ringing. */
+        mitchell
+    };
+
+    /** @return How many pixels away from its center a filter reaches, before it's stretched for shrinking. */
+    float filter_radius(resample_filter filter);
+
+    /** @brief A decoded 8-bit RGBA image, stored row by row from the top-left corner. */
+    struct image {
+        /** @brief The image width, in pixels. */
+        int width = 0;
+        /** @brief The image height, in pixels. */
+        int height = 0;
+        /** @brief `width * height * 4` bytes of pixel data. */
+        std::vector<unsigned char> pixels;
+
+        /** @brief Default constructor, creates an empty image. */
+        image() = default;
+        /** @brief Creates a fully transparent image of the given size. */
+        image(int width, int height): width(width), height(height), pixels(static_cast<size_t>(width) * height * 4) {}
+
+        /**
+         * @brief Decodes an image file with `stb_image`, converting it to RGBA if necessary.
+         *
+         * @param path The image file path.
+         * @return The decoded image. An exception is thrown if the file couldn't be decoded.
+         */
+        static image load(const std::string &path);
+
+        /**
+         * @brief Decodes an image file that was already read into memory, like `load()` does.
+         *
+         * @param data The encoded image.
+         * @param size The size of `data`, in bytes.
+         * @param name The file name, only used for error messages.
+         * @return The decoded image. An exception is thrown if the data couldn't be decoded.
+         */
+        static image decode(const unsigned char *data, size_t size, const std::string &name);
+
+        /**
+         * @brief Reads the dimensions of an encoded image from its header, without decoding it.
+         *
+         * @param data   The encoded image.
+         * @param size   The size of `data`, in bytes.
+         * @param width  [out] The image width.
+         * @param height [out] The image height.
+         * @return Whether the data is in a format `decode()` understands.
+         */
+        static bool info(const unsigned char *data, size_t size, int &width, int &height);
+
+        /**
+         * @brief Finds the smallest rectangle holding every pixel whose alpha isn't zero, scanning rows with SIMD.
+         *
+         * @return The rectangle, or an empty one at the origin if the image is fully transparent.
+         */
+        rect opaque_bounds() const;
+
+        /**
+         * @brief Copies part of this image into a new one.
+         *
+         * @param area The part to copy. Must fit entirely inside this image.
+         * @return The copy.
+         */
+        image crop(const rect &area) const;
+
+        /**
+         * @brief Copies another image into this one.
+         *
+         * @param src     The source image. Must fit entirely inside this image at the given position.
+         * @param x       The destination X position.
+         * @param y       The destination Y position.
+         * @param flipped Whether to rotate the source 90 degrees clockwise while copying. The source then takes
+         *                `src.height` x `src.width` pixels in this image.
+         */
+        void blit(const image &src, int x, int y, bool flipped = false);
+
+        /**
+         * @brief Fills a border around part of this image with the closest pixels of that part, so that filtering near
+         * its edges doesn't pick up its neighbours.
+         *
+         * @param area   The part to extrude.
+         * @param amount The border thickness, in pixels. The border is clipped to this image.
+         */
+        void extrude(const rect &area, int amount);
+
+        /**
+         * @brief Halves this image with a 2x2 box filter, averaging in linear light with premultiplied alpha so that
+         * colors neither darken nor bleed out of transparent pixels. An odd last row or column is left out, and a
+         * dimension of 1 stays 1, like OpenGL mip levels do.
+         *
+         * @return The next mip level.
+         */
+        image downsample() const;
+
+        /**
+         * @brief Resamples this image to any size with a separable filter, one axis after the other. Like
+         * `downsample()`, it averages in linear light with premultiplied alpha, and pixels past the edges repeat the
+         * edge pixels. When shrinking, the filter is stretched to cover every source pixel.
+         *
+         * @param width  The new width.
+         * @param height The new height.
+         * @param filter The filter to resample with.
+         * @return The resampled image.
+         */
+        image resize(int width, int height, resample_filter filter) const;
+    };
+}
+
+#endif // !AV_PACKER_IMAGE_HPP
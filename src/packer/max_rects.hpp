@@ -0,0 +1,835 @@
+#ifndef AV_PACKER_MAXRECTS_HPP
+#define AV_PACKER_MAXRECTS_HPP
+
+#include <packer/edge_index.hpp>
+#include <packer/free_rect_index.hpp>
+#include <packer/free_rect_tree.hpp>
+#include <av/util/packing/rect.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace av {
+    class max_rects_bin_pack {
+        public:
+        max_rects_bin_pack(): bin_width(0), bin_height(0) {}
+ 
+        /**
+         * @brief Instantiates a bin of the given size.
+         * @param allow_flip Specifies whether the packing algorithm is allowed to rotate the input rectangles by 90 degrees
+         * to consider a better placement.
+         */
+        max_rects_bin_pack(int width, int height, bool allow_flip = true) {
+            init(width, height, allow_flip);
+        }
+
+        /**
+         * @brief Initializes the packer to an empty bin of width x height units. Call whenever you need to restart with a
+         * new bin.
+         * @param width The bin width;
+         * @param height The bin height;
+         * @param allow_flip Specifies whether the packing algorithm is allowed to rotate the input rectangles by 90 degrees
+         * to consider a better placement.
+         */
+        void init(int width, int height, bool allow_flip = true) {
+            this->allow_flip = allow_flip;
+            bin_width = width;
+            bin_height = height;
+
+            rect n;
+            n.x = 0;
+            n.y = 0;
+            n.width = width;
+            n.height = height;
+
+            used_rects.clear();
+            free_rects.clear();
+            free_seqs.clear();
+            free_slots.clear();
+            moved_free.clear();
+            free_index.clear();
+            free_tree.clear();
+            edges_tracked = false;
+
+            add_free(n);
+        }
+
+        /** @brief Specifies the different heuristic rules that can be used when deciding where to place a new rectangle. */
+        enum class heuristic {
+            /** @brief Positions the rectangle against the short side of a free rectangle into which it fits the best */
+            best_short_side_fit,
+            /** @brief Positions the rectangle against the long side of a free rectangle into which it fits the best. */
+            best_long_side_fit,
+            /** @brief Positions the rectangle into the smallest free rect into which it fits. */
+            best_area_fit,
+            /** @brief Does the Tetris placement. */
+            bottom_left_rule,
+            /** @brief Chooses the placement where the rectangle touches other rects as much as possible. */
+            contact_point_rule
+        };
+
+        /** @brief Every heuristic, the default first. */
+        static constexpr heuristic heuristics[] = {
+            heuristic::best_short_side_fit, heuristic::best_long_side_fit, heuristic::best_area_fit,
+            heuristic::bottom_left_rule, heuristic::contact_point_rule
+        };
+        
+        /**
+         * @brief Inserts the given list of rectangles in an offline/batch mode, possibly rotated.
+         * 
+         * @param rects The list of rectangles to insert. This vector will be destroyed in the process.
+         * @param dst [out] This list will contain the packed rectangles. The indices will not correspond to that of rects.
+         * @param method The rectangle placement rule to use when packing.
+         */
+        void insert(std::vector<rect_size> &rects, std::vector<rect> &dst, heuristic method) {
+            std::vector<int> dst_ids;
+            insert(rects, dst, dst_ids, method);
+        }
+
+        /**
+         * @brief Inserts the given list of rectangles in an offline/batch mode, possibly rotated, keeping track of where
+         * each of them went.
+         * 
+         * @param rects   The list of rectangles to insert. Rectangles that didn't fit in the bin are left in here, and
+         *                everything else is removed.
+         * @param dst     [out] This list will contain the packed rectangles.
+         * @param dst_ids [out] This list will contain the `rect_size::id` each of the packed rectangles came from, in
+         *                the same order as `dst`.
+         * @param method  The rectangle placement rule to use when packing.
+         */
+        void insert(std::vector<rect_size> &rects, std::vector<rect> &dst, std::vector<int> &dst_ids, heuristic method) {
+            dst.clear();
+            dst_ids.clear();
+
+            switch(method) {
+                case heuristic::best_short_side_fit: insert_cached(rects, dst, dst_ids, short_side_scoring{}); break;
+                case heuristic::best_long_side_fit: insert_cached(rects, dst, dst_ids, long_side_scoring{}); break;
+                case heuristic::best_area_fit: insert_cached(rects, dst, dst_ids, area_scoring{}); break;
+                case heuristic::bottom_left_rule: insert_cached(rects, dst, dst_ids, bottom_left_scoring{}); break;
+
+                // Contact scores depend on every placed rectangle, so any placement may change any score.
+                case heuristic::contact_point_rule:
+                    track_edges();
+                    insert_rescoring(rects, dst, dst_ids, method);
+                    break;
+            }
+        }
+
+        /**
+         * Inserts a single rectangle into the bin, possibly rotated.
+         * 
+         * @param width The rectangle width.
+         * @param height The rectangle height.
+         * @param method The packing method. See `heuristic` documentation for details.
+         * @return The inserted rectangle.
+         */
+        rect insert(int width, int height, heuristic method) {
+            rect new_node;
+
+            // Unused in this function. We don't need to know the score after finding the position.
+            int score1 = std::numeric_limits<int>::max();
+            int score2 = std::numeric_limits<int>::max();
+            switch(method) {
+                case heuristic::best_short_side_fit: new_node = find_pos_short_side(width, height, score1, score2); break;
+                case heuristic::bottom_left_rule: new_node = find_pos_bottom_left(width, height, score1, score2); break;
+                case heuristic::contact_point_rule:
+                    track_edges();
+                    new_node = find_pos_contact_point(width, height, score1);
+                    break;
+
+                case heuristic::best_long_side_fit: new_node = find_pos_long_side(width, height, score2, score1); break;
+                case heuristic::best_area_fit: new_node = find_pos_best_area(width, height, score1, score2); break;
+            }
+
+            if(new_node.height == 0) return new_node;
+
+            place(new_node);
+            return new_node;
+        }
+
+        /** @return The bin width. */
+        inline int get_width() const {
+            return bin_width;
+        }
+        /** @return The bin height. */
+        inline int get_height() const {
+            return bin_height;
+        }
+        /** @return The rectangles packed so far. */
+        inline const std::vector<rect> &get_used_rects() const {
+            return used_rects;
+        }
+        /** @return The maximal free rectangles, in no particular order. */
+        inline const std::vector<rect> &get_free_rects() const {
+            return free_rects;
+        }
+
+        /**
+         * @brief Marks the given rectangle as used, splitting every free rectangle it overlaps and dropping the pieces
+         * that are contained in other free rectangles. Only the affected free rectangles are visited, through
+         * `free_tree`, so this takes time in the order of their count rather than the size of the whole free list.
+         * `free_rects` ends up in the same order as a scan over all of it would leave it.
+         *
+         * @param node The rectangle, which must lie entirely in free space, such as a position returned by `insert()`.
+         */
+        void place(const rect &node) {
+            // Split the free rectangles in the order a scan would meet them. Removing one moves the last one in its
+            // place, which the scan looks at next; if it needs splitting too, it's the last one gathered.
+            free_ids.clear();
+            free_tree.query_intersecting(node, [&](size_t seq) { free_ids.push_back(seq); });
+            std::sort(free_ids.begin(), free_ids.end(), [&](size_t a, size_t b) { return free_slots[a] < free_slots[b]; });
+
+            moved_free.clear();
+            for(size_t i = 0; i < free_ids.size();) {
+                size_t seq = free_ids[i], last = free_seqs.back();
+                split_free_node(free_rects[free_slots[seq]], node);
+                remove_free(seq);
+
+                if(last != seq) moved_free.push_back(last);
+                if(last != seq && last == free_ids.back()) {
+                    free_ids[i] = last;
+                    free_ids.pop_back();
+                } else {
+                    ++i;
+                }
+            }
+
+            moved_free.erase(std::remove_if(moved_free.begin(), moved_free.end(), [&](size_t seq) { return free_slots[seq] == npos; }), moved_free.end());
+            std::sort(moved_free.begin(), moved_free.end());
+            moved_free.erase(std::unique(moved_free.begin(), moved_free.end()), moved_free.end());
+
+            added_free_begin = free_rects.size();
+            prune_free_list();
+            used_rects.push_back(node);
+            if(edges_tracked) edges.insert(node);
+        }
+
+        /** @return The ratio of used surface area to the total bin area. */
+        double occupancy() const {
+            uint64_t used_area = 0;
+            for(size_t i = 0; i < used_rects.size(); ++i) {
+                const rect &r = used_rects[i];
+                used_area += static_cast<uint64_t>(r.width) * r.height;
+            }
+
+            return static_cast<double>(used_area) / (static_cast<uint64_t>(bin_width) * bin_height);
+        }
+
+        private:
+        int bin_width;
+        int bin_height;
+
+        bool allow_flip;
+
+        size_t new_free_rects_last_size;
+        std::vector<rect> new_free_rects;
+        std::vector<rect> used_rects;
+        std::vector<rect> free_rects;
+        /**
+         * @brief The sequence number of each of `free_rects`, counting every free rectangle ever created since `init()`.
+         * Both indices identify free rectangles by these, as their position in `free_rects` changes.
+         */
+        std::vector<size_t> free_seqs;
+        /** @brief The position in `free_rects` of every free rectangle by sequence number, or `npos` if it got split. */
+        std::vector<size_t> free_slots;
+        /** @brief The position in `free_rects` of the first free rectangle added by the last `place()`. */
+        size_t added_free_begin = 0;
+        /** @brief The sequence numbers of the free rectangles the last `place()` moved to another position. */
+        std::vector<size_t> moved_free;
+        /** @brief Answers which of `free_rects` can hold a given size. */
+        free_rect_index free_index;
+        /** @brief Answers which of `free_rects` intersect or contain a given rectangle. */
+        free_rect_tree free_tree;
+        /** @brief Free rectangles gathered by `place()` and `prune_free_list()`, kept around to avoid reallocating. */
+        std::vector<size_t> free_ids;
+        /** @brief Answers how much of a rectangle's outline touches `used_rects`, once `edges_tracked`. */
+        edge_index edges;
+        /** @brief Whether `edges` is kept up to date, which only contact point scoring needs. */
+        bool edges_tracked = false;
+
+        /** @brief Starts keeping `edges` up to date, adding every rectangle placed so far. */
+        void track_edges() {
+            if(edges_tracked) return;
+
+            edges.reset(bin_width, bin_height);
+            for(const rect &r : used_rects) edges.insert(r);
+            edges_tracked = true;
+        }
+
+        /**
+         * @brief Computes the placement score for placing the given rectangle with the given method.
+         * 
+         * @param width The rectangle width.
+         * @param height The rectangle height.
+         * @param method The packing method. See `heuristic` documentation for details.
+         * @param score1 [out] The primary placement score will be outputted here.
+         * @param score2 [out] The secondary placement score will be outputted here. This is used to break ties.
+         * @return The struct that identifies where the rectangle would be placed if it were placed.
+         */
+        rect score(int width, int height, heuristic method, int &score1, int &score2) const {
+            rect new_node;
+            score1 = std::numeric_limits<int>::max();
+            score2 = std::numeric_limits<int>::max();
+            switch(method) {
+                case heuristic::best_short_side_fit: new_node = find_pos_short_side(width, height, score1, score2); break;
+                case heuristic::bottom_left_rule: new_node = find_pos_bottom_left(width, height, score1, score2); break;
+                case heuristic::contact_point_rule: {
+                    new_node = find_pos_contact_point(width, height, score1);
+                    score1 = -score1; // Reverse since we are minimizing, but for contact point score bigger is better.
+
+                } break;
+
+                case heuristic::best_long_side_fit: new_node = find_pos_long_side(width, height, score2, score1); break;
+                case heuristic::best_area_fit: new_node = find_pos_best_area(width, height, score1, score2); break;
+            }
+
+            // Cannot fit the current rectangle.
+            if(new_node.height == 0) {
+                score1 = std::numeric_limits<int>::max();
+                score2 = std::numeric_limits<int>::max();
+            }
+
+            return new_node;
+        }
+
+        /**
+         * @brief Inserts the given list of rectangles in an offline/batch mode by rescoring every one of them after each
+         * placement.
+         */
+        void insert_rescoring(std::vector<rect_size> &rects, std::vector<rect> &dst, std::vector<int> &dst_ids, heuristic method) {
+            while(rects.size() > 0) {
+                int best_score1 = std::numeric_limits<int>::max();
+                int best_score2 = std::numeric_limits<int>::max();
+                int best_index = -1;
+                rect best_node;
+
+                for(size_t i = 0; i < rects.size(); ++i) {
+                    int score1;
+                    int score2;
+                    rect new_node = score(rects[i].width, rects[i].height, method, score1, score2);
+
+                    if(score1 < best_score1 || (score1 == best_score1 && score2 < best_score2)) {
+                        best_score1 = score1;
+                        best_score2 = score2;
+                        best_node = new_node;
+                        best_index = i;
+                    }
+                }
+
+                if(best_index == -1) return;
+
+                place(best_node);
+                dst.push_back(best_node);
+                dst_ids.push_back(rects[best_index].id);
+                rects[best_index] = rects.back();
+                rects.pop_back();
+            }
+        }
+
+        /**
+         * @brief Inserts the given list of rectangles in an offline/batch mode, keeping every pending rectangle's best
+         * few positions around between placements, with the same result as `insert_rescoring()`.
+         *
+         * A placement only splits the free rectangles it intersects, moving a few survivors into their positions and
+         * appending the pieces after them. Scores don't depend on anything but the free rectangle, and ties only on
+         * its position, so the cached positions in free rectangles that stayed put are still the best among those,
+         * and only need to be merged with the moved free rectangles and the appended pieces. A rectangle is only
+         * searched from scratch once all of its cached positions got split or moved. Rectangles that didn't
+         * fit anywhere never will, since the pieces lie inside the split free rectangles. The best position of each
+         * rectangle changes after nearly every placement, so the global best is tracked while refreshing them
+         * instead of through a priority queue.
+         *
+         * @param scoring The placement scoring rule; one of the `*_scoring` structs, which must not depend on
+         *                `used_rects`.
+         */
+        template<typename T_scoring>
+        void insert_cached(std::vector<rect_size> &rects, std::vector<rect> &dst, std::vector<int> &dst_ids, const T_scoring &scoring) {
+            static constexpr size_t cached_fits = 8;
+            std::vector<fit_list<cached_fits>> fits(rects.size());
+
+            auto better = [&](size_t pos, size_t best_pos) {
+                if(best_pos == npos) return true;
+
+                const fit &a = fits[pos].entries[0], &b = fits[best_pos].entries[0];
+                return a.score1 < b.score1 || (a.score1 == b.score1 && a.score2 < b.score2);
+            };
+
+            size_t best_pos = npos;
+            for(size_t pos = 0; pos < rects.size(); ++pos) {
+                fits[pos] = find_fits<cached_fits>(rects[pos].width, rects[pos].height, scoring);
+                if(fits[pos].fits() && better(pos, best_pos)) best_pos = pos;
+            }
+
+            while(best_pos != npos) {
+                rect node = fits[best_pos].entries[0].node;
+                place(node);
+                dst.push_back(node);
+                dst_ids.push_back(rects[best_pos].id);
+
+                rects[best_pos] = rects.back();
+                fits[best_pos] = fits.back();
+                rects.pop_back();
+                fits.pop_back();
+
+                best_pos = npos;
+                for(size_t pos = 0; pos < rects.size(); ++pos) {
+                    fit_list<cached_fits> &f = fits[pos];
+                    if(!f.fits()) continue;
+
+                    f.drop_stale(free_slots);
+                    if(!f.fits()) {
+                        f = find_fits<cached_fits>(rects[pos].width, rects[pos].height, scoring);
+                    } else {
+                        refit(f, rects[pos].width, rects[pos].height, scoring);
+                    }
+
+                    if(f.fits() && better(pos, best_pos)) best_pos = pos;
+                }
+            }
+        }
+
+        /** @brief Appends a free rectangle to `free_rects` and both indices, giving it the next sequence number. */
+        void add_free(const rect &r) {
+            size_t seq = free_slots.size();
+            free_slots.push_back(free_rects.size());
+            free_rects.push_back(r);
+            free_seqs.push_back(seq);
+
+            free_index.insert(r, seq);
+            free_tree.insert(r, seq);
+        }
+
+        /** @brief Removes a free rectangle from `free_rects` and both indices, moving the last one in its place. */
+        void remove_free(size_t seq) {
+            size_t slot = free_slots[seq];
+            free_rects[slot] = free_rects.back();
+            free_seqs[slot] = free_seqs.back();
+            free_slots[free_seqs[slot]] = slot;
+
+            free_rects.pop_back();
+            free_seqs.pop_back();
+            free_slots[seq] = npos;
+
+            free_index.erase(seq);
+            free_tree.erase(seq);
+        }
+
+        /**
+         * @return The length of the outline of the given rectangle that touches the bin borders or the placed
+         *         rectangles, looked up in `edges`, which must be tracked.
+         */
+        int contact_point_score_node(int x, int y, int width, int height) const {
+            int score = 0;
+
+            if(x == 0 || x + width == bin_width) score += height;
+            if(y == 0 || y + height == bin_height) score += width;
+
+            return score + edges.contact(x, y, width, height);
+        }
+
+        /** @brief Marks the absence of a position. */
+        static constexpr size_t npos = std::numeric_limits<size_t>::max();
+
+        /** @brief A candidate position for a rectangle, along with its scores. */
+        struct fit {
+            /** @brief Where the rectangle would be placed, or an empty `rect` if it doesn't fit anywhere. */
+            rect node = {};
+            int score1 = std::numeric_limits<int>::max();
+            int score2 = std::numeric_limits<int>::max();
+            /** @brief The sequence number of the free rectangle in `free_seqs`. */
+            size_t seq = npos;
+            /** @brief `slot * 2 + flipped`, where `slot` is the position of the free rectangle in `free_rects`. */
+            size_t order = npos;
+
+            /** @return Whether this position scores better than the other one, breaking ties by `order`. */
+            inline bool better_than(const fit &other) const {
+                if(score1 != other.score1) return score1 < other.score1;
+                if(score2 != other.score2) return score2 < other.score2;
+                return order < other.order;
+            }
+        };
+
+        /**
+         * @brief The best few positions found for a rectangle, best first. The list is always a prefix of the ranking
+         * of every possible position, so once positions are dropped from it, worse ones than the last can't be added.
+         */
+        template<size_t T_capacity>
+        struct fit_list {
+            fit entries[T_capacity];
+            size_t count = 0;
+
+            /** @return Whether there is any position at all. */
+            inline bool fits() const {
+                return count > 0;
+            }
+
+            /** @return The best position, or an empty one if there is none. */
+            inline fit best() const {
+                return count ? entries[0] : fit();
+            }
+
+            /** @return The primary score a position must not exceed to possibly enter the list. */
+            inline int bound() const {
+                return count == T_capacity ? entries[count - 1].score1 : std::numeric_limits<int>::max();
+            }
+
+            /**
+             * @brief Inserts the given position in rank, if it belongs in the list.
+             *
+             * @param candidate The position.
+             * @param extend    Whether the position may be appended after the last one. Only valid if every position
+             *                  better than it has been offered since the list was last emptied.
+             */
+            inline void offer(const fit &candidate, bool extend = true) {
+                size_t pos = count;
+                while(pos > 0 && candidate.better_than(entries[pos - 1])) --pos;
+                if(pos == count && (!extend || count == T_capacity)) return;
+
+                if(count < T_capacity) ++count;
+                for(size_t i = count - 1; i > pos; --i) entries[i] = entries[i - 1];
+                entries[pos] = candidate;
+            }
+
+            /**
+             * @brief Drops positions whose free rectangle got split or moved, which no longer rank where they did. The
+             * rest remain a prefix of the ranking of the free rectangles that stayed put.
+             */
+            inline void drop_stale(const std::vector<size_t> &free_slots) {
+                size_t kept = 0;
+                for(size_t i = 0; i < count; ++i) {
+                    if(free_slots[entries[i].seq] == entries[i].order / 2) entries[kept++] = entries[i];
+                }
+
+                count = kept;
+            }
+        };
+
+        /**
+         * @brief Scoring of `heuristic::best_short_side_fit`; the shorter leftover side first, then the longer one. Each
+         * scoring has a `score()` function computing both scores of placing a rectangle of the given (possibly flipped)
+         * size in the free rectangle given by its components, and a `bound()` function giving a lower bound of the first
+         * score for any free rectangle at least `min_width` x `min_height` large. Scorings that only depend on the free
+         * rectangle are `vectorized`, and their `score()` works on both `int` and `simd::vint` so both give the same
+         * scores.
+         */
+        struct short_side_scoring {
+            static constexpr bool vectorized = true;
+
+            static inline int bound(int min_width, int min_height, int width, int height) {
+                return std::min(min_width - width, min_height - height);
+            }
+
+            template<typename T>
+            static inline void score(T, T, T free_width, T free_height, T width, T height, T &short_fit, T &long_fit) {
+                using std::min, std::max;
+
+                T leftover_hor = free_width - width;
+                T leftover_ver = free_height - height;
+                short_fit = min(leftover_hor, leftover_ver);
+                long_fit = max(leftover_hor, leftover_ver);
+            }
+        };
+
+        /** @brief Scoring of `heuristic::best_long_side_fit`; the longer leftover side first, then the shorter one. */
+        struct long_side_scoring {
+            static constexpr bool vectorized = true;
+
+            static inline int bound(int min_width, int min_height, int width, int height) {
+                return std::max(min_width - width, min_height - height);
+            }
+
+            template<typename T>
+            static inline void score(T x, T y, T free_width, T free_height, T width, T height, T &long_fit, T &short_fit) {
+                short_side_scoring::score(x, y, free_width, free_height, width, height, short_fit, long_fit);
+            }
+        };
+
+        /** @brief Scoring of `heuristic::best_area_fit`; the leftover area first, then the shorter leftover side. */
+        struct area_scoring {
+            static constexpr bool vectorized = true;
+
+            static inline int bound(int min_width, int min_height, int width, int height) {
+                return min_width * min_height - width * height;
+            }
+
+            template<typename T>
+            static inline void score(T, T, T free_width, T free_height, T width, T height, T &area_fit, T &short_fit) {
+                using std::min;
+
+                area_fit = free_width * free_height - width * height;
+                short_fit = min(free_width - width, free_height - height);
+            }
+        };
+
+        /** @brief Scoring of `heuristic::bottom_left_rule`; the top side first, then the left side. Can't be bounded. */
+        struct bottom_left_scoring {
+            static constexpr bool vectorized = true;
+
+            static inline int bound(int, int, int, int) {
+                return std::numeric_limits<int>::min();
+            }
+
+            template<typename T>
+            static inline void score(T x, T y, T, T, T, T height, T &top_side_y, T &left_x) {
+                top_side_y = y + height;
+                left_x = x;
+            }
+        };
+
+        /**
+         * @brief Scoring of `heuristic::contact_point_rule`; the negated contact length, since bigger is better. Can't
+         * be bounded, and depends on the placed rectangles.
+         */
+        struct contact_point_scoring {
+            static constexpr bool vectorized = false;
+            const max_rects_bin_pack &bin;
+
+            static inline int bound(int, int, int, int) {
+                return std::numeric_limits<int>::min();
+            }
+
+            inline void score(int x, int y, int, int, int width, int height, int &negated, int &tie) const {
+                negated = -bin.contact_point_score_node(x, y, width, height);
+                tie = 0;
+            }
+        };
+
+        /**
+         * @brief Finds the best positions among every free rectangle the given size fits in, in either orientation.
+         * Only free rectangles reported by `free_index` are scored, a whole SIMD block at a time for `vectorized`
+         * scorings, and buckets whose bound is worse than what the list can still take are skipped. Ties are broken
+         * by the position in `free_rects` and then by trying the upright orientation first, so the result is exactly
+         * the same as a linear scan over `free_rects` would give.
+         *
+         * @param width   The rectangle width.
+         * @param height  The rectangle height.
+         * @param scoring The placement scoring rule; one of the `*_scoring` structs.
+         * @return The best `T_capacity` positions.
+         */
+        template<size_t T_capacity, typename T_scoring>
+        fit_list<T_capacity> find_fits(int width, int height, const T_scoring &scoring) const {
+            fit_list<T_capacity> best;
+
+            if constexpr(T_scoring::vectorized) {
+                auto accept = [&](int min_w, int min_h, bool flipped) {
+                    return flipped
+                        ? scoring.bound(min_w, min_h, height, width) <= best.bound()
+                        : scoring.bound(min_w, min_h, width, height) <= best.bound();
+                };
+
+                free_index.query_scored(width, height, allow_flip, scoring, accept, [&]() { return best.bound(); },
+                    [&](int x, int y, size_t seq, bool flipped, int score1, int score2) {
+                        fit candidate;
+                        candidate.node = flipped ? rect{x, y, height, width} : rect{x, y, width, height};
+                        candidate.score1 = score1;
+                        candidate.score2 = score2;
+                        candidate.seq = seq;
+                        candidate.order = free_slots[seq] * 2 + flipped;
+
+                        best.offer(candidate);
+                    }
+                );
+            } else {
+                auto visit = [&](int w, int h, size_t flipped) {
+                    auto accept = [&](int min_w, int min_h) { return scoring.bound(min_w, min_h, w, h) <= best.bound(); };
+                    free_index.query(w, h, accept, [&](const rect &r, size_t seq) {
+                        fit candidate;
+                        candidate.node = {r.x, r.y, w, h};
+                        candidate.seq = seq;
+                        candidate.order = free_slots[seq] * 2 + flipped;
+                        scoring.score(r.x, r.y, r.width, r.height, w, h, candidate.score1, candidate.score2);
+
+                        best.offer(candidate);
+                    });
+                };
+
+                // Try to place the rectangle in upright (non-flipped) orientation.
+                visit(width, height, 0);
+                if(allow_flip && width != height) visit(height, width, 1);
+            }
+
+            return best;
+        }
+
+        /**
+         * @brief Offers every free rectangle the last `place()` moved or added to a list of positions, in either
+         * orientation.
+         */
+        template<size_t T_capacity, typename T_scoring>
+        void refit(fit_list<T_capacity> &best, int width, int height, const T_scoring &scoring) const {
+            auto offer = [&](size_t slot, int w, int h, size_t flipped) {
+                const rect &r = free_rects[slot];
+                fit candidate;
+                candidate.node = {r.x, r.y, w, h};
+                candidate.seq = free_seqs[slot];
+                candidate.order = slot * 2 + flipped;
+                scoring.score(r.x, r.y, r.width, r.height, w, h, candidate.score1, candidate.score2);
+
+                best.offer(candidate, false);
+            };
+
+            auto visit = [&](size_t slot) {
+                const rect &r = free_rects[slot];
+                if(r.width >= width && r.height >= height) offer(slot, width, height, 0);
+                if(allow_flip && width != height && r.width >= height && r.height >= width) offer(slot, height, width, 1);
+            };
+
+            for(size_t seq : moved_free) visit(free_slots[seq]);
+            for(size_t i = added_free_begin; i < free_rects.size(); ++i) visit(i);
+        }
+
+        /** @brief Finds the best position with `find_fits()`, outputting the scores separately. */
+        template<typename T_scoring>
+        rect find_pos(int width, int height, int &best_score1, int &best_score2, const T_scoring &scoring) const {
+            fit best = find_fits<1>(width, height, scoring).best();
+            best_score1 = best.score1;
+            best_score2 = best.score2;
+            return best.node;
+        }
+
+        rect find_pos_bottom_left(int width, int height, int &best_y, int &best_x) const {
+            return find_pos(width, height, best_y, best_x, bottom_left_scoring{});
+        }
+
+        rect find_pos_short_side(int width, int height, int &best_short_fit, int &best_long_fit) const {
+            return find_pos(width, height, best_short_fit, best_long_fit, short_side_scoring{});
+        }
+
+        rect find_pos_long_side(int width, int height, int &best_short_fit, int &best_long_fit) const {
+            return find_pos(width, height, best_long_fit, best_short_fit, long_side_scoring{});
+        }
+
+        rect find_pos_best_area(int width, int height, int &best_area_fit, int &best_short_fit) const {
+            return find_pos(width, height, best_area_fit, best_short_fit, area_scoring{});
+        }
+
+        rect find_pos_contact_point(int width, int height, int &best_score) const {
+            int best_negated, unused;
+            rect best_node = find_pos(width, height, best_negated, unused, contact_point_scoring{*this});
+
+            best_score = best_node.height == 0 ? -1 : -best_negated;
+            return best_node;
+        }
+
+        void insert_new(const rect &new_rect) {
+            assert(new_rect.width > 0);
+            assert(new_rect.height > 0);
+
+            for(size_t i = 0; i < new_free_rects_last_size;) {
+                // Is this new free rectangle already accounted for?
+                if(new_rect.contained_in(new_free_rects[i])) return;
+
+                // Does this new free rectangle obsolete a previous new free rectangle?
+                if(new_free_rects[i].contained_in(new_rect)) {
+                    // Remove i'th new free rectangle, but do so by retaining the order of the older vs newest free
+                    // rectangles that we may still be placing in calling function split_free_node().
+                    new_free_rects[i] = new_free_rects[--new_free_rects_last_size];
+                    new_free_rects[new_free_rects_last_size] = new_free_rects.back();
+                    new_free_rects.pop_back();
+                } else {
+                    ++i;
+                }
+            }
+
+            new_free_rects.push_back(new_rect);
+        }
+
+        /** @return True if the free node was split. */
+        bool split_free_node(const rect &free, const rect &used) {
+            // Test with SAT if the rectangles even intersect.
+            if(
+                used.x >= free.x + free.width || used.x + used.width <= free.x ||
+                used.y >= free.y + free.height || used.y + used.height <= free.y
+            ) return false;
+
+            // We add up to four new free rectangles to the free rectangles list below. None of these four newly added
+            // free rectangles can overlap any other three, so keep a mark of them to avoid testing them against each
+            // other.
+            new_free_rects_last_size = new_free_rects.size();
+
+            if(used.x < free.x + free.width && used.x + used.width > free.x) {
+                // New node at the top side of the used node.
+                if(used.y > free.y && used.y < free.y + free.height) {
+                    rect new_node = free;
+                    new_node.height = used.y - new_node.y;
+                    insert_new(new_node);
+                }
+
+                // New node at the bottom side of the used node.
+                if(used.y + used.height < free.y + free.height) {
+                    rect new_node = free;
+                    new_node.y = used.y + used.height;
+                    new_node.height = free.y + free.height - (used.y + used.height);
+                    insert_new(new_node);
+                }
+            }
+
+            if(used.y < free.y + free.height && used.y + used.height > free.y) {
+                // New node at the left side of the used node.
+                if(used.x > free.x && used.x < free.x + free.width) {
+                    rect new_node = free;
+                    new_node.width = used.x - new_node.x;
+                    insert_new(new_node);
+                }
+
+                // New node at the right side of the used node.
+                if(used.x + used.width < free.x + free.width) {
+                    rect new_node = free;
+                    new_node.x = used.x + used.width;
+                    new_node.width = free.x + free.width - (used.x + used.width);
+                    insert_new(new_node);
+                }
+            }
+
+            return true;
+        }
+
+        /**
+         * Goes through the free rectangle list and removes any redundant entries. Only the free rectangles that contain
+         * any of the new ones are visited, in the order of `free_rects`, so the new ones end up in the same order as
+         * if every free rectangle was tested.
+         */
+        void prune_free_list() {
+            // A new free rectangle is dropped by the first free rectangle that contains it, if any.
+            free_ids.clear();
+            for(const rect &r : new_free_rects) {
+                size_t first = npos;
+                free_tree.query_containing(r, [&](size_t seq) { first = std::min(first, free_slots[seq]); });
+                if(first != npos) free_ids.push_back(first);
+            }
+
+            std::sort(free_ids.begin(), free_ids.end());
+            free_ids.erase(std::unique(free_ids.begin(), free_ids.end()), free_ids.end());
+
+            // Test the newly introduced free rectangles against those old free rectangles.
+            for(size_t slot : free_ids) {
+                const rect &old = free_rects[slot];
+                for(size_t j = 0; j < new_free_rects.size();) {
+                    if(new_free_rects[j].contained_in(old)) {
+                        new_free_rects[j] = new_free_rects.back();
+                        new_free_rects.pop_back();
+                    } else {
+                        // The old free rectangles can never be contained in any of the new free rectangles (the new
+                        // free rectangles keep shrinking in size)
+                        assert(!old.contained_in(new_free_rects[j]));
+
+                        ++j;
+                    }
+                }
+            }
+
+            // Merge new and old free rectangles to the group of old free rectangles.
+            for(const rect &r : new_free_rects) add_free(r);
+
+            new_free_rects.clear();
+        }
+    };
+}
+
+#endif // !AV_PACKER_MAXRECTS_HPP
@@ -0,0 +1,292 @@
+#include <packer/outline.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+namespace av {
+    namespace {
+        using span = opaque_rows::extent;
+
+        /** @return How far `b` turns left from `a` around `origin`, i.e. twice the signed area of their triangle. */
+        inline double cross(const outline_point &origin, const outline_point &a, const outline_point &b) {
+            return (static_cast<double>(a.x) - origin.x) * (static_cast<double>(b.y) - origin.y) - (static_cast<double>(a.y) - origin.y) * (static_cast<double>(b.x) - origin.x);
+        }
+
+        /** @return Twice the signed area of a polygon, positive if its vertices turn left. */
+        double area(const std::vector<outline_point> &polygon) {
+            double sum = 0.0;
+            for(size_t i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++) {
+                sum += static_cast<double>(polygon[j].x) * polygon[i].y - static_cast<double>(polygon[i].x) * polygon[j].y;
+            }
+
+            return sum;
+        }
+
+        /** @brief Removes vertices lying on the line between their neighbours, duplicates included. */
+        void drop_collinear(std::vector<outline_point> &polygon) {
+            for(bool removed = true; removed && polygon.size() > 3;) {
+                removed = false;
+                for(size_t i = 0; i < polygon.size() && polygon.size() > 3; ++i) {
+                    const outline_point &prev = polygon[(i + polygon.size() - 1) % polygon.size()], &next = polygon[(i + 1) % polygon.size()];
+                    if(cross(prev, polygon[i], next) == 0.0) {
+                        polygon.erase(polygon.begin() + i--);
+                        removed = true;
+                    }
+                }
+            }
+        }
+
+        /** @return The convex hull of the corners of every pixel, with its vertices turning left. */
+        std::vector<outline_point> convex_hull(const std::vector<span> &rows) {
+            std::vector<outline_point> points;
+            for(int y = 0; y < static_cast<int>(rows.size()); ++y) {
+                const span &row = rows[y];
+                if(row.left >= row.right) continue;
+
+                float top = static_cast<float>(y), bottom = static_cast<float>(y + 1);
+                points.insert(points.end(), {{static_cast<float>(row.left), top}, {static_cast<float>(row.left), bottom}, {static_cast<float>(row.right), top}, {static_cast<float>(row.right), bottom}});
+            }
+
+            std::sort(points.begin(), points.end(), [](const outline_point &a, const outline_point &b) { return a.x < b.x || (a.x == b.x && a.y < b.y); });
+
+            // Andrew's monotone chain: the lower then the upper hull, each dropping points that don't turn left.
+            std::vector<outline_point> hull(points.size() * 2);
+            size_t count = 0;
+            for(size_t i = 0; i < points.size(); ++i) {
+                while(count >= 2 && cross(hull[count - 2], hull[count - 1], points[i]) <= 0.0) --count;
+                hull[count++] = points[i];
+            }
+
+            for(size_t i = points.size() - 1, lower = count + 1; i-- > 0;) {
+                while(count >= lower && cross(hull[count - 2], hull[count - 1], points[i]) <= 0.0) --count;
+                hull[count++] = points[i];
+            }
+
+            hull.resize(count - 1);
+            return hull;
+        }
+
+        /**
+         * @brief Removes edges of a convex polygon turning left until it has at most the given number of vertices, each
+         * time extending the neighbours of the edge adding the least area until they meet.
+         *
+         * @return Whether it worked; edges can't be removed if their neighbours would meet outside the image.
+         */
+        bool reduce(std::vector<outline_point> &polygon, size_t max_vertices, int width, int height) {
+            while(polygon.size() > max_vertices) {
+                size_t n = polygon.size(), best = n;
+                double best_area = std::numeric_limits<double>::infinity();
+                outline_point best_point = {};
+
+                for(size_t i = 0; i < n; ++i) {
+                    const outline_point &prev = polygon[(i + n - 1) % n], &a = polygon[i], &b = polygon[(i + 1) % n], &next = polygon[(i + 2) % n];
+
+                    double dx1 = static_cast<double>(a.x) - prev.x, dy1 = static_cast<double>(a.y) - prev.y;
+                    double dx2 = static_cast<double>(next.x) - b.x, dy2 = static_cast<double>(next.y) - b.y;
+                    double denom = dx1 * dy2 - dy1 * dx2;
+                    if(denom <= 1e-9) continue;
+
+                    double t = ((static_cast<double>(b.x) - a.x) * dy2 - (static_cast<double>(b.y) - a.y) * dx2) / denom;
+                    if(t < 0.0) continue;
+
+                    outline_point meet = {static_cast<float>(a.x + dx1 * t), static_cast<float>(a.y + dy1 * t)};
+                    if(meet.x < 0.0f || meet.y < 0.0f || meet.x > width || meet.y > height) continue;
+
+                    double added = std::abs(cross(a, meet, b));
+                    if(added < best_area) {
+                        best_area = added;
+                        best = i;
+                        best_point = meet;
+                    }
+                }
+
+                if(best == n) return false;
+
+                polygon[best] = best_point;
+                polygon.erase(polygon.begin() + (best + 1) % n);
+            }
+
+            return true;
+        }
+
+        /**
+         * @brief Makes a staircase of bands of rows, each covering the extent of its pixels. Bands without any are
+         * dropped at either end, and copy the band above in between; bands are also widened to overlap the band above,
+         * so that the polygon stays simple.
+         *
+         * @param band The height of a band, in rows.
+         */
+        std::vector<outline_point> staircase(const std::vector<span> &rows, int width, int band) {
+            struct step {
+                int top, bottom;
+                span extent;
+                bool empty;
+            };
+
+            int height = static_cast<int>(rows.size());
+            std::vector<step> steps;
+            for(int top = 0; top < height; top += band) {
+                int bottom = std::min(top + band, height);
+
+                span extent = {width, 0};
+                for(int y = top; y < bottom; ++y) {
+                    if(rows[y].left >= rows[y].right) continue;
+
+                    extent.left = std::min(extent.left, rows[y].left);
+                    extent.right = std::max(extent.right, rows[y].right);
+                }
+
+                bool empty = extent.left >= extent.right;
+                if(empty && steps.empty()) continue;
+
+                if(empty) {
+                    extent = steps.back().extent;
+                } else if(!steps.empty()) {
+                    const span &above = steps.back().extent;
+                    if(extent.left >= above.right) extent.left = above.right - 1;
+                    if(extent.right <= above.left) extent.right = above.left + 1;
+                }
+
+                steps.push_back({top, bottom, extent, empty});
+            }
+
+            while(!steps.empty() && steps.back().empty) steps.pop_back();
+
+            // Down the left side, then up the right side.
+            std::vector<outline_point> polygon;
+            for(const step &s : steps) {
+                polygon.push_back({static_cast<float>(s.extent.left), static_cast<float>(s.top)});
+                polygon.push_back({static_cast<float>(s.extent.left), static_cast<float>(s.bottom)});
+            }
+
+            for(size_t i = steps.size(); i-- > 0;) {
+                polygon.push_back({static_cast<float>(steps[i].extent.right), static_cast<float>(steps[i].bottom)});
+                polygon.push_back({static_cast<float>(steps[i].extent.right), static_cast<float>(steps[i].top)});
+            }
+
+            drop_collinear(polygon);
+            return polygon;
+        }
+
+        /** @return Whether a point lies inside a triangle or on its edges, given the winding of the triangle. */
+        inline bool inside(const outline_point &p, const outline_point &a, const outline_point &b, const outline_point &c, double winding) {
+            return winding * cross(a, b, p) >= 0.0 && winding * cross(b, c, p) >= 0.0 && winding * cross(c, a, p) >= 0.0;
+        }
+
+        inline bool same(const outline_point &a, const outline_point &b) {
+            return a.x == b.x && a.y == b.y;
+        }
+    }
+
+    opaque_rows opaque_rows::scan(const image &pixels, int x, int y, int width, int height) {
+        opaque_rows result;
+        result.width = width;
+        result.rows.assign(height, {width, 0});
+
+        for(int row = 0; row < pixels.height; ++row) {
+            const unsigned char *src = pixels.pixels.data() + static_cast<size_t>(row) * pixels.width * 4;
+
+            int left = 0, right = pixels.width;
+            while(left < pixels.width && !src[left * 4 + 3]) ++left;
+            if(left == pixels.width) continue;
+            while(!src[(right - 1) * 4 + 3]) --right;
+
+            result.rows[y + row] = {x + left, x + right};
+        }
+
+        return result;
+    }
+
+    opaque_rows opaque_rows::resized(int width, int height, resample_filter filter) const {
+        int source_height = static_cast<int>(rows.size());
+        double scale_x = static_cast<double>(this->width) / width, scale_y = static_cast<double>(source_height) / height;
+        double reach_x = filter_radius(filter) * std::max(1.0, scale_x), reach_y = filter_radius(filter) * std::max(1.0, scale_y);
+
+        // A resized pixel is made of the source pixels whose centers are less than the reach away from its own center,
+        // mapped back to the source. The bounds are rounded outwards, as pixels right at the reach weigh nothing anyway.
+        constexpr double slack = 1e-6;
+
+        opaque_rows result;
+        result.width = width;
+        result.rows.assign(height, {width, 0});
+
+        for(int y = 0; y < height; ++y) {
+            double center = (y + 0.5) * scale_y;
+            int first = std::max(0, static_cast<int>(std::floor(center - reach_y - 0.5 - slack)) + 1);
+            int last = std::min(source_height - 1, static_cast<int>(std::ceil(center + reach_y - 0.5 + slack)) - 1);
+
+            span source = {this->width, 0};
+            for(int row = first; row <= last; ++row) {
+                if(rows[row].left >= rows[row].right) continue;
+
+                source.left = std::min(source.left, rows[row].left);
+                source.right = std::max(source.right, rows[row].right);
+            }
+
+            if(source.left >= source.right) continue;
+
+            int left = static_cast<int>(std::floor((source.left + 0.5 - reach_x) / scale_x - 0.5 - slack)) + 1;
+            int right = static_cast<int>(std::ceil((source.right - 0.5 + reach_x) / scale_x - 0.5 + slack));
+            result.rows[y] = {std::max(0, left), std::min(width, right)};
+        }
+
+        return result;
+    }
+
+    std::vector<outline_point> trace_outline(const opaque_rows &rows, size_t max_vertices) {
+        int width = rows.width, height = static_cast<int>(rows.rows.size());
+
+        bool any = std::any_of(rows.rows.begin(), rows.rows.end(), [](const span &row) { return row.left < row.right; });
+        if(!any) return {{0.0f, 0.0f}, {0.0f, static_cast<float>(height)}, {static_cast<float>(width), static_cast<float>(height)}, {static_cast<float>(width), 0.0f}};
+
+        // The staircase always ends up within budget, at worst as the bounding rectangle.
+        std::vector<outline_point> stairs;
+        for(int band = 1;; band *= 2) {
+            stairs = staircase(rows.rows, width, band);
+            if(stairs.size() <= max_vertices || band >= height) break;
+        }
+
+        std::vector<outline_point> hull = convex_hull(rows.rows);
+        if(hull.size() >= 3 && reduce(hull, max_vertices, width, height) && std::abs(area(hull)) < std::abs(area(stairs))) return hull;
+
+        return stairs;
+    }
+
+    std::vector<uint16_t> triangulate(const std::vector<outline_point> &outline) {
+        std::vector<uint16_t> triangles;
+        if(outline.size() < 3) return triangles;
+
+        double winding = area(outline) < 0.0 ? -1.0 : 1.0;
+        std::vector<uint16_t> remaining(outline.size());
+        std::iota(remaining.begin(), remaining.end(), static_cast<uint16_t>(0));
+
+        while(remaining.size() > 3) {
+            size_t n = remaining.size(), ear = n;
+            for(size_t i = 0; i < n && ear == n; ++i) {
+                const outline_point &a = outline[remaining[(i + n - 1) % n]], &b = outline[remaining[i]], &c = outline[remaining[(i + 1) % n]];
+                if(winding * cross(a, b, c) <= 0.0) continue;
+
+                bool blocked = false;
+                for(size_t j = 0; j < n && !blocked; ++j) {
+                    const outline_point &p = outline[remaining[j]];
+                    if(j == i || j == (i + n - 1) % n || j == (i + 1) % n || same(p, a) || same(p, b) || same(p, c)) continue;
+
+                    blocked = inside(p, a, b, c, winding);
+                }
+
+                if(!blocked) ear = i;
+            }
+
+            // Only a degenerate polygon has no ear; cutting any vertex off still covers it.
+            if(ear == n) ear = 0;
+
+            triangles.insert(triangles.end(), {remaining[(ear + n - 1) % n], remaining[ear], remaining[(ear + 1) % n]});
+            remaining.erase(remaining.begin() + ear);
+        }
+
+        triangles.insert(triangles.end(), remaining.begin(), remaining.end());
+        return triangles;
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef AV_PACKER_OUTLINE_HPP
+#define AV_PACKER_OUTLINE_HPP
+
+#include <packer/image.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace av {
+    /** @brief A vertex of a sprite outline, in pixels from the top-left corner of the image it was traced from. */
+    struct outline_point {
+        float x, y;
+    };
+
+    /** @brief Where the pixels whose alpha isn't zero are in every row of an image, which is all outlines look at. */
+    struct opaque_rows {
+        /** @brief The first such pixel of a row and the one past its last; empty if `left >= right`. */
+        struct extent {
+            int left, right;
+        };
+
+        /** @brief The image width. */
+        int width = 0;
+        std::vector<extent> rows;
+
+        /**
+         * @brief Scans an image placed in a larger, transparent one.
+         *
+         * @param pixels The image.
+         * @param x      The X position of the image in the larger one.
+         * @param y      The Y position of the image in the larger one.
+         * @param width  The width of the larger image.
+         * @param height The height of the larger one.
+         * @return The rows of the larger image.
+         */
+        static opaque_rows scan(const image &pixels, int x, int y, int width, int height);
+
+        /**
+         * @brief Finds where the pixels that `image::resize()` doesn't leave fully transparent can be, by widening
+         * every row by how far the filter reaches before scaling it.
+         *
+         * @param width  The resized width.
+         * @param height The resized height.
+         * @param filter The filter the image is resized with.
+         * @return The rows of the resized image, holding at least every pixel whose alpha isn't zero.
+         */
+        opaque_rows resized(int width, int height, resample_filter filter) const;
+    };
+
+    /**
+     * @brief Finds a simple polygon that holds every pixel whose alpha isn't zero, with at most the given number of
+     * vertices, so that drawing the sprite as that polygon instead of a quad skips its transparent area.
+     *
+     * Two candidates are made, and the one with the smallest area is kept:
+     * - The convex hull of the pixels, whose edges are then removed one at a time, each time picking the one whose
+     *   neighbouring edges, once extended to meet each other, add the least area.
+     * - A concave staircase of the rows, each band of rows covering the horizontal extent of its pixels, with the bands
+     *   made taller until there are few enough vertices. At worst, a single band is the bounding rectangle.
+     *
+     * Both stay within the image.
+     *
+     * @param rows         The pixels of the image.
+     * @param max_vertices The vertex budget, at least 4.
+     * @return The polygon, in a consistent winding. The whole image if it's fully transparent.
+     */
+    std::vector<outline_point> trace_outline(const opaque_rows &rows, size_t max_vertices);
+
+    /**
+     * @brief Splits a simple polygon into triangles by ear clipping: cutting off, one at a time, a convex vertex whose
+     * triangle with its neighbours holds no other vertex.
+     *
+     * @param outline The polygon, e.g. as traced by `trace_outline()`.
+     * @return Every triangle as 3 indices into `outline`, with the same winding as the polygon.
+     */
+    std::vector<uint16_t> triangulate(const std::vector<outline_point> &outline);
+}
+
+#endif // !AV_PACKER_OUTLINE_HPP
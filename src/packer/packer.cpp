@@ -1,555 +1,1302 @@
+#include <packer/atlas_writer.hpp>
+#include <packer/block_encoder.hpp>
+#include <packer/cache.hpp>
+#include <packer/distance_field.hpp>
+#include <packer/image.hpp>
+#include <packer/max_rects.hpp>
+#include <packer/outline.hpp>
+#include <packer/palette.hpp>
+#include <packer/png_writer.hpp>
+#include <packer/search.hpp>
+#include <packer/simd.hpp>
+#include <av/util/graphics/atlas_file.hpp>
+#include <av/util/hash.hpp>
+#include <av/util/log.hpp>
+#include <av/util/thread_pool.hpp>
+
 #include <algorithm>
-#include <cassert>
-#include <cmath>
+#include <cctype>
+#include <condition_variable>
+#include <cstdint>
 #include <cstdlib>
 #include <cstring>
-#include <iostream>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
 #include <limits>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
-#define STB_IMAGE_IMPLEMENTATION
-#include <stb/stb_image.h>
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include <stb/stb_image_write.h>
+namespace fs = std::filesystem;
+using namespace av;
 
-namespace av {
-    struct rect_size {
-        int width;
-        int height;
+namespace {
+    /** @brief How the atlas pages are written. */
+    enum class output_format {
+        /** @brief One PNG file per page, with a text manifest of the regions. */
+        png,
+        /** @brief A single binary atlas file holding the pages and the regions, as read by `atlas_view`. */
+        atlas
     };
 
-    struct rect {
-        int x;
-        int y;
-        int width;
-        int height;
-        
-        bool contained_in(const rect &other) const {
-            return
-                x >= other.x && y >= other.y &&
-                x + width <= other.x + other.width &&
-                y + height <= other.y + other.height;
-        }
+    /** @brief The bin packing algorithm, each of which is a `pack_strategy` policy. */
+    enum class bin_algorithm {
+        /** @brief `max_rects_bin_pack`, the densest and slowest. */
+        max_rects,
+        /** @brief `skyline_bin_pack`. */
+        skyline,
+        /** @brief `guillotine_bin_pack`. */
+        guillotine
     };
 
-    int common_length(int i1start, int i1end, int i2start, int i2end) {
-        if(i1end < i2start || i2end < i1start) return 0;
-        return std::min(i1end, i2end) - std::max(i1start, i2start);
-    }
-
-    class max_rects_bin_pack {
-        public:
-        max_rects_bin_pack(): bin_width(0), bin_height(0) {}
- 
+    /** @brief The `options::palette` value that only indexes pages with at most 256 colors. */
+    constexpr int palette_auto = -1;
+
+    /** @brief Command line options of the packer. */
+    struct options {
+        /** @brief Directories to scan for sprites. */
+        std::vector<std::string> inputs;
+        /** @brief Output path, without extension. */
+        std::string output = "atlas";
+        output_format format = output_format::png;
+        /** @brief The atlas page dimension, in pixels of the largest variant. */
+        int width = 1024, height = 1024;
+        bin_algorithm algorithm = bin_algorithm::max_rects;
+        /** @brief The placement rule by name, since every algorithm has its own, or empty for the default one. */
+        std::string heuristic;
+        /** @brief The insertion order, and whether sprites may be rotated by 90 degrees. */
+        sort_order order = sort_order::global_best;
+        bool allow_flip = true;
+        /** @brief Whether to try every heuristic and order instead, keeping the best; `allow_flip` still applies. */
+        bool search = false;
+        /** @brief Whether to find the smallest page size following `sizes` instead of using `width` and `height`. */
+        bool auto_size = false;
+        /** @brief The page sizes `auto_size` may pick. */
+        size_rules sizes;
+        /** @brief The most pages to spill sprites over, `0` for no limit. */
+        size_t max_pages = 0;
+        /** @brief Pixels of space around every sprite in the smallest variant, filled with its extruded edges. */
+        int padding = 0;
         /**
-         * @brief Instantiates a bin of the given size.
-         * @param allow_flip Specifies whether the packing algorithm is allowed to rotate the input rectangles by 90 degrees
-         * to consider a better placement.
+         * @brief The scale of every resolution variant to write, largest first, e.g. `{4, 2, 1}`, or empty for a single
+         * one. Sprites are drawn at the largest scale, and resampled to the others.
          */
-        max_rects_bin_pack(int width, int height, bool allow_flip = true) {
-            init(width, height, allow_flip);
-        }
-
+        std::vector<int> scales;
+        /** @brief The filter sprites are resampled to the smaller variants with. */
+        resample_filter filter = resample_filter::lanczos3;
+        /** @brief Whether to store a full mip chain with every page, only for `output_format::atlas`. */
+        bool mips = false;
         /**
-         * @brief Initializes the packer to an empty bin of width x height units. Call whenever you need to restart with a
-         * new bin.
-         * @param width The bin width;
-         * @param height The bin height;
-         * @param allow_flip Specifies whether the packing algorithm is allowed to rotate the input rectangles by 90 degrees
-         * to consider a better placement.
+         * @brief Whether to make every page the same size and format, and mark the atlas so that its pages are loaded
+         * as the layers of one texture array; only for `output_format::atlas`.
          */
-        void init(int width, int height, bool allow_flip = true) {
-            allow_flip = allow_flip;
-            bin_width = width;
-            bin_height = height;
-
-            rect n;
-            n.x = 0;
-            n.y = 0;
-            n.width = width;
-            n.height = height;
-
-            used_rects.clear();
-            free_rects.clear();
-            free_rects.push_back(n);
-        }
-
-        /** @brief Specifies the different heuristic rules that can be used when deciding where to place a new rectangle. */
-        enum class heuristic {
-            /** @brief Positions the rectangle against the short side of a free rectangle into which it fits the best */
-            best_short_side_fit,
-            /** @brief Positions the rectangle against the long side of a free rectangle into which it fits the best. */
-            best_long_side_fit,
-            /** @brief Positions the rectangle into the smallest free rect into which it fits. */
-            best_area_fit,
-            /** @brief Does the Tetris placement. */
-            bottom_left_rule,
-            /** @brief Chooses the placement where the rectangle touches other rects as much as possible. */
-            contact_point_rule
+        bool array = false;
+        /** @brief The `atlas_format_*` constant pages are stored as; anything but 8-bit RGBA needs `output_format::atlas`. */
+        uint32_t pixel_format = atlas_format_rgba8;
+        /** @brief The most vertices of the mesh written around the opaque pixels of every sprite, `0` for none. */
+        size_t mesh = 0;
+        /**
+         * @brief How far the signed distance fields that pages hold instead of colors reach on either side of the
+         * edges of the sprites, in pixels of the smallest variant, or `0` for colors.
+         */
+        int sdf = 0;
+        /**
+         * @brief How many colors the palette of every page may hold if pages are stored as indices into one, `0` to
+         * store colors, or `palette_auto` to only index the pages that have few enough colors to lose nothing.
+         */
+        int palette = 0;
+        /** @brief Whether to reuse what the previous run with the same output path produced, where possible. */
+        bool cache = true;
+        /**
+         * @brief Roughly how many bytes of decoded sprites and pages may be held at once, `0` for no limit. With a
+         * limit, sprites are decoded once to be measured and once more to be drawn, instead of being kept in between.
+         */
+        size_t memory = 0;
+        /** @brief The zlib compression level of PNG pages, from 1 to 9. */
+        int compression = 3;
+        /** @brief How many worker threads to use, `0` for one per hardware thread. */
+        size_t threads = 0;
+    };
+
+    /** @brief Makes threads wait until the memory they are about to use fits within a limit. */
+    class memory_budget {
+        std::mutex lock;
+        std::condition_variable released;
+        size_t limit, used = 0;
+
+        public:
+        /** @brief A reservation, released on destruction. */
+        class lease {
+            memory_budget &budget;
+            size_t bytes;
+
+            public:
+            lease(const lease &) = delete;
+            lease(memory_budget &budget, size_t bytes): budget(budget), bytes(bytes) {
+                budget.acquire(bytes);
+            }
+
+            ~lease() {
+                budget.release(bytes);
+            }
         };
-        
+
+        memory_budget(const memory_budget &) = delete;
+        /** @param limit The limit, in bytes, or `0` for none. */
+        memory_budget(size_t limit): limit(limit) {}
+
         /**
-         * @brief Inserts the given list of rectangles in an offline/batch mode, possibly rotated.
-         * 
-         * @param rects The list of rectangles to insert. This vector will be destroyed in the process.
-         * @param dst [out] This list will contain the packed rectangles. The indices will not correspond to that of rects.
-         * @param method The rectangle placement rule to use when packing.
+         * @brief Blocks until the given amount fits, and reserves it. A reservation larger than the limit is let
+         * through once nothing else is reserved, so that it can't wait forever.
          */
-        void insert(std::vector<rect_size> &rects, std::vector<rect> &dst, heuristic method) {
-            dst.clear();
-
-            while(rects.size() > 0) {
-                int best_score1 = std::numeric_limits<int>::max();
-                int best_score2 = std::numeric_limits<int>::max();
-                int best_index = -1;
-                rect best_node;
-
-                for(size_t i = 0; i < rects.size(); ++i) {
-                    int score1;
-                    int score2;
-                    rect new_node = score(rects[i].width, rects[i].height, method, score1, score2);
-
-                    if(score1 < best_score1 || (score1 == best_score1 && score2 < best_score2)) {
-                        best_score1 = score1;
-                        best_score2 = score2;
-                        best_node = new_node;
-                        best_index = i;
-                    }
-                }
+        void acquire(size_t bytes) {
+            if(!limit) return;
 
-                if(best_index == -1) return;
+            std::unique_lock<std::mutex> guard(lock);
+            released.wait(guard, [&]() { return !used || used + bytes <= limit; });
+            used += bytes;
+        }
 
-                place(best_node);
-                dst.push_back(best_node);
-                rects[best_index] = rects.back();
-                rects.pop_back();
+        void release(size_t bytes) {
+            if(!limit) return;
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                used -= bytes;
             }
+
+            released.notify_all();
         }
+    };
 
+    /** @brief One resolution of the atlas. Every variant shares the same layout, scaled. */
+    struct variant {
+        /** @brief The scale, as given on the command line. */
+        int scale;
+        /** @brief How many pixels a layout unit takes in this variant. */
+        int factor;
+        /** @brief The output path, without extension. */
+        std::string output;
+    };
+
+    /** @brief A single input image. */
+    struct sprite {
+        /** @brief The sprite name, i.e. the path relative to its input directory without the extension. */
+        std::string name;
+        /** @brief The image file path. */
+        std::string path;
+        /** @brief The image file, as last seen. */
+        pack_cache::file_entry file;
         /**
-         * Inserts a single rectangle into the bin, possibly rotated.
-         * 
-         * @param width The rectangle width.
-         * @param height The rectangle height.
-         * @param method The packing method. See `heuristic` documentation for details.
-         * @return The inserted rectangle.
+         * @brief `file.bounds`, grown to multiples of the factor of the largest variant, so that it takes whole pixels in
+         * every variant.
          */
-        rect insert(int width, int height, heuristic method) {
-            rect new_node;
-
-            // Unused in this function. We don't need to know the score after finding the position.
-            int score1 = std::numeric_limits<int>::max();
-            int score2 = std::numeric_limits<int>::max();
-            switch(method) {
-                case heuristic::best_short_side_fit: new_node = find_pos_short_side(width, height, score1, score2); break;
-                case heuristic::bottom_left_rule: new_node = find_pos_bottom_left(width, height, score1, score2); break;
-                case heuristic::contact_point_rule: new_node = find_pos_contact_point(width, height, score1); break;
-                case heuristic::best_long_side_fit: new_node = find_pos_long_side(width, height, score2, score1); break;
-                case heuristic::best_area_fit: new_node = find_pos_best_area(width, height, score1, score2); break;
-            }
+        rect aligned = {};
+        /** @brief The pixels within `file.bounds`, only kept if decoded anyway or needed to copy into a page. */
+        image pixels;
+        /** @brief The triangles of every outline in `file.outlines`, 3 vertex indices each. */
+        std::vector<std::vector<uint16_t>> triangles;
+        /** @brief The index of the sprite holding the same pixels that is actually packed, this one's if none. */
+        size_t alias = 0;
+        /** @brief The atlas page the sprite was placed in. */
+        size_t page = 0;
+        /** @brief Where the sprite was placed in its page, in layout units. */
+        rect region = {};
+        /** @brief Whether the sprite was rotated 90 degrees clockwise to fit `region`. */
+        bool flipped = false;
+    };
+
+    void print_usage(const char *program) {
+        std::printf(
+            "Usage: %s [options] <input-dir>...\n"
+            "Packs every image found in the input directories into an atlas, spilling over to more pages as needed.\n\n"
+            "Options:\n"
+            "  -o, --output <path>     Output path without extension (default: atlas). Pages are written to <path>.png,\n"
+            "                          or <path>-<index>.png if there are several.\n"
+            "  --format <name>         png, or atlas for a single binary <path>.avatlas (default: png).\n"
+            "  --width <px>            Atlas page width, at the largest scale (default: 1024).\n"
+            "  --height <px>           Atlas page height, at the largest scale (default: 1024).\n"
+            "  --max-pages <n>         The most pages to use (default: no limit).\n"
+            "  --auto-size             Uses the largest size for full pages and the smallest one for the last page instead\n"
+            "                          of --width and --height.\n"
+            "  --pow2                  Only picks power of two sizes with --auto-size.\n"
+            "  --square                Only picks square sizes with --auto-size.\n"
+            "  --max-size <px>         The largest dimension --auto-size may pick (default: 4096).\n"
+            "  --packer <name>         max-rects, or skyline or guillotine for much faster but looser packing\n"
+            "                          (default: max-rects).\n"
+            "  --heuristic <name>      short-side, long-side, area, bottom-left or contact-point with max-rects,\n"
+            "                          bottom-left or min-waste with skyline, short-side, long-side or area with\n"
+            "                          guillotine (default: the first one).\n"
+            "  --order <name>          global, area, max-side or perimeter (default: global). Skyline min-waste\n"
+            "                          places sprites by area instead of globally.\n"
+            "  --no-flip               Never rotate sprites.\n"
+            "  --padding <px>          Space around every sprite, filled by extruding its edges (default: 0).\n"
+            "  --scales <list>         Writes an atlas variant for every scale in a comma separated list, e.g. 4,2,1,\n"
+            "                          to <path>@<scale>x. Sprites are drawn at the largest scale and resampled to the\n"
+            "                          others, and every variant shares the same layout, scaled. --padding is in pixels\n"
+            "                          of the smallest variant.\n"
+            "  --filter <name>         lanczos or mitchell, to resample sprites with (default: lanczos).\n"
+            "  --mips                  Stores a gamma-correct mip chain with every page; needs --format atlas.\n"
+            "  --array                 Makes every page the same size and format, to be loaded as the layers of one\n"
+            "                          texture array, so sprites of every page draw without switching textures;\n"
+            "                          needs --format atlas.\n"
+            "  --pixel-format <name>   rgba8, or bc1, bc3 or bc7 to store pages in a GPU block compressed format,\n"
+            "                          encoded on every thread; needs --format atlas (default: rgba8).\n"
+            "  --mesh <n>              Also writes a mesh of at most n vertices, from 4 to 256, around the opaque pixels\n"
+            "                          of every sprite, to draw instead of a quad so that less transparent area is filled.\n"
+            "  --sdf <spread>          Stores the signed distance field of the alpha of every sprite instead of its\n"
+            "                          colors, in a single channel, reaching <spread> pixels of the smallest variant\n"
+            "                          either side of its edges, and writes GLSL functions to sample it to <path>.glsl.\n"
+            "  --palette <n|auto>      Stores pages as indices into a palette of at most n colors, from 2 to 256,\n"
+            "                          picked by median cut and k-means, or only the pages that have at most 256\n"
+            "                          colors to begin with for auto. Indexed pages of PNG output are palette images.\n"
+            "  --search                Tries every heuristic, order and flip setting, keeping the best packing.\n"
+            "  --no-cache              Rebuilds everything instead of reusing <path>.cache from the previous run.\n"
+            "  --memory <MiB>          Roughly caps the memory held by decoded sprites and pages, decoding every\n"
+            "                          changed sprite twice instead of keeping it (default: no limit).\n"
+            "  --compression <level>   PNG compression level, from 1 (fastest) to 9 (smallest) (default: 3).\n"
+            "  -j, --threads <n>       Worker thread count (default: one per hardware thread).\n"
+            "  --help                  Shows this message.\n",
+            program
+        );
+    }
+
+    constexpr std::pair<const char *, bin_algorithm> algorithm_names[] = {
+        {"max-rects", bin_algorithm::max_rects},
+        {"skyline", bin_algorithm::skyline},
+        {"guillotine", bin_algorithm::guillotine}
+    };
+
+    /** @brief The heuristic names of every bin packing algorithm. */
+    template<typename T_bin>
+    struct heuristic_names;
+
+    template<>
+    struct heuristic_names<max_rects_bin_pack> {
+        using heuristic = max_rects_bin_pack::heuristic;
+        static constexpr std::pair<const char *, heuristic> names[] = {
+            {"short-side", heuristic::best_short_side_fit},
+            {"long-side", heuristic::best_long_side_fit},
+            {"area", heuristic::best_area_fit},
+            {"bottom-left", heuristic::bottom_left_rule},
+            {"contact-point", heuristic::contact_point_rule}
+        };
+    };
+
+    template<>
+    struct heuristic_names<skyline_bin_pack> {
+        using heuristic = skyline_bin_pack::heuristic;
+        static constexpr std::pair<const char *, heuristic> names[] = {
+            {"bottom-left", heuristic::bottom_left_rule},
+            {"min-waste", heuristic::min_waste_fit}
+        };
+    };
+
+    template<>
+    struct heuristic_names<guillotine_bin_pack> {
+        using heuristic = guillotine_bin_pack::heuristic;
+        static constexpr std::pair<const char *, heuristic> names[] = {
+            {"short-side", heuristic::best_short_side_fit},
+            {"long-side", heuristic::best_long_side_fit},
+            {"area", heuristic::best_area_fit}
+        };
+    };
 
-            if(new_node.height == 0) return new_node;
+    constexpr std::pair<const char *, output_format> format_names[] = {
+        {"png", output_format::png},
+        {"atlas", output_format::atlas}
+    };
+
+    constexpr std::pair<const char *, uint32_t> pixel_format_names[] = {
+        {"rgba8", atlas_format_rgba8},
+        {"bc1", atlas_format_bc1},
+        {"bc3", atlas_format_bc3},
+        {"bc7", atlas_format_bc7}
+    };
+
+    constexpr std::pair<const char *, resample_filter> filter_names[] = {
+        {"lanczos", resample_filter::lanczos3},
+        {"mitchell", resample_filter::mitchell}
+    };
+
+    constexpr std::pair<const char *, sort_order> order_names[] = {
+        {"global", sort_order::global_best},
+        {"area", sort_order::area},
+        {"max-side", sort_order::max_side},
+        {"perimeter", sort_order::perimeter}
+    };
+
+    /** @return The `atlas_format_*` constant pages are stored as, unless they are only indexed where possible. */
+    uint32_t page_format(const options &opts) {
+        if(opts.palette > 0) return atlas_format_indexed8;
+        return opts.sdf ? atlas_format_r8 : opts.pixel_format;
+    }
 
-            place(new_node);
-            return new_node;
+    /** @return Whether a page may be stored as the given `atlas_format_*` constant. */
+    bool allowed_format(const options &opts, uint32_t format) {
+        return format == page_format(opts) || (opts.palette == palette_auto && format == atlas_format_indexed8);
+    }
+
+    /** @brief Looks a value up by name in one of the tables above, throwing if there is none. */
+    template<typename T, size_t T_count>
+    T parse_name(const std::pair<const char *, T> (&names)[T_count], const std::string &name, const char *what) {
+        for(const auto &[key, value] : names) if(name == key) return value;
+        throw std::runtime_error(std::string("Unknown ").append(what).append(" '").append(name).append("'."));
+    }
+
+    /** @brief Looks a name up by value in one of the tables above. */
+    template<typename T, size_t T_count>
+    const char *name_of(const std::pair<const char *, T> (&names)[T_count], T value) {
+        for(const auto &[key, known] : names) if(known == value) return key;
+        return "?";
+    }
+
+    /** @brief Stands in for a type, to hand it to a generic lambda. */
+    template<typename T>
+    struct type_tag {
+        using type = T;
+    };
+
+    /**
+     * @brief Calls `func(type_tag<T_bin>())` with the bin packing class of the given algorithm, so that everything it
+     * goes on to do is compiled for that class.
+     */
+    template<typename T_func>
+    decltype(auto) with_algorithm(bin_algorithm algorithm, T_func &&func) {
+        switch(algorithm) {
+            case bin_algorithm::skyline: return func(type_tag<skyline_bin_pack>());
+            case bin_algorithm::guillotine: return func(type_tag<guillotine_bin_pack>());
+            default: return func(type_tag<max_rects_bin_pack>());
         }
+    }
+
+    /** @return The strategy chosen on the command line, throwing if the heuristic isn't one of `T_bin`. */
+    template<typename T_bin>
+    pack_strategy<T_bin> chosen_strategy(const options &opts) {
+        pack_strategy<T_bin> strategy;
+        if(!opts.heuristic.empty()) strategy.method = parse_name(heuristic_names<T_bin>::names, opts.heuristic, "heuristic");
+
+        strategy.order = opts.order;
+        strategy.allow_flip = opts.allow_flip;
+        return strategy;
+    }
+
+    /**
+     * @return The variants to write, largest first. Layout units are pixels of the smallest variant, so that every
+     *         factor is a whole number: the scales divided by their greatest common divisor.
+     */
+    std::vector<variant> make_variants(const options &opts) {
+        if(opts.scales.empty()) return {{1, 1, opts.output}};
 
-        /** @return The ratio of used surface area to the total bin area. */
-        double occupancy() const {
-            uint64_t used_area = 0;
-            for(size_t i = 0; i < used_rects.size(); ++i) {
-                const rect &r = used_rects[i];
-                used_area += r.width * r.height;
+        int divisor = 0;
+        for(int scale : opts.scales) divisor = std::gcd(divisor, scale);
+
+        std::vector<variant> variants;
+        for(int scale : opts.scales) variants.push_back({scale, scale / divisor, opts.output + "@" + std::to_string(scale) + "x"});
+        return variants;
+    }
+
+    /** @return `false` if the program should exit, either because of invalid arguments or `--help`. */
+    bool parse_options(int argc, char *argv[], options &opts) {
+        for(int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            auto value = [&]() -> const char * {
+                if(i + 1 >= argc) throw std::runtime_error(std::string("Missing value for '").append(arg).append("'."));
+                return argv[++i];
+            };
+
+            if(arg == "--help") {
+                print_usage(argv[0]);
+                return false;
+            } else if(arg == "-o" || arg == "--output") {
+                opts.output = value();
+            } else if(arg == "--width") {
+                opts.width = std::atoi(value());
+            } else if(arg == "--height") {
+                opts.height = std::atoi(value());
+            } else if(arg == "--format") {
+                opts.format = parse_name(format_names, value(), "format");
+            } else if(arg == "--max-pages") {
+                opts.max_pages = std::max(0, std::atoi(value()));
+            } else if(arg == "--auto-size") {
+                opts.auto_size = true;
+            } else if(arg == "--pow2") {
+                opts.sizes.pow2 = true;
+            } else if(arg == "--square") {
+                opts.sizes.square = true;
+            } else if(arg == "--max-size") {
+                opts.sizes.max_size = std::atoi(value());
+            } else if(arg == "--packer") {
+                opts.algorithm = parse_name(algorithm_names, value(), "packer");
+            } else if(arg == "--heuristic") {
+                opts.heuristic = value();
+            } else if(arg == "--order") {
+                opts.order = parse_name(order_names, value(), "order");
+            } else if(arg == "--no-flip") {
+                opts.allow_flip = false;
+            } else if(arg == "--padding") {
+                opts.padding = std::max(0, std::atoi(value()));
+            } else if(arg == "--scales") {
+                opts.scales.clear();
+                std::istringstream list(value());
+                for(std::string scale; std::getline(list, scale, ',');) opts.scales.push_back(std::atoi(scale.c_str()));
+            } else if(arg == "--filter") {
+                opts.filter = parse_name(filter_names, value(), "filter");
+            } else if(arg == "--mips") {
+                opts.mips = true;
+            } else if(arg == "--array") {
+                opts.array = true;
+            } else if(arg == "--pixel-format") {
+                opts.pixel_format = parse_name(pixel_format_names, value(), "pixel format");
+            } else if(arg == "--mesh") {
+                opts.mesh = static_cast<size_t>(std::max(0, std::atoi(value())));
+            } else if(arg == "--sdf") {
+                opts.sdf = std::max(0, std::atoi(value()));
+            } else if(arg == "--palette") {
+                std::string count = value();
+                opts.palette = count == "auto" ? palette_auto : std::atoi(count.c_str());
+                if(opts.palette != palette_auto && (opts.palette < 2 || opts.palette > 256)) throw std::runtime_error("Palettes must have from 2 to 256 colors, or be auto.");
+            } else if(arg == "--search") {
+                opts.search = true;
+            } else if(arg == "--no-cache") {
+                opts.cache = false;
+            } else if(arg == "--memory") {
+                opts.memory = static_cast<size_t>(std::max(0, std::atoi(value()))) << 20;
+            } else if(arg == "--compression") {
+                opts.compression = std::clamp(std::atoi(value()), 1, 9);
+            } else if(arg == "-j" || arg == "--threads") {
+                opts.threads = std::max(0, std::atoi(value()));
+            } else if(arg.size() > 1 && arg[0] == '-') {
+                throw std::runtime_error(std::string("Unknown option '").append(arg).append("'."));
+            } else {
+                opts.inputs.push_back(arg);
             }
+        }
 
-            return static_cast<double>(used_area) / (static_cast<uint64_t>(bin_width) * bin_height);
+        if(opts.inputs.empty()) {
+            print_usage(argv[0]);
+            return false;
         }
 
-        private:
-        int bin_width;
-        int bin_height;
+        if(std::any_of(opts.scales.begin(), opts.scales.end(), [](int scale) { return scale <= 0; })) throw std::runtime_error("Scales must be positive.");
+        std::sort(opts.scales.begin(), opts.scales.end(), std::greater<int>());
+        opts.scales.erase(std::unique(opts.scales.begin(), opts.scales.end()), opts.scales.end());
 
-        bool allow_flip;
+        int source_factor = make_variants(opts).front().factor;
+        if(opts.width < source_factor || opts.height < source_factor || opts.sizes.max_size < source_factor) {
+            throw std::runtime_error("Atlas dimension must be positive in every variant.");
+        }
 
-        size_t new_free_rects_last_size;
-        std::vector<rect> new_free_rects;
-        std::vector<rect> used_rects;
-        std::vector<rect> free_rects;
+        if(opts.mips && opts.format != output_format::atlas) throw std::runtime_error("PNG pages can't hold mip levels; use --mips with --format atlas.");
+        if(opts.pixel_format != atlas_format_rgba8 && opts.format != output_format::atlas) throw std::runtime_error("PNG pages can't hold compressed blocks; use --pixel-format with --format atlas.");
+        if(opts.sdf && opts.pixel_format != atlas_format_rgba8) throw std::runtime_error("Distance fields are single channel pixels; don't use --pixel-format with --sdf.");
+        if(opts.array && opts.format != output_format::atlas) throw std::runtime_error("PNG pages can't be texture array layers; use --array with --format atlas.");
+        if(opts.array && opts.palette == palette_auto) throw std::runtime_error("Texture array layers share a format, but --palette auto may only index some pages; use --palette <n> with --array.");
+        if(opts.palette && (opts.sdf || opts.pixel_format != atlas_format_rgba8)) throw std::runtime_error("Only 8-bit RGBA pages can be indexed; don't use --pixel-format or --sdf with --palette.");
+        if(opts.mesh && (opts.mesh < 4 || opts.mesh > 256)) throw std::runtime_error("Meshes must have from 4 to 256 vertices.");
 
-        /**
-         * @brief Computes the placement score for placing the given rectangle with the given method.
-         * 
-         * @param width The rectangle width.
-         * @param height The rectangle height.
-         * @param method The packing method. See `heuristic` documentation for details.
-         * @param score1 [out] The primary placement score will be outputted here.
-         * @param score2 [out] The secondary placement score will be outputted here. This is used to break ties.
-         * @return The struct that identifies where the rectangle would be placed if it were placed.
-         */
-        rect score(int width, int height, heuristic method, int &score1, int &score2) const {
-            rect new_node;
-            score1 = std::numeric_limits<int>::max();
-            score2 = std::numeric_limits<int>::max();
-            switch(method) {
-                case heuristic::best_short_side_fit: new_node = find_pos_short_side(width, height, score1, score2); break;
-                case heuristic::bottom_left_rule: new_node = find_pos_bottom_left(width, height, score1, score2); break;
-                case heuristic::contact_point_rule: {
-                    new_node = find_pos_contact_point(width, height, score1);
-                    score1 = -score1; // Reverse since we are minimizing, but for contact point score bigger is better.
-
-                } break;
-
-                case heuristic::best_long_side_fit: new_node = find_pos_long_side(width, height, score2, score1); break;
-                case heuristic::best_area_fit: new_node = find_pos_best_area(width, height, score1, score2); break;
-            }
+        with_algorithm(opts.algorithm, [&](auto tag) { chosen_strategy<typename decltype(tag)::type>(opts); });
+        return true;
+    }
+
+    bool is_image(const fs::path &path) {
+        static constexpr const char *extensions[] = {
+            ".png", ".jpg", ".jpeg", ".bmp", ".tga", ".gif", ".psd", ".hdr", ".pic", ".pnm", ".ppm", ".pgm"
+        };
+
+        std::string ext = path.extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+
+        for(const char *known : extensions) if(ext == known) return true;
+        return false;
+    }
+
+    /** @return Every image in the given directories, sorted by name so the output doesn't depend on the file system. */
+    std::vector<sprite> scan(const std::vector<std::string> &inputs) {
+        std::vector<sprite> sprites;
+        for(const std::string &input : inputs) {
+            if(!fs::is_directory(input)) throw std::runtime_error(std::string("Not a directory: '").append(input).append("'."));
 
-            // Cannot fit the current rectangle.
-            if(new_node.height == 0) {
-                score1 = std::numeric_limits<int>::max();
-                score2 = std::numeric_limits<int>::max();
+            for(const fs::directory_entry &entry : fs::recursive_directory_iterator(input)) {
+                if(!entry.is_regular_file() || !is_image(entry.path())) continue;
+
+                sprite s;
+                s.name = fs::relative(entry.path(), input).replace_extension().generic_string();
+                s.path = entry.path().string();
+                sprites.push_back(std::move(s));
             }
+        }
 
-            return new_node;
+        std::sort(sprites.begin(), sprites.end(), [](const sprite &a, const sprite &b) { return a.name < b.name; });
+        for(size_t i = 1; i < sprites.size(); ++i) {
+            if(sprites[i].name == sprites[i - 1].name) {
+                throw std::runtime_error(std::string("Duplicate sprite name '").append(sprites[i].name).append("'."));
+            }
         }
 
-        void place(const rect &node) {
-            for(size_t i = 0; i < free_rects.size();) {
-                if(split_free_node(free_rects[i], node)) {
-                    free_rects[i] = free_rects.back();
-                    free_rects.pop_back();
-                } else {
-                    ++i;
-                }
+        return sprites;
+    }
+
+    /** @return How many mip levels a page of the given size has, down to 1x1 if `mips` is set. */
+    uint32_t level_count(int width, int height, bool mips) {
+        uint32_t levels = 1;
+        if(mips) while(std::max(width, height) >> levels) ++levels;
+        return levels;
+    }
+
+    /** @return A rectangle grown outwards to multiples of a factor. */
+    rect align(const rect &r, int factor) {
+        int x = r.x / factor * factor, y = r.y / factor * factor;
+        return {x, y, (r.x + r.width + factor - 1) / factor * factor - x, (r.y + r.height + factor - 1) / factor * factor - y};
+    }
+
+    /** @return A rectangle in layout units, in pixels of a variant with the given factor. */
+    rect scaled(const rect &r, int factor) {
+        return {r.x * factor, r.y * factor, r.width * factor, r.height * factor};
+    }
+
+    /** @return Roughly how much memory decoding a sprite and cropping it to its bounds takes. */
+    size_t decode_cost(const pack_cache::file_entry &file) {
+        return (static_cast<size_t>(file.width) * file.height + static_cast<size_t>(file.bounds.width) * file.bounds.height) * 4;
+    }
+
+    /** @return The pixels of a sprite within its bounds. */
+    image load_pixels(const sprite &s) {
+        return image::load(s.path).crop(s.file.bounds);
+    }
+
+    /** @return The pixels of a sprite within its aligned bounds, taking them out of `sprite::pixels`. */
+    image take_aligned_pixels(sprite &s) {
+        image pixels = std::move(s.pixels);
+        s.pixels = image();
+        if(s.aligned.width == s.file.bounds.width && s.aligned.height == s.file.bounds.height) return pixels;
+
+        // Aligned bounds may reach past the image, which is as transparent as the trimmed borders.
+        image aligned(s.aligned.width, s.aligned.height);
+        aligned.blit(pixels, s.file.bounds.x - s.aligned.x, s.file.bounds.y - s.aligned.y);
+        return aligned;
+    }
+
+    /**
+     * @return Where a sprite is in a variant, where its unrotated region is in the original sprite, and its mesh if it
+     *         has one, all at the scale of that variant.
+     */
+    atlas_entry entry_of(const sprite &s, const std::vector<variant> &variants, size_t index, const pack_cache::page_entry &page) {
+        int factor = variants[index].factor, source_factor = variants.front().factor;
+        const rect &a = s.aligned;
+        rect bounds = {a.x / source_factor * factor, a.y / source_factor * factor, a.width / source_factor * factor, a.height / source_factor * factor};
+
+        // Aligned bounds may reach past the original sprite. The largest variant keeps its exact size, and the
+        // transparent part of its region past the edges is left out; smaller variants are only whole layout units.
+        int width = (s.file.width + source_factor - 1) / source_factor * factor, height = (s.file.height + source_factor - 1) / source_factor * factor;
+        rect region = scaled(s.region, factor);
+        if(factor == source_factor) {
+            width = s.file.width;
+            height = s.file.height;
+
+            // The unrotated right edge is the bottom of a flipped region, and the unrotated bottom is its left.
+            int right = std::max(0, bounds.x + bounds.width - width), bottom = std::max(0, bounds.y + bounds.height - height);
+            bounds.width -= right;
+            bounds.height -= bottom;
+            if(s.flipped) {
+                region.x += bottom;
+                region.width -= bottom;
+                region.height -= right;
+            } else {
+                region.width -= right;
+                region.height -= bottom;
             }
+        }
+
+        atlas_entry entry = {s.name, s.page, region, s.flipped, bounds, width, height, {}, {}};
+
+        if(s.file.outlines.empty()) return entry;
+
+        // Outlines rotate along with the region.
+        float page_width = static_cast<float>(page.width * factor), page_height = static_cast<float>(page.height * factor);
+        for(const outline_point &point : s.file.outlines[index]) {
+            float x = point.x, y = point.y;
+            float page_x = s.flipped ? entry.region.x + bounds.height - y : entry.region.x + x;
+            float page_y = s.flipped ? entry.region.y + x : entry.region.y + y;
 
-            prune_free_list();
-            used_rects.push_back(node);
+            entry.vertices.insert(entry.vertices.end(), {bounds.x + x, bounds.y + y, page_x / page_width, page_y / page_height});
         }
 
-        int contact_point_score_node(int x, int y, int width, int height) const {
-            int score = 0;
+        entry.indices = s.triangles[index];
+        return entry;
+    }
+
+    /** @return The hash of everything the region table of a binary atlas holds. */
+    uint64_t atlas_key(const std::vector<atlas_entry> &entries) {
+        hasher h(pack_cache::version);
+        for(const atlas_entry &entry : entries) {
+            h.update(entry.name).update(entry.page).update(entry.region.x).update(entry.region.y).update(entry.region.width).update(entry.region.height).update(entry.flipped);
+            h.update(entry.bounds.x).update(entry.bounds.y).update(entry.bounds.width).update(entry.bounds.height).update(entry.source_width).update(entry.source_height);
+            h.update(entry.vertices.size()).update(entry.vertices.data(), entry.vertices.size() * sizeof(float));
+            h.update(entry.indices.size()).update(entry.indices.data(), entry.indices.size() * sizeof(uint16_t));
+        }
 
-            if(x == 0 || x + width == bin_width) score += height;
-            if(y == 0 || y + height == bin_height) score += width;
+        return h.digest();
+    }
+
+    /** @return The hash of every option that affects the bounds and outlines of the sprites, `0` for the defaults. */
+    uint64_t trace_key(const options &opts) {
+        if(!opts.mesh && !opts.sdf) return 0;
+
+        hasher h(pack_cache::version);
+        h.update(static_cast<uint64_t>(opts.mesh)).update(opts.filter).update(opts.sdf);
+        for(int scale : opts.scales) h.update(scale);
+        return h.digest();
+    }
 
-            for(size_t i = 0; i < used_rects.size(); ++i) {
-                const rect &r = used_rects[i];
-                if(r.x == x + width || r.x + r.width == x) score += common_length(r.y, r.y + r.height, y, y + height);
-                if(r.y == y + height || r.y + r.height == y) score += common_length(r.x, r.x + r.width, x, x + width);
+    /**
+     * @return The outline of a sprite in every variant, relative to its bounds aligned for that variant. Smaller
+     *         variants are traced around every pixel their resampling filter reaches, not just the scaled opaque ones.
+     */
+    std::vector<std::vector<outline_point>> trace_outlines(const image &pixels, const rect &bounds, const options &opts, const std::vector<variant> &variants) {
+        int source_factor = variants.front().factor;
+        rect aligned = align(bounds, source_factor);
+        opaque_rows rows = opaque_rows::scan(pixels, bounds.x - aligned.x, bounds.y - aligned.y, aligned.width, aligned.height);
+
+        std::vector<std::vector<outline_point>> outlines;
+        for(const variant &v : variants) {
+            if(v.factor == source_factor) {
+                outlines.push_back(trace_outline(rows, opts.mesh));
+            } else {
+                int width = aligned.width / source_factor * v.factor, height = aligned.height / source_factor * v.factor;
+                outlines.push_back(trace_outline(rows.resized(width, height, opts.filter), opts.mesh));
             }
+        }
+
+        return outlines;
+    }
 
-            return score;
+    /**
+     * @brief Fills in `sprite::file`, reusing the hashes, dimensions, bounds and outlines of the previous run if the file
+     * size, modification time, mesh and distance field settings didn't change, and decoding the file otherwise. Fully
+     * transparent borders are trimmed off, down to a single pixel for fully transparent images, except for as much as
+     * distance fields reach out of the opaque pixels, within the image. Outlines are traced around that reach too. The
+     * decoded pixels are kept in `sprite::pixels` unless there is a memory limit.
+     */
+    void fingerprint(sprite &s, const pack_cache &previous, memory_budget &budget, bool keep, const options &opts, const std::vector<variant> &variants, thread_pool &pool) {
+        pack_cache::file_entry &file = s.file;
+        file.size = fs::file_size(s.path);
+        file.mtime = static_cast<int64_t>(fs::last_write_time(s.path).time_since_epoch().count());
+
+        auto it = previous.files.find(s.path);
+        if(it != previous.files.end() && it->second.size == file.size && it->second.mtime == file.mtime && it->second.trace_key == trace_key(opts)) {
+            file = it->second;
+            return;
         }
 
-        rect find_pos_bottom_left(int width, int height, int &best_y, int &best_x) const {
-            rect best_node = {};
+        std::ifstream in(s.path, std::ios::binary);
+        std::vector<unsigned char> data(file.size);
+        if(!in.read(reinterpret_cast<char *>(data.data()), data.size())) throw std::runtime_error(std::string("Couldn't read '").append(s.path).append("'."));
 
-            best_y = std::numeric_limits<int>::max();
-            best_x = std::numeric_limits<int>::max();
+        file.hash = hash64(data.data(), data.size());
+        if(!image::info(data.data(), data.size(), file.width, file.height)) throw std::runtime_error(std::string("Couldn't decode '").append(s.path).append("'."));
 
-            for(size_t i = 0; i < free_rects.size(); ++i) {
-                const rect &r = used_rects[i];
+        // Cropping can't take more than the whole image again.
+        file.bounds = {0, 0, file.width, file.height};
+        memory_budget::lease lease(budget, decode_cost(file));
 
-                // Try to place the rectangle in upright (non-flipped) orientation.
-                if(r.width >= width && r.height >= height) {
-                    int top_side_y = r.y + height;
-                    if(top_side_y < best_y || (top_side_y == best_y && r.x < best_x)) {
-                        best_node.x = r.x;
-                        best_node.y = r.y;
-                        best_node.width = width;
-                        best_node.height = height;
-                        best_y = top_side_y;
-                        best_x = r.x;
-                    }
-                }
+        image decoded = image::decode(data.data(), data.size(), s.path);
+        file.bounds = decoded.opaque_bounds();
+        if(!file.bounds.width) file.bounds = {0, 0, 1, 1};
 
-                if(allow_flip && r.width >= height && r.height >= width) {
-                    int top_side_y = r.y + width;
-                    if(top_side_y < best_y || (top_side_y == best_y && r.x < best_x)) {
-                        best_node.x = r.x;
-                        best_node.y = r.y;
-                        best_node.width = height;
-                        best_node.height = width;
-                        best_y = top_side_y;
-                        best_x = r.x;
-                    }
-                }
-            }
+        int reach = opts.sdf * variants.front().factor;
+        if(opts.sdf) {
+            int left = std::max(0, file.bounds.x - reach), top = std::max(0, file.bounds.y - reach);
+            int right = std::min(file.width, file.bounds.x + file.bounds.width + reach), bottom = std::min(file.height, file.bounds.y + file.bounds.height + reach);
+            file.bounds = {left, top, right - left, bottom - top};
+        }
 
-            return best_node;
+        image pixels = decoded.crop(file.bounds);
+        file.pixel_hash = hasher().update(pixels.width).update(pixels.height).update(pixels.pixels.data(), pixels.pixels.size()).digest();
+        file.trace_key = trace_key(opts);
+        if(opts.mesh && opts.sdf) {
+            // The field reaches into the pixels the bounds are aligned with as well.
+            rect aligned = align(file.bounds, variants.front().factor);
+            image canvas(aligned.width, aligned.height);
+            canvas.blit(pixels, file.bounds.x - aligned.x, file.bounds.y - aligned.y);
+            file.outlines = trace_outlines(distance_field(canvas, reach, pool), aligned, opts, variants);
+        } else if(opts.mesh) {
+            file.outlines = trace_outlines(pixels, file.bounds, opts, variants);
         }
 
-        rect find_pos_short_side(int width, int height, int &best_short_fit, int &best_long_fit) const {
-            rect best_node = {};
+        if(keep) s.pixels = std::move(pixels);
+    }
 
-            best_short_fit = std::numeric_limits<int>::max();
-            best_long_fit = std::numeric_limits<int>::max();
+    /**
+     * @return Whether two sprites have the same pixels within their bounds. Without a memory limit, the pixels are
+     * kept for later; with one, they are only decoded for the comparison.
+     */
+    bool same_pixels(sprite &a, sprite &b, memory_budget &budget, bool keep) {
+        if(a.file.pixel_hash != b.file.pixel_hash || a.file.bounds.width != b.file.bounds.width || a.file.bounds.height != b.file.bounds.height) return false;
+
+        if(keep) {
+            if(a.pixels.pixels.empty()) a.pixels = load_pixels(a);
+            if(b.pixels.pixels.empty()) b.pixels = load_pixels(b);
+            return a.pixels.pixels == b.pixels.pixels;
+        }
 
-            for(size_t i = 0; i < free_rects.size(); ++i) {
-                const rect &r = used_rects[i];
+        memory_budget::lease lease(budget, decode_cost(a.file) + decode_cost(b.file));
+        return load_pixels(a).pixels == load_pixels(b).pixels;
+    }
 
-                // Try to place the rectangle in upright (non-flipped) orientation.
-                if(r.width >= width && r.height >= height) {
-                    int leftover_hor = std::abs(r.width - width);
-                    int leftover_ver = std::abs(r.height - height);
-                    int short_fit = std::min(leftover_hor, leftover_ver);
-                    int long_fit = std::max(leftover_hor, leftover_ver);
+    /** @return The hash of every option that affects the placement of the sprites. */
+    uint64_t settings_key(const options &opts) {
+        hasher h(pack_cache::version);
+        h.update(opts.width).update(opts.height);
+        h.update(opts.algorithm).update(opts.heuristic).update(opts.order).update(opts.allow_flip).update(opts.search);
+        h.update(opts.auto_size).update(opts.sizes.pow2).update(opts.sizes.square).update(opts.sizes.max_size);
+        h.update(static_cast<uint64_t>(opts.max_pages)).update(opts.padding).update(opts.array);
+        for(int scale : opts.scales) h.update(scale);
+        return h.digest();
+    }
 
-                    if(short_fit < best_short_fit || (short_fit == best_short_fit && long_fit < best_long_fit)) {
-                        best_node.x = r.x;
-                        best_node.y = r.y;
-                        best_node.width = width;
-                        best_node.height = height;
-                        best_short_fit = short_fit;
-                        best_long_fit = long_fit;
-                    }
-                }
+    /**
+     * @brief Packs the sprites with one bin packing algorithm, placing every canonical sprite and adding the pages to
+     * the cache.
+     *
+     * @param sizes         The padded size of every canonical sprite in layout units, with its index as id.
+     * @param source_factor The factor of the largest variant, which the page sizes of the options are in pixels of.
+     * @return Whether every sprite fit.
+     */
+    template<typename T_bin>
+    bool pack_sprites(const options &opts, int source_factor, const std::vector<rect_size> &sizes, std::vector<sprite> &sprites, pack_cache &next, thread_pool &pool) {
+        std::vector<pack_strategy<T_bin>> strategies = opts.search ? all_strategies<T_bin>(opts.allow_flip) : std::vector<pack_strategy<T_bin>>{chosen_strategy<T_bin>(opts)};
+        log::msg("Trying %zu strategies with %s scoring kernels...", strategies.size(), simd::name());
+
+        size_rules rules = opts.sizes;
+        rules.max_size /= source_factor;
+
+        std::vector<pack_result<T_bin>> pages = pack_pages(sizes, opts.width / source_factor, opts.height / source_factor, opts.auto_size ? &rules : nullptr, strategies, pool, opts.max_pages);
+
+        const pack_result<T_bin> &last = pages.back();
+        if(!last.unplaced.empty()) {
+            log::msg<log_level::error>("%zu of %zu sprites don't fit in %zu page%s of %dx%d, e.g. '%s'.", last.unplaced.size(), sprites.size(), pages.size(), pages.size() == 1 ? "" : "s", pages.front().width, pages.front().height, sprites[last.unplaced.front()].name.c_str());
+            return false;
+        }
 
-                if(allow_flip && r.width >= height && r.height >= width) {
-                    int leftover_hor_f = std::abs(r.width - height);
-                    int leftover_ver_f = std::abs(r.height - width);
-                    int short_fit_f = std::min(leftover_hor_f, leftover_ver_f);
-                    int long_fit_f = std::max(leftover_hor_f, leftover_ver_f);
-
-                    if(short_fit_f < best_short_fit || (short_fit_f == best_short_fit && long_fit_f < best_long_fit)) {
-                        best_node.x = r.x;
-                        best_node.y = r.y;
-                        best_node.width = height;
-                        best_node.height = width;
-                        best_short_fit = short_fit_f;
-                        best_long_fit = long_fit_f;
-                    }
-                }
+        for(size_t i = 0; i < pages.size(); ++i) {
+            const pack_result<T_bin> &packing = pages[i];
+            const pack_strategy<T_bin> &used = packing.strategy;
+            log::msg("Page %zu: %zu sprites in %dx%d (%.2f%% occupancy), %s heuristic, %s order%s.",
+                i, packing.placed.size(), packing.width, packing.height,
+                static_cast<double>(packing.used_area) / (static_cast<uint64_t>(packing.width) * packing.height) * 100.0,
+                name_of(heuristic_names<T_bin>::names, used.method), name_of(order_names, used.order), used.allow_flip ? ", flipping" : ""
+            );
+
+            for(size_t j = 0; j < packing.placed.size(); ++j) {
+                sprite &s = sprites[packing.ids[j]];
+                s.page = i;
+                const rect &placed = packing.placed[j];
+                s.region = {placed.x + opts.padding, placed.y + opts.padding, placed.width - opts.padding * 2, placed.height - opts.padding * 2};
+                s.flipped = s.aligned.width != s.aligned.height && s.region.width != s.aligned.width / source_factor;
+            }
+
+            next.pages.push_back({packing.width, packing.height, 0, {}});
+        }
+
+        // Texture array layers all have the size of the largest page, e.g. when the last page was shrunk to fit.
+        if(opts.array) {
+            int width = 0, height = 0;
+            for(const pack_cache::page_entry &page : next.pages) {
+                width = std::max(width, page.width);
+                height = std::max(height, page.height);
             }
 
-            return best_node;
+            for(pack_cache::page_entry &page : next.pages) {
+                page.width = width;
+                page.height = height;
+            }
         }
 
-        rect find_pos_long_side(int width, int height, int &best_short_fit, int &best_long_fit) const {
-            rect best_node = {};
+        return true;
+    }
 
-            best_short_fit = std::numeric_limits<int>::max();
-            best_long_fit = std::numeric_limits<int>::max();
+    /** @return The alpha of every pixel of an image, which distance fields are drawn in. */
+    std::vector<unsigned char> alpha_channel(const image &pixels) {
+        std::vector<unsigned char> alpha(pixels.pixels.size() / 4);
+        for(size_t i = 0; i < alpha.size(); ++i) alpha[i] = pixels.pixels[i * 4 + 3];
+        return alpha;
+    }
 
-            for(size_t i = 0; i < free_rects.size(); ++i) {
-                const rect &r = used_rects[i];
+    /** @return Every color of every level of a page if there are at most 256 of them, or nothing. */
+    std::vector<uint32_t> lossless_palette(const std::vector<image> &levels) {
+        std::vector<uint32_t> palette, merged;
+        for(const image &level : levels) {
+            std::optional<std::vector<uint32_t>> colors = distinct_colors(level, atlas_palette_colors);
+            if(!colors) return {};
+
+            merged.clear();
+            std::set_union(palette.begin(), palette.end(), colors->begin(), colors->end(), std::back_inserter(merged));
+            if(merged.size() > atlas_palette_colors) return {};
+            palette.swap(merged);
+        }
 
-                // Try to place the rectangle in upright (non-flipped) orientation.
-                if(r.width >= width && r.height >= height) {
-                    int leftover_hor = std::abs(r.width - width);
-                    int leftover_ver = std::abs(r.height - height);
-                    int short_fit = std::min(leftover_hor, leftover_ver);
-                    int long_fit = std::max(leftover_hor, leftover_ver);
+        return palette;
+    }
 
-                    if(long_fit < best_long_fit || (long_fit == best_long_fit && short_fit < best_short_fit)) {
-                        best_node.x = r.x;
-                        best_node.y = r.y;
-                        best_node.width = width;
-                        best_node.height = height;
-                        best_short_fit = short_fit;
-                        best_long_fit = long_fit;
-                    }
-                }
+    /**
+     * @brief Writes the region manifest of a variant. Every line is either `page <index> <width> <height> <file>` or
+     * `sprite <page> <x> <y> <width> <height> <flipped> <offset x> <offset y> <source width> <source height> <name>`,
+     * where the offset is where the unrotated region was in the original sprite before its transparent borders were
+     * trimmed off. Names run until the end of the line. With meshes, every sprite line is followed by a
+     * `mesh <vertex count> <index count> <vertices>... <indices>...` line, laid out as `atlas_region` describes.
+     *
+     * @param index   The index of the variant.
+     * @param entries The sprites, as placed in the variant.
+     */
+    void write_manifest(const std::string &path, const std::vector<pack_cache::page_entry> &pages, const variant &target, size_t index, const std::vector<atlas_entry> &entries) {
+        std::ofstream out(path);
+        if(!out) throw std::runtime_error(std::string("Couldn't write '").append(path).append("'."));
+        out.precision(std::numeric_limits<float>::max_digits10);
+
+        for(size_t i = 0; i < pages.size(); ++i) {
+            out << "page " << i << ' ' << pages[i].width * target.factor << ' ' << pages[i].height * target.factor << ' ' << pages[i].files[index] << '\n';
+        }
 
-                if(allow_flip && r.width >= height && r.height >= width) {
-                    int leftover_hor_f = std::abs(r.width - height);
-                    int leftover_ver_f = std::abs(r.height - width);
-                    int short_fit_f = std::min(leftover_hor_f, leftover_ver_f);
-                    int long_fit_f = std::max(leftover_hor_f, leftover_ver_f);
-
-                    if(long_fit_f < best_long_fit || (long_fit_f == best_long_fit && short_fit_f < best_short_fit)) {
-                        best_node.x = r.x;
-                        best_node.y = r.y;
-                        best_node.width = height;
-                        best_node.height = width;
-                        best_short_fit = short_fit_f;
-                        best_long_fit = long_fit_f;
-                    }
-                }
-            }
+        for(const atlas_entry &e : entries) {
+            out << "sprite " << e.page << ' '
+                << e.region.x << ' ' << e.region.y << ' ' << e.region.width << ' ' << e.region.height << ' '
+                << e.flipped << ' ' << e.bounds.x << ' ' << e.bounds.y << ' ' << e.source_width << ' ' << e.source_height << ' '
+                << e.name << '\n';
+
+            if(e.vertices.empty()) continue;
 
-            return best_node;
+            out << "mesh " << e.vertices.size() / atlas_vertex_floats << ' ' << e.indices.size();
+            for(float component : e.vertices) out << ' ' << component;
+            for(uint16_t index : e.indices) out << ' ' << index;
+            out << '\n';
         }
+    }
 
-        rect find_pos_best_area(int width, int height, int &best_area_fit, int &best_short_fit) const {
-            rect best_node = {};
+    /**
+     * @brief Writes GLSL functions that sample the distance field pages of a variant, to put in the fragment shader
+     * source given to `shader`. They need GLSL 1.30 or later.
+     *
+     * @param spread How far the fields reach on either side of the edges, in pixels of the variant.
+     * @param array  Whether the pages are the layers of a texture array, sampled with the layer as third coordinate.
+     */
+    void write_sdf_functions(const std::string &path, int spread, bool array) {
+        std::ofstream out(path);
+        if(!out) throw std::runtime_error(std::string("Couldn't write '").append(path).append("'."));
+
+        const char *sampler = array ? "sampler2DArray pages, vec3 uv" : "sampler2D page, vec2 uv", *pages = array ? "pages" : "page";
+        out <<
+            "// Pages hold 0.5 on the edges of sprites, rising to 1 at av_sdf_spread texels inside and falling to 0 at\n"
+            "// av_sdf_spread texels outside.\n"
+            "const float av_sdf_spread = " << spread << ".0;\n"
+            "\n"
+            "// Returns the distance to the nearest edge at some texture coordinates, in texels, positive inside.\n"
+            << (array ? "// The third coordinate is the layer of the page.\n" : "") <<
+            "float av_sdf_distance(" << sampler << ") {\n"
+            "    return (texture(" << pages << ", uv).r - 0.5) * 2.0 * av_sdf_spread;\n"
+            "}\n"
+            "\n"
+            "// Returns how much of the screen pixel at some texture coordinates a sprite covers, with its edges moved\n"
+            "// outwards by offset texels, e.g. to draw an outline. Edges are smoothed over one screen pixel at any scale.\n"
+            "float av_sdf_coverage(" << sampler << ", float offset) {\n"
+            "    float texels = length(fwidth(uv.xy * vec2(textureSize(" << pages << ", 0).xy))) * 0.70710678;\n"
+            "    return clamp((av_sdf_distance(" << pages << ", uv) + offset) / max(texels, 1e-4) + 0.5, 0.0, 1.0);\n"
+            "}\n";
+    }
+}
 
-            best_area_fit = std::numeric_limits<int>::max();
-            best_short_fit = std::numeric_limits<int>::max();
+int main(int argc, char *argv[]) {
+    try {
+        options opts;
+        if(!parse_options(argc, argv, opts)) return 1;
+
+        std::vector<sprite> sprites = scan(opts.inputs);
+        if(sprites.empty()) {
+            log::msg<log_level::error>("No images found.");
+            return 1;
+        }
 
-            for(size_t i = 0; i < free_rects.size(); ++i) {
-                const rect &r = used_rects[i];
-                int area_fit = r.width * r.height - width * height;
+        thread_pool pool(opts.threads);
+        std::string cache_path = opts.output + ".cache";
+        pack_cache previous = opts.cache ? pack_cache::load(cache_path) : pack_cache();
 
-                // Try to place the rectangle in upright (non-flipped) orientation.
-                if(r.width >= width && r.height >= height) {
-                    int leftover_hor = std::abs(r.width - width);
-                    int leftover_ver = std::abs(r.height - height);
-                    int short_fit = std::min(leftover_hor, leftover_ver);
+        memory_budget budget(opts.memory);
+        bool keep = !opts.memory;
 
-                    if(area_fit < best_area_fit || (area_fit == best_area_fit && short_fit < best_short_fit)) {
-                        best_node.x = r.x;
-                        best_node.y = r.y;
-                        best_node.width = width;
-                        best_node.height = height;
-                        best_short_fit = short_fit;
-                        best_area_fit = area_fit;
-                    }
-                }
+        std::vector<variant> variants = make_variants(opts);
+
+        log::msg("Hashing %zu images on %zu threads...", sprites.size(), pool.size());
+        pool.for_each(sprites.size(), [&](size_t i) {
+            fingerprint(sprites[i], previous, budget, keep, opts, variants, pool);
+            for(const std::vector<outline_point> &outline : sprites[i].file.outlines) sprites[i].triangles.push_back(triangulate(outline));
+        });
+
+        int source_factor = variants.front().factor;
+        for(sprite &s : sprites) s.aligned = align(s.file.bounds, source_factor);
+
+        // Sprites with the same pixel hash are confirmed to be identical byte by byte before being packed only once.
+        // Each group of such sprites aliases every member to the first one it's identical to, as long as their bounds
+        // are aligned the same way too, so that they scale to the same pixels.
+        std::unordered_map<uint64_t, std::vector<size_t>> by_hash;
+        for(size_t i = 0; i < sprites.size(); ++i) {
+            sprites[i].alias = i;
+            by_hash[sprites[i].file.pixel_hash].push_back(i);
+        }
 
-                if(allow_flip && r.width >= height && r.height >= width) {
-                    int leftover_hor_f = std::abs(r.width - height);
-                    int leftover_ver_f = std::abs(r.height - width);
-                    int short_fit_f = std::min(leftover_hor_f, leftover_ver_f);
-
-                    if(area_fit < best_area_fit || (area_fit == best_area_fit && short_fit_f < best_short_fit)) {
-                        best_node.x = r.x;
-                        best_node.y = r.y;
-                        best_node.width = height;
-                        best_node.height = width;
-                        best_short_fit = short_fit_f;
-                        best_area_fit = area_fit;
+        std::vector<const std::vector<size_t> *> groups;
+        for(const auto &[hash, members] : by_hash) if(members.size() > 1) groups.push_back(&members);
+
+        pool.for_each(groups.size(), [&](size_t g) {
+            std::vector<size_t> originals;
+            for(size_t i : *groups[g]) {
+                for(size_t original : originals) {
+                    const rect &a = sprites[i].file.bounds, &b = sprites[original].file.bounds;
+                    if(a.x % source_factor != b.x % source_factor || a.y % source_factor != b.y % source_factor) continue;
+
+                    if(same_pixels(sprites[i], sprites[original], budget, keep)) {
+                        sprites[i].alias = original;
+                        break;
                     }
                 }
-            }
 
-            return best_node;
+                if(sprites[i].alias == i) originals.push_back(i);
+            }
+        });
+
+        size_t aliased = 0;
+        uint64_t source_area = 0, trimmed_area = 0;
+        for(size_t i = 0; i < sprites.size(); ++i) {
+            const sprite &s = sprites[i];
+            source_area += static_cast<uint64_t>(s.file.width) * s.file.height;
+
+            if(s.alias == i) {
+                trimmed_area += static_cast<uint64_t>(s.file.bounds.width) * s.file.bounds.height;
+            } else {
+                ++aliased;
+            }
         }
 
-        rect find_pos_contact_point(int width, int height, int &best_score) const {
-            rect best_node = {};
+        log::msg("Trimmed and deduplicated %.2f%% of the pixels away; %zu sprites are aliases.", (1.0 - static_cast<double>(trimmed_area) / source_area) * 100.0, aliased);
 
-            best_score = -1;
+        // The placement only depends on the options, and on the sprite names, aligned sizes and aliases.
+        hasher layout(settings_key(opts));
+        std::vector<rect_size> sizes;
+        sizes.reserve(sprites.size() - aliased);
+        for(size_t i = 0; i < sprites.size(); ++i) {
+            const sprite &s = sprites[i];
+            layout.update(s.name).update(s.aligned.width).update(s.aligned.height).update(sprites[s.alias].name);
 
-            for(size_t i = 0; i < free_rects.size(); ++i) {
-                const rect &r = used_rects[i];
+            int width = s.aligned.width / source_factor, height = s.aligned.height / source_factor;
+            if(s.alias == i) sizes.push_back({width + opts.padding * 2, height + opts.padding * 2, static_cast<int>(i)});
+        }
 
-                // Try to place the rectangle in upright (non-flipped) orientation.
-                if(r.width >= width && r.height >= height) {
-                    int score = contact_point_score_node(r.x, r.y, width, height);
-                    if(score > best_score) {
-                        best_node.x = r.x;
-                        best_node.y = r.y;
-                        best_node.width = width;
-                        best_node.height = height;
-                        best_score = score;
-                    }
-                }
+        pack_cache next;
+        next.layout_key = layout.digest();
 
-                if(allow_flip && r.width >= height && r.height >= width) {
-                    int score = contact_point_score_node(r.x, r.y, height, width);
-                    if(score > best_score) {
-                        best_node.x = r.x;
-                        best_node.y = r.y;
-                        best_node.width = height;
-                        best_node.height = width;
-                        best_score = score;
-                    }
-                }
+        bool reuse_layout = opts.cache && next.layout_key == previous.layout_key && !previous.pages.empty() && std::all_of(sprites.begin(), sprites.end(), [&](const sprite &s) {
+            auto it = previous.sprites.find(s.name);
+            return it != previous.sprites.end() && it->second.page < previous.pages.size();
+        });
+
+        if(reuse_layout) {
+            log::msg("Reusing the previous layout.");
+            for(const pack_cache::page_entry &page : previous.pages) next.pages.push_back({page.width, page.height, 0, {}});
+
+            for(sprite &s : sprites) {
+                const pack_cache::sprite_entry &entry = previous.sprites.at(s.name);
+                s.page = entry.page;
+                s.region = entry.region;
+                s.flipped = entry.flipped;
+            }
+        } else {
+            bool packed = with_algorithm(opts.algorithm, [&](auto tag) {
+                return pack_sprites<typename decltype(tag)::type>(opts, source_factor, sizes, sprites, next, pool);
+            });
+
+            if(!packed) return 1;
+
+            for(sprite &s : sprites) {
+                const sprite &original = sprites[s.alias];
+                s.page = original.page;
+                s.region = original.region;
+                s.flipped = original.flipped;
             }
+        }
 
-            return best_node;
+        // A page is unchanged as long as the same sprite contents are in the same places, at the same scales.
+        std::vector<hasher> page_keys;
+        for(const pack_cache::page_entry &page : next.pages) {
+            hasher &key = page_keys.emplace_back(next.layout_key).update(page.width).update(page.height).update(opts.mips).update(opts.filter).update(opts.pixel_format).update(opts.sdf).update(opts.palette);
+            for(const variant &v : variants) key.update(v.scale);
         }
 
-        void insert_new(const rect &new_rect) {
-            assert(new_rect.width > 0);
-            assert(new_rect.height > 0);
+        uint64_t used_area = 0, total_area = 0;
+        for(size_t i = 0; i < sprites.size(); ++i) {
+            const sprite &s = sprites[i];
+            page_keys[s.page].update(s.name).update(s.file.pixel_hash).update(s.region.x).update(s.region.y).update(s.flipped);
+            page_keys[s.page].update(s.file.bounds.x).update(s.file.bounds.y).update(s.file.width).update(s.file.height);
+            if(s.alias == i) used_area += static_cast<uint64_t>(s.region.width) * s.region.height;
 
-            for(size_t i = 0; i < new_free_rects_last_size;) {
-                // Is this new free rectangle already accounted for?
-                if(new_rect.contained_in(new_free_rects[i])) return;
+            next.files[s.path] = s.file;
+            next.sprites[s.name] = {s.page, s.region, s.flipped};
+        }
 
-                // Does this new free rectangle obsolete a previous new free rectangle?
-                if(new_free_rects[i].contained_in(new_rect)) {
-                    // Remove i'th new free rectangle, but do so by retaining the order of the older vs newest free
-                    // rectangles that we may still be placing in calling function split_free_node().
-                    new_free_rects[i] = new_free_rects[--new_free_rects_last_size];
-                    new_free_rects[new_free_rects_last_size] = new_free_rects.back();
-                    new_free_rects.pop_back();
+        // Every variant has its own files, and a page is redrawn in every variant at once.
+        std::vector<std::vector<std::string>> page_paths(variants.size());
+        std::vector<char> dirty(next.pages.size());
+        for(size_t i = 0; i < next.pages.size(); ++i) {
+            pack_cache::page_entry &page = next.pages[i];
+            page.key = page_keys[i].digest();
+            total_area += static_cast<uint64_t>(page.width) * page.height;
+
+            bool missing = false;
+            for(size_t v = 0; v < variants.size(); ++v) {
+                const std::string &output = variants[v].output;
+                if(opts.format == output_format::atlas) {
+                    page_paths[v].push_back(output + ".avatlas");
                 } else {
-                    ++i;
+                    page_paths[v].push_back(next.pages.size() == 1 ? output + ".png" : output + "-" + std::to_string(i) + ".png");
                 }
+
+                page.files.push_back(fs::path(page_paths[v][i]).filename().string());
+                missing = missing || !fs::exists(page_paths[v][i]);
             }
 
-            new_free_rects.push_back(new_rect);
+            dirty[i] = !opts.cache || i >= previous.pages.size() || previous.pages[i].key != page.key || previous.pages[i].files != page.files || missing;
         }
 
-        /** @return True if the free node was split. */
-        bool split_free_node(const rect &free, const rect &used) {
-            // Test with SAT if the rectangles even intersect.
-            if(
-                used.x >= free.x + free.width || used.x + used.width <= free.x ||
-                used.y >= free.y + free.height || used.y + used.height <= free.y
-            ) return false;
+        // A binary atlas is written as a whole, so the pixels of unchanged pages are copied from the previous one.
+        std::vector<std::ifstream> previous_atlases(variants.size());
+        std::vector<std::vector<atlas_page>> previous_pages(variants.size());
+        if(opts.format == output_format::atlas && std::count(dirty.begin(), dirty.end(), 0)) {
+            try {
+                for(size_t v = 0; v < variants.size(); ++v) {
+                    previous_atlases[v].open(page_paths[v][0], std::ios::binary);
+                    previous_pages[v] = atlas_writer::read_pages(previous_atlases[v]);
+
+                    int factor = variants[v].factor;
+                    for(size_t i = 0; i < next.pages.size(); ++i) {
+                        if(dirty[i]) continue;
+
+                        const pack_cache::page_entry &page = next.pages[i];
+                        const std::vector<atlas_page> &known = previous_pages[v];
+                        if(
+                            i >= known.size() || !allowed_format(opts, known[i].format) || known[i].levels != level_count(page.width * factor, page.height * factor, opts.mips) ||
+                            known[i].width != static_cast<uint32_t>(page.width * factor) || known[i].height != static_cast<uint32_t>(page.height * factor)
+                        ) throw std::runtime_error("The previous atlas doesn't match its cache.");
+                    }
+                }
+            } catch(std::exception &e) {
+                log::msg<log_level::warn>("%s Redrawing every page.", e.what());
+                std::fill(dirty.begin(), dirty.end(), 1);
+            }
+        }
 
-            // We add up to four new free rectangles to the free rectangles list below. None of these four newly added
-            // free rectangles can overlap any other three, so keep a mark of them to avoid testing them against each
-            // other.
-            new_free_rects_last_size = new_free_rects.size();
+        std::vector<std::vector<atlas_entry>> entries(variants.size());
+        for(size_t v = 0; v < variants.size(); ++v) {
+            entries[v].reserve(sprites.size());
+            for(const sprite &s : sprites) entries[v].push_back(entry_of(s, variants, v, next.pages[s.page]));
+        }
 
-            if(used.x < free.x + free.width && used.x + used.width > free.x) {
-                // New node at the top side of the used node.
-                if(used.y > free.y && used.y < free.y + free.height) {
-                    rect new_node = free;
-                    new_node.height = used.y - new_node.y;
-                    insert_new(new_node);
+        // Every output goes next to the output path, whose directories may not exist yet.
+        fs::path output_dir = fs::path(opts.output).parent_path();
+        if(!output_dir.empty()) fs::create_directories(output_dir);
+
+        // The region table is written along with the pages, so an atlas is rewritten if either changed, copying every
+        // unchanged page.
+        std::vector<std::optional<atlas_writer>> writers(variants.size());
+        if(opts.format == output_format::atlas) {
+            bool redrawing = std::count(dirty.begin(), dirty.end(), 1);
+            for(size_t v = 0; v < variants.size(); ++v) {
+                next.atlases.push_back(atlas_key(entries[v]));
+                if(!redrawing && opts.cache && v < previous.atlases.size() && previous.atlases[v] == next.atlases[v]) continue;
+
+                if(!redrawing) log::msg("Regions of '%s' changed; copying its pages.", page_paths[v][0].c_str());
+
+                int factor = variants[v].factor;
+                std::vector<atlas_page> records(next.pages.size());
+                for(size_t i = 0; i < next.pages.size(); ++i) {
+                    records[i].width = next.pages[i].width * factor;
+                    records[i].height = next.pages[i].height * factor;
+                    records[i].levels = level_count(records[i].width, records[i].height, opts.mips);
                 }
 
-                // New node at the bottom side of the used node.
-                if(used.y + used.height < free.y + free.height) {
-                    rect new_node = free;
-                    new_node.y = used.y + used.height;
-                    new_node.height = free.y + free.height - (used.y + used.height);
-                    insert_new(new_node);
-                }
+                writers[v].emplace(page_paths[v][0], records, entries[v], opts.array ? atlas_flag_array : 0);
+            }
+        }
+
+        // Only the sprites of changed pages have to be decoded and copied. Pages are drawn in batches that take up to
+        // half of the memory limit, leaving the other half for decoding, or all at once without a limit. Every sprite
+        // owns a disjoint region of its page, padding included, so all of the sprites of a batch can be copied at
+        // once, each sprite being resampled to every variant by the thread that copies it. Then the mip levels and
+        // files of every page of the batch can be made at once, each PNG file being compressed on every thread as well.
+        size_t redrawn_pages = static_cast<size_t>(std::count(dirty.begin(), dirty.end(), 1)), redrawn_sprites = 0, indexed_pages = 0;
+        log::msg("Redrawing %zu of %zu pages...", redrawn_pages, next.pages.size());
+        if(variants.size() > 1) log::msg("Resampling to %zu variants with the %s filter.", variants.size(), name_of(filter_names, opts.filter));
+        if(opts.pixel_format != atlas_format_rgba8) log::msg("Encoding pages to %s blocks.", name_of(pixel_format_names, opts.pixel_format));
+        if(opts.sdf) log::msg("Drawing distance fields reaching %d pixels of the smallest variant.", opts.sdf);
+        if(opts.palette > 0) log::msg("Quantizing pages to %d colors.", opts.palette);
+
+        std::vector<std::vector<size_t>> page_sprites(next.pages.size());
+        for(size_t i = 0; i < sprites.size(); ++i) if(sprites[i].alias == i && dirty[sprites[i].page]) page_sprites[sprites[i].page].push_back(i);
+
+        size_t area_per_unit = 0;
+        for(const variant &v : variants) area_per_unit += static_cast<size_t>(v.factor) * v.factor;
+
+        memory_budget drawing(opts.memory / 2 + (opts.memory & 1));
+        for(size_t first = 0; first < next.pages.size();) {
+            size_t last = first, batch_size = 0;
+            for(; last < next.pages.size(); ++last) {
+                if(!dirty[last]) continue;
+
+                size_t size = static_cast<size_t>(next.pages[last].width) * next.pages[last].height * area_per_unit * 4 * (opts.mips ? 2 : 1);
+                if(opts.memory && batch_size && batch_size + size > opts.memory / 2) break;
+                batch_size += size;
             }
 
-            if(used.y < free.y + free.height && used.y + used.height > free.y) {
-                // New node at the left side of the used node.
-                if(used.x > free.x && used.x < free.x + free.width) {
-                    rect new_node = free;
-                    new_node.width = used.x - new_node.x;
-                    insert_new(new_node);
-                }
+            // The levels of every variant of a page are next to each other.
+            std::vector<std::vector<image>> page_levels((last - first) * variants.size());
+            std::vector<size_t> batch;
+            for(size_t i = first; i < last; ++i) {
+                if(!dirty[i]) continue;
 
-                // New node at the right side of the used node.
-                if(used.x + used.width < free.x + free.width) {
-                    rect new_node = free;
-                    new_node.x = used.x + used.width;
-                    new_node.width = free.x + free.width - (used.x + used.width);
-                    insert_new(new_node);
+                for(size_t v = 0; v < variants.size(); ++v) {
+                    int factor = variants[v].factor;
+                    page_levels[(i - first) * variants.size() + v].emplace_back(next.pages[i].width * factor, next.pages[i].height * factor);
                 }
+
+                batch.insert(batch.end(), page_sprites[i].begin(), page_sprites[i].end());
             }
 
-            return true;
-        }
+            pool.for_each(batch.size(), [&](size_t i) {
+                sprite &s = sprites[batch[i]];
+
+                std::optional<memory_budget::lease> decoding;
+                if(s.pixels.pixels.empty()) {
+                    decoding.emplace(drawing, decode_cost(s.file));
+                    s.pixels = load_pixels(s);
+                }
 
-        /** Goes through the free rectangle list and removes any redundant entries. */
-        void prune_free_list() {
-            // Test all newly introduced free rectangles against old free rectangles.
-            for(size_t i = 0; i < free_rects.size(); ++i) {
-                for(size_t j = 0; j < new_free_rects.size();) {
-                    if(new_free_rects[j].contained_in(free_rects[i])) {
-                        new_free_rects[j] = new_free_rects.back();
-                        new_free_rects.pop_back();
+                image source = take_aligned_pixels(s);
+                if(opts.sdf) source = distance_field(source, opts.sdf * source_factor, pool);
+                for(size_t v = 0; v < variants.size(); ++v) {
+                    int factor = variants[v].factor;
+                    rect region = scaled(s.region, factor);
+
+                    image &page = page_levels[(s.page - first) * variants.size() + v].front();
+                    if(factor == source_factor) {
+                        page.blit(source, region.x, region.y, s.flipped);
                     } else {
-                        // The old free rectangles can never be contained in any of the new free rectangles (the new
-                        // free rectangles keep shrinking in size)
-                        assert(!free_rects[i].contained_in(new_free_rects[j]));
+                        int width = s.aligned.width / source_factor * factor, height = s.aligned.height / source_factor * factor;
+                        page.blit(source.resize(width, height, opts.filter), region.x, region.y, s.flipped);
+                    }
 
-                        ++j;
+                    if(opts.padding) page.extrude(region, opts.padding * factor);
+                }
+            });
+
+            // Levels in other formats than 8-bit RGBA are converted on every thread as well. Indexed pages share one
+            // palette across all of their levels, quantized from the first one.
+            std::vector<std::vector<std::vector<unsigned char>>> page_data(page_levels.size());
+            std::vector<uint32_t> formats(page_levels.size(), page_format(opts));
+            std::vector<std::vector<uint32_t>> palettes(page_levels.size());
+            pool.for_each(page_levels.size(), [&](size_t i) {
+                size_t page = first + i / variants.size(), v = i % variants.size();
+                if(!dirty[page]) return;
+
+                std::vector<image> &levels = page_levels[i];
+                for(uint32_t level = 1, count = level_count(levels.front().width, levels.front().height, opts.mips); level < count; ++level) levels.push_back(levels.back().downsample());
+                if(opts.palette == palette_auto) {
+                    palettes[i] = lossless_palette(levels);
+                } else if(opts.palette) {
+                    palettes[i] = quantize(levels.front(), opts.palette, pool);
+                }
+
+                if(!palettes[i].empty()) {
+                    formats[i] = atlas_format_indexed8;
+                    for(const image &level : levels) page_data[i].push_back(index_pixels(level, palettes[i], pool));
+                    if(opts.format == output_format::png) {
+                        png_writer png(page_paths[v][page], levels.front().width, levels.front().height, pool, opts.compression, 1, palettes[i]);
+                        png.write_rows(page_data[i].front().data(), levels.front().height);
+                        png.finish();
+                    }
+                } else if(opts.format == output_format::png && opts.sdf) {
+                    png_writer png(page_paths[v][page], levels.front().width, levels.front().height, pool, opts.compression, 1);
+                    png.write_rows(alpha_channel(levels.front()).data(), levels.front().height);
+                    png.finish();
+                } else if(opts.format == output_format::png) {
+                    png_writer png(page_paths[v][page], levels.front().width, levels.front().height, pool, opts.compression);
+                    png.write_rows(levels.front().pixels.data(), levels.front().height);
+                    png.finish();
+                } else if(opts.sdf) {
+                    for(const image &level : levels) page_data[i].push_back(alpha_channel(level));
+                } else if(opts.pixel_format != atlas_format_rgba8) {
+                    for(const image &level : levels) page_data[i].push_back(encode_blocks(level, opts.pixel_format, pool));
+                }
+            });
+
+            for(size_t v = 0; v < variants.size(); ++v) {
+                if(!writers[v]) continue;
+
+                for(size_t i = first; i < last; ++i) {
+                    size_t index = (i - first) * variants.size() + v;
+                    if(dirty[i] && formats[index] == atlas_format_rgba8) {
+                        writers[v]->write_page(page_levels[index]);
+                    } else if(dirty[i]) {
+                        const image &page = page_levels[index].front();
+                        std::vector<unsigned char> palette(atlas_view::palette_size(formats[index]));
+                        for(size_t k = 0; k < palettes[index].size() * 4; ++k) palette[k] = static_cast<unsigned char>(palettes[index][k / 4] >> (k % 4 * 8));
+                        writers[v]->write_page(static_cast<uint32_t>(page.width), static_cast<uint32_t>(page.height), formats[index], page_data[index], palette);
+                    } else {
+                        writers[v]->copy_page(previous_atlases[v], previous_pages[v][i]);
                     }
                 }
             }
 
-            // Merge new and old free rectangles to the group of old free rectangles.
-            free_rects.insert(free_rects.end(), new_free_rects.begin(), new_free_rects.end());
-            new_free_rects.clear();
+            indexed_pages += static_cast<size_t>(std::count(formats.begin(), formats.end(), atlas_format_indexed8));
+            redrawn_sprites += batch.size();
+            first = last;
         }
-    };
-}
 
-int main(int argc, char *argv[]) {
+        for(size_t v = 0; v < variants.size(); ++v) {
+            if(!writers[v]) continue;
+
+            previous_atlases[v].close();
+            writers[v]->finish();
+        }
+
+        if(redrawn_pages) log::msg("Redrew %zu sprites.", redrawn_sprites);
+        if(opts.palette == palette_auto) log::msg("%zu of %zu redrawn pages had at most %u colors and were indexed.", indexed_pages, redrawn_pages * variants.size(), atlas_palette_colors);
+
+        // Remove pages of the previous run that aren't part of this one anymore.
+        for(const pack_cache::page_entry &page : previous.pages) {
+            for(const std::string &file : page.files) {
+                bool kept = std::any_of(next.pages.begin(), next.pages.end(), [&](const pack_cache::page_entry &p) {
+                    return std::find(p.files.begin(), p.files.end(), file) != p.files.end();
+                });
+
+                if(!kept) fs::remove(output_dir / file);
+            }
+        }
+
+        for(size_t v = 0; v < variants.size(); ++v) {
+            write_manifest(variants[v].output + ".manifest", next.pages, variants[v], v, entries[v]);
+            if(opts.sdf) write_sdf_functions(variants[v].output + ".glsl", opts.sdf * variants[v].factor, opts.array);
+        }
+        if(opts.cache) next.save(cache_path);
+
+        log::msg("Packed %zu sprites into %zu page%s (%.2f%% occupancy).", sprites.size(), next.pages.size(), next.pages.size() == 1 ? "" : "s", static_cast<double>(used_area) / total_area * 100.0);
+    } catch(std::exception &e) {
+        log::msg<log_level::error>("%s", e.what());
+        return 1;
+    }
 
+    return 0;
 }
@@ -0,0 +1,274 @@
+#include <packer/palette.hpp>
+#include <packer/simd.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <unordered_set>
+
+namespace av {
+    namespace {
+        /** @brief How many colors a k-means task assigns at once. */
+        constexpr size_t chunk_colors = 4096;
+        /** @brief The most k-means iterations; means hardly move after a few. */
+        constexpr int max_iterations = 8;
+        /** @brief A channel value of padding palette entries, too far from any color to be picked. */
+        constexpr int32_t unreachable = 1024;
+
+        inline int32_t channel(uint32_t color, int c) {
+            return static_cast<int32_t>(color >> (c * 8) & 0xFF);
+        }
+
+        /** @brief A distinct color, and how many pixels have it. */
+        struct weighted_color {
+            uint32_t color;
+            uint32_t weight;
+        };
+
+        /** @brief A box of median cut, as a range of colors, and its widest channel. */
+        struct color_box {
+            size_t first, last;
+            int widest, range;
+        };
+
+        color_box make_box(const std::vector<weighted_color> &colors, size_t first, size_t last) {
+            int32_t low[4] = {255, 255, 255, 255}, high[4] = {};
+            for(size_t i = first; i < last; ++i) {
+                for(int c = 0; c < 4; ++c) {
+                    low[c] = std::min(low[c], channel(colors[i].color, c));
+                    high[c] = std::max(high[c], channel(colors[i].color, c));
+                }
+            }
+
+            color_box box = {first, last, 0, high[0] - low[0]};
+            for(int c = 1; c < 4; ++c) {
+                if(high[c] - low[c] > box.range) {
+                    box.widest = c;
+                    box.range = high[c] - low[c];
+                }
+            }
+
+            return box;
+        }
+
+        /** @brief Splits the widest boxes at their weighted median until there are `count` of them or none can be split. */
+        std::vector<color_box> median_cut(std::vector<weighted_color> &colors, int count) {
+            std::vector<color_box> boxes = {make_box(colors, 0, colors.size())};
+            while(boxes.size() < static_cast<size_t>(count)) {
+                auto widest = std::max_element(boxes.begin(), boxes.end(), [](const color_box &a, const color_box &b) { return a.range < b.range; });
+                if(!widest->range) break;
+
+                color_box box = *widest;
+                std::sort(colors.begin() + box.first, colors.begin() + box.last, [&](const weighted_color &a, const weighted_color &b) {
+                    return channel(a.color, box.widest) < channel(b.color, box.widest);
+                });
+
+                uint64_t total = 0, below = 0;
+                for(size_t i = box.first; i < box.last; ++i) total += colors[i].weight;
+
+                // Both halves keep at least one color.
+                size_t split = box.first + 1;
+                for(size_t i = box.first; i + 2 < box.last && (below += colors[i].weight) * 2 < total; ++i) split = i + 2;
+
+                *widest = make_box(colors, box.first, split);
+                boxes.push_back(make_box(colors, split, box.last));
+            }
+
+            return boxes;
+        }
+    }
+
+    std::optional<std::vector<uint32_t>> distinct_colors(const image &pixels, size_t limit) {
+        std::unordered_set<uint32_t> colors;
+        colors.reserve(limit * 2);
+
+        uint32_t last = 0;
+        for(size_t i = 0; i < pixels.pixels.size(); i += 4) {
+            uint32_t color = pack_color(&pixels.pixels[i]);
+            if(i && color == last) continue;
+
+            last = color;
+            if(colors.insert(color).second && colors.size() > limit) return std::nullopt;
+        }
+
+        std::vector<uint32_t> sorted(colors.begin(), colors.end());
+        std::sort(sorted.begin(), sorted.end());
+        return sorted;
+    }
+
+    std::vector<uint32_t> quantize(const image &pixels, int count, thread_pool &pool) {
+        std::vector<uint32_t> all(pixels.pixels.size() / 4);
+        for(size_t i = 0; i < all.size(); ++i) all[i] = pack_color(&pixels.pixels[i * 4]);
+        std::sort(all.begin(), all.end());
+
+        std::vector<weighted_color> colors;
+        for(size_t i = 0; i < all.size();) {
+            size_t j = i;
+            while(j < all.size() && all[j] == all[i]) ++j;
+
+            colors.push_back({all[i], static_cast<uint32_t>(j - i)});
+            i = j;
+        }
+
+        if(colors.size() <= static_cast<size_t>(count)) {
+            std::vector<uint32_t> palette;
+            for(const weighted_color &c : colors) palette.push_back(c.color);
+            return palette;
+        }
+
+        // Colors are sorted, so transparent black comes first if there is any.
+        bool transparent = !colors.front().color;
+        if(transparent) colors.erase(colors.begin());
+
+        int means_count = count - (transparent ? 1 : 0);
+        std::vector<color_box> boxes = median_cut(colors, means_count);
+
+        std::vector<int32_t> means[4];
+        for(const color_box &box : boxes) {
+            double sums[4] = {}, total = 0.0;
+            for(size_t i = box.first; i < box.last; ++i) {
+                for(int c = 0; c < 4; ++c) sums[c] += static_cast<double>(channel(colors[i].color, c)) * colors[i].weight;
+                total += colors[i].weight;
+            }
+
+            for(int c = 0; c < 4; ++c) means[c].push_back(static_cast<int32_t>(std::lround(sums[c] / total)));
+        }
+
+        // Channels apart, padded to whole vectors with colors that weigh nothing.
+        size_t lanes = simd::vint::lanes, padded = (colors.size() + lanes - 1) / lanes * lanes;
+        std::vector<int32_t> channels[4];
+        std::vector<uint32_t> weights(padded);
+        for(int c = 0; c < 4; ++c) channels[c].resize(padded);
+        for(size_t i = 0; i < colors.size(); ++i) {
+            for(int c = 0; c < 4; ++c) channels[c][i] = channel(colors[i].color, c);
+            weights[i] = colors[i].weight;
+        }
+
+        // Every chunk sums its colors by mean on its own, and the sums are added up in order so that the result
+        // doesn't depend on the threads.
+        size_t chunks = (padded + chunk_colors - 1) / chunk_colors, mean_count = boxes.size();
+        std::vector<double> sums(chunks * mean_count * 5);
+        for(int iteration = 0; iteration < max_iterations; ++iteration) {
+            std::fill(sums.begin(), sums.end(), 0.0);
+            pool.for_each(chunks, [&](size_t chunk) {
+                double *chunk_sums = &sums[chunk * mean_count * 5];
+                for(size_t i = chunk * chunk_colors, end = std::min(padded, i + chunk_colors); i < end; i += lanes) {
+                    simd::vint values[4];
+                    for(int c = 0; c < 4; ++c) values[c] = simd::load(&channels[c][i]);
+
+                    simd::vint best = simd::set1(std::numeric_limits<int32_t>::max()), picked = simd::set1(0);
+                    for(size_t k = 0; k < mean_count; ++k) {
+                        simd::vint error = simd::set1(0);
+                        for(int c = 0; c < 4; ++c) {
+                            simd::vint difference = simd::set1(means[c][k]) - values[c];
+                            error = error + difference * difference;
+                        }
+
+                        simd::vint better = best > error;
+                        best = simd::min(best, error);
+                        picked = picked + ((simd::set1(static_cast<int32_t>(k)) - picked) & better);
+                    }
+
+                    int32_t picks[simd::vint::lanes];
+                    simd::store(picks, picked);
+                    for(size_t lane = 0; lane < lanes; ++lane) {
+                        double weight = weights[i + lane], *mean_sums = chunk_sums + picks[lane] * 5;
+                        for(int c = 0; c < 4; ++c) mean_sums[c] += channels[c][i + lane] * weight;
+                        mean_sums[4] += weight;
+                    }
+                }
+            });
+
+            bool moved = false;
+            for(size_t k = 0; k < mean_count; ++k) {
+                double total[5] = {};
+                for(size_t chunk = 0; chunk < chunks; ++chunk) {
+                    for(int c = 0; c < 5; ++c) total[c] += sums[(chunk * mean_count + k) * 5 + c];
+                }
+
+                // A mean nothing is closest to stays where it is.
+                if(!total[4]) continue;
+                for(int c = 0; c < 4; ++c) {
+                    int32_t mean = static_cast<int32_t>(std::lround(total[c] / total[4]));
+                    moved = moved || mean != means[c][k];
+                    means[c][k] = mean;
+                }
+            }
+
+            if(!moved) break;
+        }
+
+        std::vector<uint32_t> palette;
+        if(transparent) palette.push_back(0);
+        for(size_t k = 0; k < mean_count; ++k) {
+            unsigned char rgba[4];
+            for(int c = 0; c < 4; ++c) rgba[c] = static_cast<unsigned char>(std::clamp(means[c][k], 0, 255));
+            palette.push_back(pack_color(rgba));
+        }
+
+        std::sort(palette.begin(), palette.end());
+        palette.erase(std::unique(palette.begin(), palette.end()), palette.end());
+        return palette;
+    }
+
+    std::vector<unsigned char> index_pixels(const image &pixels, const std::vector<uint32_t> &palette, thread_pool &pool) {
+        size_t lanes = simd::vint::lanes, padded = (palette.size() + lanes - 1) / lanes * lanes;
+        std::vector<int32_t> channels[4];
+        for(int c = 0; c < 4; ++c) {
+            channels[c].assign(padded, unreachable);
+            for(size_t k = 0; k < palette.size(); ++k) channels[c][k] = channel(palette[k], c);
+        }
+
+        int32_t lane_indices[simd::vint::lanes];
+        for(size_t lane = 0; lane < lanes; ++lane) lane_indices[lane] = static_cast<int32_t>(lane);
+
+        std::vector<unsigned char> indices(static_cast<size_t>(pixels.width) * pixels.height);
+        pool.for_each(static_cast<size_t>(pixels.height), [&](size_t y) {
+            // Neighbouring pixels often have the same color, so the last one is remembered.
+            uint32_t last = 0;
+            unsigned char last_index = 0;
+            bool known = false;
+
+            for(size_t x = 0, i = y * pixels.width; x < static_cast<size_t>(pixels.width); ++x, ++i) {
+                uint32_t color = pack_color(&pixels.pixels[i * 4]);
+                if(known && color == last) {
+                    indices[i] = last_index;
+                    continue;
+                }
+
+                simd::vint values[4];
+                for(int c = 0; c < 4; ++c) values[c] = simd::set1(channel(color, c));
+
+                simd::vint best = simd::set1(std::numeric_limits<int32_t>::max()), picked = simd::set1(0);
+                for(size_t k = 0; k < padded; k += lanes) {
+                    simd::vint error = simd::set1(0);
+                    for(int c = 0; c < 4; ++c) {
+                        simd::vint difference = simd::load(&channels[c][k]) - values[c];
+                        error = error + difference * difference;
+                    }
+
+                    simd::vint better = best > error, index = simd::load(lane_indices) + simd::set1(static_cast<int32_t>(k));
+                    best = simd::min(best, error);
+                    picked = picked + ((index - picked) & better);
+                }
+
+                // Ties go to the first entry, as within every lane.
+                int32_t errors[simd::vint::lanes], picks[simd::vint::lanes];
+                simd::store(errors, best);
+                simd::store(picks, picked);
+
+                size_t pick = 0;
+                for(size_t lane = 1; lane < lanes; ++lane) {
+                    if(errors[lane] < errors[pick] || (errors[lane] == errors[pick] && picks[lane] < picks[pick])) pick = lane;
+                }
+
+                last = color;
+                last_index = indices[i] = static_cast<unsigned char>(picks[pick]);
+                known = true;
+            }
+        });
+
+        return indices;
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef AV_PACKER_PALETTE_HPP
+#define AV_PACKER_PALETTE_HPP
+
+#include <packer/image.hpp>
+#include <av/util/thread_pool.hpp>
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace av {
+    /** @return An 8-bit RGBA color packed into an integer, red in the lowest byte, as palettes hold them. */
+    inline uint32_t pack_color(const unsigned char *rgba) {
+        // Fully transparent pixels look the same whatever their color.
+        if(!rgba[3]) return 0;
+        return static_cast<uint32_t>(rgba[0]) | static_cast<uint32_t>(rgba[1]) << 8 | static_cast<uint32_t>(rgba[2]) << 16 | static_cast<uint32_t>(rgba[3]) << 24;
+    }
+
+    /**
+     * @brief Lists the colors of an image, counting every fully transparent pixel as transparent black.
+     *
+     * @param pixels The image.
+     * @param limit  The most colors to list.
+     * @return The colors, packed by `pack_color()` and sorted, or nothing if there are more than `limit`.
+     */
+    std::optional<std::vector<uint32_t>> distinct_colors(const image &pixels, size_t limit);
+
+    /**
+     * @brief Picks a few colors to stand for every color of an image. Boxes of colors are split by median cut along
+     * their widest channel until there are enough, and their means are then refined by k-means. Colors are counted
+     * once with their pixel count as weight, and their closest means are found with SIMD across colors, on every
+     * thread of a pool. Transparent black keeps an exact entry if any pixel is fully transparent.
+     *
+     * @param pixels The image.
+     * @param count  The most colors to pick, from 2 to 256.
+     * @param pool   The pool to quantize on, from the calling thread or any of its tasks.
+     * @return The colors, packed by `pack_color()`; the colors of the image itself if it has few enough of them.
+     */
+    std::vector<uint32_t> quantize(const image &pixels, int count, thread_pool &pool);
+
+    /**
+     * @brief Replaces every pixel of an image with the index of the palette color closest to it, in squared distance
+     * over all four channels, with SIMD across palette colors. Rows are mapped on every thread of a pool.
+     *
+     * @param pixels  The image.
+     * @param palette The palette, packed by `pack_color()`, of at most 256 colors.
+     * @param pool    The pool to map on, from the calling thread or any of its tasks.
+     * @return The `width * height` indices, row by row from the top-left corner.
+     */
+    std::vector<unsigned char> index_pixels(const image &pixels, const std::vector<uint32_t> &palette, thread_pool &pool);
+}
+
+#endif // !AV_PACKER_PALETTE_HPP
@@ -0,0 +1,249 @@
+#include <packer/png_writer.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#include <zlib.h>
+
+namespace av {
+    namespace {
+        /** @brief How much data a chunk is compressed from, roughly; the same as pigz. */
+        constexpr size_t chunk_size = 128 * 1024;
+        /** @brief The deflate window size, and so the most a chunk can refer back into the chunk before it. */
+        constexpr size_t window_size = 32 * 1024;
+
+        inline void put_u32(uint8_t *to, uint32_t value) {
+            to[0] = static_cast<uint8_t>(value >> 24);
+            to[1] = static_cast<uint8_t>(value >> 16);
+            to[2] = static_cast<uint8_t>(value >> 8);
+            to[3] = static_cast<uint8_t>(value);
+        }
+
+        inline int paeth(int a, int b, int c) {
+            int p = a + b - c, pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+            if(pa <= pb && pa <= pc) return a;
+            return pb <= pc ? b : c;
+        }
+
+        /** @return The sum of absolute differences of a row filtered with the given predictor. */
+        template<typename T_predict>
+        uint64_t apply_filter(const uint8_t *row, const uint8_t *prior, size_t size, size_t stride, uint8_t *to, T_predict &&predict) {
+            uint64_t cost = 0;
+            for(size_t i = 0; i < size; ++i) {
+                int a = i >= stride ? row[i - stride] : 0, c = i >= stride ? prior[i - stride] : 0;
+                uint8_t value = static_cast<uint8_t>(row[i] - predict(a, prior[i], c));
+
+                to[i] = value;
+                cost += static_cast<uint64_t>(std::abs(static_cast<int8_t>(value)));
+            }
+
+            return cost;
+        }
+
+        /**
+         * @brief Filters a row with whichever of the five PNG filters gives the smallest sum of absolute differences,
+         * the usual heuristic for what compresses best.
+         *
+         * @param row     The row.
+         * @param prior   The row above, or zeros for the first row.
+         * @param size    The size of a row, in bytes.
+         * @param stride  The size of a pixel, in bytes.
+         * @param to      Where to write the filter type byte followed by the filtered row.
+         * @param scratch Space for a candidate filtered row.
+         */
+        void filter_row(const uint8_t *row, const uint8_t *prior, size_t size, size_t stride, uint8_t *to, std::vector<uint8_t> &scratch) {
+            scratch.resize(size);
+
+            to[0] = 0;
+            uint64_t best = apply_filter(row, prior, size, stride, to + 1, [](int, int, int) { return 0; });
+            auto consider = [&](uint8_t type, uint64_t cost) {
+                if(cost >= best) return;
+
+                best = cost;
+                to[0] = type;
+                std::memcpy(to + 1, scratch.data(), size);
+            };
+
+            consider(1, apply_filter(row, prior, size, stride, scratch.data(), [](int a, int, int) { return a; }));
+            consider(2, apply_filter(row, prior, size, stride, scratch.data(), [](int, int b, int) { return b; }));
+            consider(3, apply_filter(row, prior, size, stride, scratch.data(), [](int a, int b, int) { return (a + b) / 2; }));
+            consider(4, apply_filter(row, prior, size, stride, scratch.data(), paeth));
+        }
+
+        /**
+         * @brief Compresses data as raw deflate blocks that can be followed by more blocks of the same stream.
+         *
+         * @param data            The data.
+         * @param dictionary      The data that comes right before it in the stream, up to 32 KiB of it.
+         * @param dictionary_size The size of `dictionary`, in bytes.
+         * @param level           The zlib compression level.
+         * @param last            Whether this is the end of the stream; otherwise the blocks end on a sync flush, on a
+         *                        byte boundary.
+         * @return The compressed data.
+         */
+        std::vector<uint8_t> compress(const std::vector<uint8_t> &data, const uint8_t *dictionary, size_t dictionary_size, int level, bool last) {
+            z_stream stream = {};
+            if(deflateInit2(&stream, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) throw std::runtime_error("Couldn't initialize zlib.");
+            if(dictionary_size) deflateSetDictionary(&stream, dictionary, static_cast<uInt>(dictionary_size));
+
+            std::vector<uint8_t> result(deflateBound(&stream, static_cast<uLong>(data.size())) + 16);
+            stream.next_in = const_cast<Bytef *>(data.data());
+            stream.avail_in = static_cast<uInt>(data.size());
+            stream.next_out = result.data();
+            stream.avail_out = static_cast<uInt>(result.size());
+
+            int mode = last ? Z_FINISH : Z_SYNC_FLUSH;
+            while(true) {
+                int status = deflate(&stream, mode);
+                if(status == Z_STREAM_ERROR) {
+                    deflateEnd(&stream);
+                    throw std::runtime_error("Couldn't compress image data.");
+                }
+
+                if(last ? status == Z_STREAM_END : stream.avail_out != 0) break;
+
+                size_t used = result.size() - stream.avail_out;
+                result.resize(result.size() * 2);
+                stream.next_out = result.data() + used;
+                stream.avail_out = static_cast<uInt>(result.size() - used);
+            }
+
+            result.resize(result.size() - stream.avail_out);
+            deflateEnd(&stream);
+            return result;
+        }
+    }
+
+    png_writer::png_writer(const std::string &path, int width, int height, thread_pool &pool, int level, int channels, const std::vector<uint32_t> &palette):
+        path(path),
+        out(path, std::ios::binary),
+        pool(pool),
+        width(width),
+        height(height),
+        level(std::clamp(level, 1, 9)),
+        channels(channels == 1 ? 1 : 4),
+        row_size(static_cast<size_t>(width) * this->channels),
+        chunk_rows(std::max<size_t>(1, chunk_size / (row_size + 1))),
+        batch_chunks(pool.size() * 2),
+        previous_row(row_size),
+        checksum(adler32(0, nullptr, 0)) {
+        if(!out) throw std::runtime_error(std::string("Couldn't write '").append(path).append("'."));
+
+        static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+        out.write(reinterpret_cast<const char *>(signature), sizeof(signature));
+
+        // 8-bit RGBA, grayscale or palette, deflate, adaptive filtering and no interlacing.
+        bool indexed = this->channels == 1 && !palette.empty();
+        uint8_t header[13] = {0, 0, 0, 0, 0, 0, 0, 0, 8, static_cast<uint8_t>(indexed ? 3 : this->channels == 1 ? 0 : 6), 0, 0, 0};
+        put_u32(header, static_cast<uint32_t>(width));
+        put_u32(header + 4, static_cast<uint32_t>(height));
+        write_chunk("IHDR", header, sizeof(header));
+
+        if(indexed) {
+            // Colors and their alpha go in separate chunks, the latter right after the former.
+            std::vector<uint8_t> colors, alphas;
+            for(uint32_t color : palette) {
+                for(int c = 0; c < 3; ++c) colors.push_back(static_cast<uint8_t>(color >> (c * 8)));
+                alphas.push_back(static_cast<uint8_t>(color >> 24));
+            }
+
+            write_chunk("PLTE", colors.data(), colors.size());
+            write_chunk("tRNS", alphas.data(), alphas.size());
+        }
+    }
+
+    void png_writer::write_chunk(const char *type, const uint8_t *data, size_t size) {
+        uint8_t length[4], crc[4];
+        put_u32(length, static_cast<uint32_t>(size));
+
+        uLong sum = crc32(0, nullptr, 0);
+        sum = crc32(sum, reinterpret_cast<const Bytef *>(type), 4);
+        if(size) sum = crc32(sum, data, static_cast<uInt>(size));
+        put_u32(crc, static_cast<uint32_t>(sum));
+
+        out.write(reinterpret_cast<const char *>(length), 4);
+        out.write(type, 4);
+        out.write(reinterpret_cast<const char *>(data), size);
+        out.write(reinterpret_cast<const char *>(crc), 4);
+    }
+
+    void png_writer::write_rows(const uint8_t *data, int count) {
+        if(count < 0 || rows + count > height) throw std::runtime_error(std::string("Too many rows for '").append(path).append("'."));
+        rows += count;
+
+        size_t batch_size = chunk_rows * batch_chunks * row_size;
+        for(size_t left = static_cast<size_t>(count) * row_size; left;) {
+            size_t size = std::min(left, batch_size - pending.size());
+            pending.insert(pending.end(), data, data + size);
+            data += size;
+            left -= size;
+
+            if(pending.size() == batch_size) flush(false);
+        }
+    }
+
+    void png_writer::flush(bool last) {
+        size_t count = pending.size() / row_size, chunks = std::max<size_t>(last ? 1 : 0, (count + chunk_rows - 1) / chunk_rows);
+        std::vector<std::vector<uint8_t>> filtered(chunks), compressed(chunks);
+        std::vector<uLong> sums(chunks);
+
+        // Filtering only depends on the unfiltered row above, so every chunk can be filtered at once.
+        pool.for_each(chunks, [&](size_t c) {
+            size_t first = c * chunk_rows, end = std::min(count, first + chunk_rows);
+            std::vector<uint8_t> scratch;
+
+            filtered[c].resize((end - first) * (row_size + 1));
+            for(size_t r = first; r < end; ++r) {
+                const uint8_t *prior = r ? &pending[(r - 1) * row_size] : previous_row.data();
+                filter_row(&pending[r * row_size], prior, row_size, static_cast<size_t>(channels), &filtered[c][(r - first) * (row_size + 1)], scratch);
+            }
+
+            sums[c] = adler32(adler32(0, nullptr, 0), filtered[c].data(), static_cast<uInt>(filtered[c].size()));
+        });
+
+        pool.for_each(chunks, [&](size_t c) {
+            const std::vector<uint8_t> &before = c ? filtered[c - 1] : dictionary;
+            size_t size = std::min(before.size(), window_size);
+            compressed[c] = compress(filtered[c], before.data() + before.size() - size, size, level, last && c == chunks - 1);
+        });
+
+        for(size_t c = 0; c < chunks; ++c) {
+            std::vector<uint8_t> &data = compressed[c];
+            checksum = adler32_combine(checksum, sums[c], static_cast<z_off_t>(filtered[c].size()));
+
+            if(!started) {
+                static const uint8_t stream_header[2] = {0x78, 0x9C};
+                data.insert(data.begin(), stream_header, stream_header + 2);
+                started = true;
+            }
+
+            if(last && c == chunks - 1) {
+                uint8_t trailer[4];
+                put_u32(trailer, static_cast<uint32_t>(checksum));
+                data.insert(data.end(), trailer, trailer + 4);
+            }
+
+            write_chunk("IDAT", data.data(), data.size());
+        }
+
+        if(count) previous_row.assign(pending.end() - row_size, pending.end());
+        if(chunks) {
+            const std::vector<uint8_t> &tail = filtered.back();
+            dictionary.assign(tail.end() - std::min(tail.size(), window_size), tail.end());
+        }
+
+        pending.clear();
+    }
+
+    void png_writer::finish() {
+        if(rows != height) throw std::runtime_error(std::string("Missing rows for '").append(path).append("'."));
+
+        flush(true);
+        write_chunk("IEND", nullptr, 0);
+
+        out.close();
+        if(!out) throw std::runtime_error(std::string("Couldn't write '").append(path).append("'."));
+    }
+}
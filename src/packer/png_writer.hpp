@@ -0,0 +1,77 @@
+#ifndef AV_PACKER_PNGWRITER_HPP
+#define AV_PACKER_PNGWRITER_HPP
+
+#include <av/util/thread_pool.hpp>
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace av {
+    /**
+     * @brief Writes an 8-bit RGBA, grayscale or palette PNG file row by row, filtering and deflating on every thread of a pool in the style
+     * of pigz. Rows are split into chunks that are compressed independently. Each chunk is primed with the last 32 KiB
+     * of the chunk before it, and all but the last one end on a sync flush. The compressed chunks can then be
+     * concatenated into a single zlib stream, so the output is an ordinary PNG file.
+     *
+     * Only a batch of a few chunks per thread is held at once, so the memory use doesn't grow with the image size.
+     */
+    class png_writer {
+        std::string path;
+        std::ofstream out;
+        thread_pool &pool;
+        int width, height, level, channels;
+        /** @brief The size of a row, in bytes, without its filter type byte. */
+        size_t row_size;
+        /** @brief How many rows go in a chunk, and how many chunks go in a batch. */
+        size_t chunk_rows, batch_chunks;
+        /** @brief The rows received since the last batch was written. */
+        std::vector<uint8_t> pending;
+        /** @brief The last row of the previous batch, or zeros at first, which the next row is filtered against. */
+        std::vector<uint8_t> previous_row;
+        /** @brief The end of the filtered data of the previous batch, which the next chunk is primed with. */
+        std::vector<uint8_t> dictionary;
+        /** @brief How many rows were received so far. */
+        int rows = 0;
+        /** @brief The Adler-32 checksum of the filtered data written so far. */
+        unsigned long checksum;
+        /** @brief Whether the zlib stream header was written yet. */
+        bool started = false;
+
+        /** @brief Writes a PNG chunk, with its length and checksum. */
+        void write_chunk(const char *type, const uint8_t *data, size_t size);
+        /** @brief Filters and compresses the pending rows, and writes them as image data. */
+        void flush(bool last);
+
+        public:
+        png_writer(const png_writer &) = delete;
+        /**
+         * @brief Opens the output file and writes the PNG header. An exception is thrown if the file couldn't be
+         * opened.
+         *
+         * @param path     The output file path.
+         * @param width    The image width, in pixels.
+         * @param height   The image height, in pixels.
+         * @param pool     The threads to compress with; may be the pool calling this.
+         * @param level    The zlib compression level, from 1 to 9. Past 3, files barely shrink while taking a lot longer.
+         * @param channels `4` for RGBA pixels, or `1` for grayscale ones or palette indices.
+         * @param palette  The colors single channel pixels index, packed with red in the lowest byte, or empty for
+         *                 grayscale pixels.
+         */
+        png_writer(const std::string &path, int width, int height, thread_pool &pool, int level = 3, int channels = 4, const std::vector<uint32_t> &palette = {});
+
+        /**
+         * @brief Appends rows to the image, compressing them once enough were received.
+         *
+         * @param data  The rows, as tightly packed pixels of as many channels as were given at construction.
+         * @param count How many rows there are.
+         */
+        void write_rows(const uint8_t *data, int count);
+
+        /** @brief Compresses the remaining rows and closes the file, once every row was written. */
+        void finish();
+    };
+}
+
+#endif // !AV_PACKER_PNGWRITER_HPP
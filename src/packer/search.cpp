@@ -0,0 +1,363 @@
+#include <packer/search.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+namespace av {
+    namespace {
+        /** @brief Marks the absence of a position. */
+        constexpr size_t none = std::numeric_limits<size_t>::max();
+    }
+
+    template<typename T_bin>
+    double pack_result<T_bin>::occupancy() const {
+        uint64_t extent = static_cast<uint64_t>(used_width) * used_height;
+        return extent ? static_cast<double>(used_area) / extent : 0.0;
+    }
+
+    template<typename T_bin>
+    bool pack_result<T_bin>::better_than(const pack_result &other) const {
+        if(unplaced.size() != other.unplaced.size()) return unplaced.size() < other.unplaced.size();
+        if(used_area != other.used_area) return used_area > other.used_area;
+        return static_cast<uint64_t>(used_width) * used_height < static_cast<uint64_t>(other.used_width) * other.used_height;
+    }
+
+    template<typename T_bin>
+    pack_result<T_bin> pack(const std::vector<rect_size> &sizes, int width, int height, const pack_strategy<T_bin> &strategy) {
+        pack_result<T_bin> result;
+        result.strategy = strategy;
+        result.width = width;
+        result.height = height;
+
+        T_bin bin(width, height, strategy.allow_flip);
+        if(strategy.order == sort_order::global_best) {
+            std::vector<rect_size> pending = sizes;
+            bin.insert(pending, result.placed, result.ids, strategy.method);
+
+            for(const rect_size &s : pending) result.unplaced.push_back(s.id);
+        } else {
+            auto key = [&](const rect_size &s) -> std::pair<int64_t, int64_t> {
+                switch(strategy.order) {
+                    case sort_order::area: return {static_cast<int64_t>(s.width) * s.height, 0};
+                    case sort_order::max_side: return {std::max(s.width, s.height), std::min(s.width, s.height)};
+                    case sort_order::perimeter: return {static_cast<int64_t>(s.width) + s.height, 0};
+                    default: return {0, 0};
+                }
+            };
+
+            std::vector<rect_size> sorted = sizes;
+            std::stable_sort(sorted.begin(), sorted.end(), [&](const rect_size &a, const rect_size &b) { return key(a) > key(b); });
+
+            for(const rect_size &s : sorted) {
+                rect node = bin.insert(s.width, s.height, strategy.method);
+                if(node.height == 0) {
+                    result.unplaced.push_back(s.id);
+                } else {
+                    result.placed.push_back(node);
+                    result.ids.push_back(s.id);
+                }
+            }
+        }
+
+        for(const rect &r : result.placed) {
+            result.used_width = std::max(result.used_width, r.x + r.width);
+            result.used_height = std::max(result.used_height, r.y + r.height);
+            result.used_area += static_cast<uint64_t>(r.width) * r.height;
+        }
+
+        return result;
+    }
+
+    template<typename T_bin>
+    pack_result<T_bin> pack_best(const std::vector<rect_size> &sizes, int width, int height, const std::vector<pack_strategy<T_bin>> &strategies, thread_pool &pool) {
+        std::vector<pack_result<T_bin>> results(strategies.size());
+        pool.for_each(strategies.size(), [&](size_t i) {
+            results[i] = pack(sizes, width, height, strategies[i]);
+        });
+
+        size_t best = 0;
+        for(size_t i = 1; i < results.size(); ++i) {
+            if(results[i].better_than(results[best])) best = i;
+        }
+
+        return std::move(results[best]);
+    }
+
+    template<typename T_bin>
+    std::vector<pack_strategy<T_bin>> all_strategies(bool allow_flip) {
+        static constexpr sort_order orders[] = {sort_order::global_best, sort_order::area, sort_order::max_side, sort_order::perimeter};
+
+        std::vector<pack_strategy<T_bin>> strategies;
+        for(bool flip : {true, false}) {
+            if(flip && !allow_flip) continue;
+
+            for(sort_order order : orders) {
+                for(typename T_bin::heuristic method : T_bin::heuristics) {
+                    // The batch contact point insertion rescores every pending rectangle after each placement, which
+                    // alone takes longer than every other strategy combined.
+                    if constexpr(std::is_same_v<T_bin, max_rects_bin_pack>) {
+                        if(method == max_rects_bin_pack::heuristic::contact_point_rule && order == sort_order::global_best) continue;
+                    }
+
+                    // The batch min waste insertion packs by area anyway, which the area order already tries.
+                    if constexpr(std::is_same_v<T_bin, skyline_bin_pack>) {
+                        if(method == skyline_bin_pack::heuristic::min_waste_fit && order == sort_order::global_best) continue;
+                    }
+
+                    strategies.push_back({method, order, flip});
+                }
+            }
+        }
+
+        return strategies;
+    }
+
+    template<typename T_bin>
+    pack_result<T_bin> pack_smallest(const std::vector<rect_size> &sizes, const size_rules &rules, const std::vector<pack_strategy<T_bin>> &strategies, thread_pool &pool) {
+        bool allow_flip = std::any_of(strategies.begin(), strategies.end(), [](const pack_strategy<T_bin> &s) { return s.allow_flip; });
+
+        // Every size has to hold all of the rectangles' area, and the largest of them in any orientation allowed.
+        uint64_t total_area = 0;
+        int max_width = 0, max_height = 0, max_short = 0, max_long = 0;
+        for(const rect_size &s : sizes) {
+            total_area += static_cast<uint64_t>(s.width) * s.height;
+            max_width = std::max(max_width, s.width);
+            max_height = std::max(max_height, s.height);
+            max_short = std::max(max_short, std::min(s.width, s.height));
+            max_long = std::max(max_long, std::max(s.width, s.height));
+        }
+
+        auto admissible = [&](int width, int height) {
+            if(static_cast<uint64_t>(width) * height < total_area) return false;
+            return allow_flip
+                ? std::min(width, height) >= max_short && std::max(width, height) >= max_long
+                : width >= max_width && height >= max_height;
+        };
+
+        auto round_up = [&](int dim) {
+            if(!rules.pow2) return dim;
+
+            int pow = 1;
+            while(pow < dim) pow <<= 1;
+            return pow;
+        };
+
+        // A packing that leaves part of its bin unused also fits in a smaller one.
+        auto shrink = [&](pack_result<T_bin> &result) {
+            int width = round_up(std::max(result.used_width, 1)), height = round_up(std::max(result.used_height, 1));
+            if(rules.square) width = height = std::max(width, height);
+
+            if(static_cast<uint64_t>(width) * height < static_cast<uint64_t>(result.width) * result.height) {
+                result.width = width;
+                result.height = height;
+            }
+        };
+
+        // Packs at every size at once, returning the first that fits in list order, or `npos` if none does.
+        std::vector<pack_result<T_bin>> results;
+        auto try_sizes = [&](const std::vector<std::pair<int, int>> &candidates) {
+            results.assign(candidates.size(), pack_result<T_bin>());
+            pool.for_each(candidates.size(), [&](size_t i) {
+                results[i] = pack_best(sizes, candidates[i].first, candidates[i].second, strategies, pool);
+            });
+
+            for(size_t i = 0; i < results.size(); ++i) if(results[i].unplaced.empty()) return i;
+            return none;
+        };
+
+        auto fallback = [&]() {
+            return pack_best(sizes, rules.max_size, rules.max_size, strategies, pool);
+        };
+
+        if(rules.pow2) {
+            std::vector<std::pair<int, int>> candidates;
+            for(int width = 1; width <= rules.max_size; width <<= 1) {
+                for(int height = 1; height <= rules.max_size; height <<= 1) {
+                    if((!rules.square || width == height) && admissible(width, height)) candidates.emplace_back(width, height);
+                }
+            }
+
+            // Smallest area first, then the squarest, then the wider.
+            std::sort(candidates.begin(), candidates.end(), [](const std::pair<int, int> &a, const std::pair<int, int> &b) {
+                uint64_t area_a = static_cast<uint64_t>(a.first) * a.second, area_b = static_cast<uint64_t>(b.first) * b.second;
+                if(area_a != area_b) return area_a < area_b;
+
+                int skew_a = std::abs(a.first - a.second), skew_b = std::abs(b.first - b.second);
+                if(skew_a != skew_b) return skew_a < skew_b;
+                return a.first > b.first;
+            });
+
+            size_t round = std::max<size_t>(pool.size(), 1);
+            for(size_t begin = 0; begin < candidates.size(); begin += round) {
+                std::vector<std::pair<int, int>> batch(candidates.begin() + begin, candidates.begin() + std::min(begin + round, candidates.size()));
+
+                size_t found = try_sizes(batch);
+                if(found != none) {
+                    pack_result<T_bin> result = std::move(results[found]);
+                    shrink(result);
+                    return result;
+                }
+            }
+
+            return fallback();
+        }
+
+        if(rules.square) {
+            // Probe a fixed amount of sizes per round regardless of the thread count, so the result doesn't depend on it.
+            static constexpr int probes = 8;
+
+            int lo = std::max(max_long, static_cast<int>(std::sqrt(static_cast<double>(total_area))));
+            while(lo <= rules.max_size && !admissible(lo, lo)) ++lo;
+            if(lo > rules.max_size) return fallback();
+
+            // `hi` is the smallest size known to fit, or one past the largest allowed one if none is known yet.
+            int hi = rules.max_size + 1;
+            pack_result<T_bin> best;
+            while(lo < hi) {
+                int last = std::min(hi - 1, rules.max_size);
+
+                std::vector<std::pair<int, int>> candidates;
+                for(int i = 0; i < probes; ++i) {
+                    int size = lo + static_cast<int>(static_cast<int64_t>(last - lo) * i / (probes - 1));
+                    if(candidates.empty() || candidates.back().first != size) candidates.emplace_back(size, size);
+                }
+
+                size_t found = try_sizes(candidates);
+                if(found == none) {
+                    if(hi > rules.max_size) return fallback();
+
+                    lo = last + 1;
+                    continue;
+                }
+
+                best = std::move(results[found]);
+                shrink(best);
+
+                hi = best.width;
+                if(found > 0) lo = candidates[found - 1].first + 1;
+            }
+
+            return best;
+        }
+
+        // Any size; pack a range of widths around the square root of the area as tall as allowed, keeping the one that
+        // uses the least area. Ratios between the narrowest and widest are equal, so as many sizes are tried on either
+        // side of a square.
+        static constexpr int widths = 16;
+        static constexpr double aspect = 4.0;
+
+        int min_width = std::max<int>(allow_flip ? max_short : max_width, static_cast<int>((total_area + rules.max_size - 1) / rules.max_size));
+        if(min_width > rules.max_size) return fallback();
+
+        double side = std::sqrt(static_cast<double>(total_area));
+        double narrowest = std::max<double>(min_width, side / aspect), widest = std::min<double>(rules.max_size, side * aspect);
+        if(widest < narrowest) widest = narrowest;
+
+        std::vector<std::pair<int, int>> candidates;
+        for(int i = 0; i < widths; ++i) {
+            int width = static_cast<int>(std::lround(narrowest * std::pow(widest / narrowest, i / (widths - 1.0))));
+            width = std::clamp(width, min_width, rules.max_size);
+            if(candidates.empty() || candidates.back().first != width) candidates.emplace_back(width, rules.max_size);
+        }
+
+        if(try_sizes(candidates) == none) return fallback();
+
+        size_t best_index = none;
+        for(size_t i = 0; i < results.size(); ++i) {
+            if(!results[i].unplaced.empty()) continue;
+
+            shrink(results[i]);
+            if(best_index == none || static_cast<uint64_t>(results[i].width) * results[i].height < static_cast<uint64_t>(results[best_index].width) * results[best_index].height) best_index = i;
+        }
+
+        // Packing into a bin that's already tight tends to do better than cropping a tall one, so narrow the height
+        // down at that width, like square sizes are.
+        static constexpr int probes = 8;
+
+        pack_result<T_bin> best = std::move(results[best_index]);
+        int width = best.width;
+        int lo = std::max<int>(allow_flip ? 1 : max_height, static_cast<int>((total_area + width - 1) / width)), hi = best.height;
+        while(lo < hi) {
+            int last = hi - 1;
+
+            candidates.clear();
+            for(int i = 0; i < probes; ++i) {
+                int height = lo + static_cast<int>(static_cast<int64_t>(last - lo) * i / (probes - 1));
+                if(candidates.empty() || candidates.back().second != height) candidates.emplace_back(width, height);
+            }
+
+            size_t found = try_sizes(candidates);
+            if(found == none) break;
+
+            shrink(results[found]);
+            if(static_cast<uint64_t>(results[found].width) * results[found].height < static_cast<uint64_t>(best.width) * best.height) {
+                best = std::move(results[found]);
+            }
+
+            hi = candidates[found].second;
+            if(found > 0) lo = candidates[found - 1].second + 1;
+        }
+
+        return best;
+    }
+
+    template<typename T_bin>
+    std::vector<pack_result<T_bin>> pack_pages(const std::vector<rect_size> &sizes, int width, int height, const size_rules *rules, const std::vector<pack_strategy<T_bin>> &strategies, thread_pool &pool, size_t max_pages) {
+        if(rules) {
+            width = height = rules->max_size;
+            if(rules->pow2) {
+                int pow = 1;
+                while(pow <= rules->max_size / 2) pow <<= 1;
+                width = height = pow;
+            }
+        }
+
+        std::vector<pack_result<T_bin>> pages;
+        std::vector<rect_size> pending = sizes;
+        do {
+            pack_result<T_bin> page = pack_best(pending, width, height, strategies, pool);
+
+            // Whatever is left fits in this page, so it may as well be as small as possible.
+            if(rules && page.unplaced.empty()) page = pack_smallest(pending, *rules, strategies, pool);
+
+            // Nothing fit in an empty bin, so nothing ever will.
+            if(page.placed.empty()) {
+                if(pages.empty()) pages.push_back(std::move(page));
+                else pages.back().unplaced = std::move(page.unplaced);
+
+                break;
+            }
+
+            // Keep the rectangles that didn't fit in their original order, so the next page gets the same input it
+            // would if they were packed on their own.
+            std::vector<int> left = page.unplaced;
+            std::sort(left.begin(), left.end());
+
+            pending.erase(std::remove_if(pending.begin(), pending.end(), [&](const rect_size &s) {
+                return !std::binary_search(left.begin(), left.end(), s.id);
+            }), pending.end());
+            pages.push_back(std::move(page));
+        } while(!pending.empty() && (!max_pages || pages.size() < max_pages));
+
+        return pages;
+    }
+
+    // Every bin packing algorithm the packer can pick from.
+#define AV_PACKER_INSTANTIATE(T_bin) \
+    template struct pack_result<T_bin>; \
+    template pack_result<T_bin> pack(const std::vector<rect_size> &, int, int, const pack_strategy<T_bin> &); \
+    template pack_result<T_bin> pack_best(const std::vector<rect_size> &, int, int, const std::vector<pack_strategy<T_bin>> &, thread_pool &); \
+    template std::vector<pack_strategy<T_bin>> all_strategies(bool); \
+    template pack_result<T_bin> pack_smallest(const std::vector<rect_size> &, const size_rules &, const std::vector<pack_strategy<T_bin>> &, thread_pool &); \
+    template std::vector<pack_result<T_bin>> pack_pages(const std::vector<rect_size> &, int, int, const size_rules *, const std::vector<pack_strategy<T_bin>> &, thread_pool &, size_t);
+
+    AV_PACKER_INSTANTIATE(max_rects_bin_pack)
+    AV_PACKER_INSTANTIATE(skyline_bin_pack)
+    AV_PACKER_INSTANTIATE(guillotine_bin_pack)
+
+#undef AV_PACKER_INSTANTIATE
+}
@@ -0,0 +1,154 @@
+#ifndef AV_PACKER_SEARCH_HPP
+#define AV_PACKER_SEARCH_HPP
+
+#include <packer/max_rects.hpp>
+#include <packer/skyline.hpp>
+#include <av/util/packing/guillotine.hpp>
+#include <av/util/packing/rect.hpp>
+#include <av/util/thread_pool.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace av {
+    /** @brief The order rectangles are inserted in. */
+    enum class sort_order {
+        /** @brief Uses the batch `insert()` of the bin, which always places the best fitting rectangle next. */
+        global_best,
+        /** @brief Inserts one at a time, largest area first. */
+        area,
+        /** @brief Inserts one at a time, longest side first, then longest other side first. */
+        max_side,
+        /** @brief Inserts one at a time, largest perimeter first. */
+        perimeter
+    };
+
+    /**
+     * @brief A way to pack a set of rectangles in a bin. The bin packing algorithm is a compile-time policy, one of
+     * `max_rects_bin_pack`, `skyline_bin_pack` or `guillotine_bin_pack`, so that its placement loops inline into the
+     * search; every function below is instantiated for each of them.
+     */
+    template<typename T_bin>
+    struct pack_strategy {
+        typename T_bin::heuristic method = T_bin::heuristics[0];
+        sort_order order = sort_order::global_best;
+        bool allow_flip = true;
+    };
+
+    /** @brief The outcome of packing a set of rectangles with a `pack_strategy`. */
+    template<typename T_bin>
+    struct pack_result {
+        pack_strategy<T_bin> strategy;
+        /** @brief The bin size. */
+        int width = 0, height = 0;
+        /** @brief Where each packed rectangle went. */
+        std::vector<rect> placed;
+        /** @brief The `rect_size::id` of each of `placed`. */
+        std::vector<int> ids;
+        /** @brief The `rect_size::id` of every rectangle that didn't fit. */
+        std::vector<int> unplaced;
+        /** @brief The size of the smallest area anchored at the origin that holds every packed rectangle. */
+        int used_width = 0, used_height = 0;
+        /** @brief The total area of the packed rectangles. */
+        uint64_t used_area = 0;
+
+        /** @return The ratio of `used_area` to the area of `used_width` x `used_height`. */
+        double occupancy() const;
+
+        /**
+         * @brief Ranks packings of the same rectangles: the one that leaves out fewer rectangles, then less area, then
+         * the one with the smaller used extent is better.
+         */
+        bool better_than(const pack_result &other) const;
+    };
+
+    /**
+     * @brief Packs rectangles into a single bin.
+     *
+     * @param sizes    The rectangles.
+     * @param width    The bin width.
+     * @param height   The bin height.
+     * @param strategy How to pack them.
+     * @return Where they went.
+     */
+    template<typename T_bin>
+    pack_result<T_bin> pack(const std::vector<rect_size> &sizes, int width, int height, const pack_strategy<T_bin> &strategy);
+
+    /**
+     * @brief Packs rectangles into a single bin with each of the given strategies in parallel, keeping the best result
+     * as ranked by `pack_result::better_than()`. Ties go to the strategy listed first, so the result only depends on
+     * the input.
+     *
+     * @param sizes      The rectangles.
+     * @param width      The bin width.
+     * @param height     The bin height.
+     * @param strategies The strategies to try. Must not be empty.
+     * @param pool       The thread pool to run them on.
+     * @return The best result.
+     */
+    template<typename T_bin>
+    pack_result<T_bin> pack_best(const std::vector<rect_size> &sizes, int width, int height, const std::vector<pack_strategy<T_bin>> &strategies, thread_pool &pool);
+
+    /**
+     * @param allow_flip Whether strategies that flip rectangles may be included.
+     * @return Every combination of heuristic, sort order and flipping, except for the batch contact point insertion of
+     *         `max_rects_bin_pack`, which is far too slow to search with.
+     */
+    template<typename T_bin>
+    std::vector<pack_strategy<T_bin>> all_strategies(bool allow_flip);
+
+    /** @brief Which bin sizes `pack_smallest()` may pick. */
+    struct size_rules {
+        /** @brief Whether both dimensions must be powers of two. */
+        bool pow2 = false;
+        /** @brief Whether both dimensions must be equal. */
+        bool square = false;
+        /** @brief The largest either dimension may be. */
+        int max_size = 4096;
+    };
+
+    /**
+     * @brief Finds the smallest bin following the given rules that every rectangle fits in, trying several sizes at
+     * once. Sizes that are smaller in area than the rectangles combined, or can't hold the largest of them, are
+     * rejected without packing.
+     *
+     * - Power-of-two sizes are few, so they are packed in order of area until one fits.
+     * - Other square sizes are narrowed down by packing a fixed number of sizes at once, assuming that a size fits
+     *   if a smaller one did.
+     * - Any other size is found by packing a range of widths into bins as tall as allowed, and cropping each to the
+     *   area actually used.
+     *
+     * Whenever a packing uses less than its bin, it's shrunk to the smallest size following the rules that holds it.
+     * The result only depends on the input, not on how many threads there are.
+     *
+     * @param sizes      The rectangles.
+     * @param rules      The allowed bin sizes.
+     * @param strategies The strategies to try at every size, with `pack_best()`. Must not be empty.
+     * @param pool       The thread pool to run them on.
+     * @return The best packing in the smallest bin found, or in the largest allowed bin if nothing fits; the latter
+     *         has a non-empty `pack_result::unplaced`.
+     */
+    template<typename T_bin>
+    pack_result<T_bin> pack_smallest(const std::vector<rect_size> &sizes, const size_rules &rules, const std::vector<pack_strategy<T_bin>> &strategies, thread_pool &pool);
+
+    /**
+     * @brief Packs rectangles into as many bins as they need, filling each with the best of the given strategies before
+     * moving what's left to the next one. Pages depend on what the previous ones left over, so only the strategies of a
+     * page are tried in parallel.
+     *
+     * @param sizes      The rectangles.
+     * @param width      The bin width.
+     * @param height     The bin height.
+     * @param rules      If not null, the last page is shrunk to the smallest size following these rules with
+     *                   `pack_smallest()`, and `width` and `height` are ignored in favor of its largest allowed size.
+     * @param strategies The strategies to try on every page. Must not be empty.
+     * @param pool       The thread pool to run them on.
+     * @param max_pages  The most pages to use, or `0` for no limit.
+     * @return The pages. Rectangles that didn't fit anywhere, either because they are larger than a bin or because
+     *         `max_pages` ran out, are in the `pack_result::unplaced` of the last one.
+     */
+    template<typename T_bin>
+    std::vector<pack_result<T_bin>> pack_pages(const std::vector<rect_size> &sizes, int width, int height, const size_rules *rules, const std::vector<pack_strategy<T_bin>> &strategies, thread_pool &pool, size_t max_pages = 0);
+}
+
+#endif // !AV_PACKER_SEARCH_HPP
@@ -0,0 +1,150 @@
+#ifndef AV_PACKER_SIMD_HPP
+#define AV_PACKER_SIMD_HPP
+
+#include <algorithm>
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE4_1__)
+#include <smmintrin.h>
+#endif
+
+namespace av::simd {
+    /**
+     * @brief A vector of 32-bit signed integers. Uses AVX2 or SSE4.1 if the compiler targets them, and a plain array
+     * otherwise. Comparisons return a mask vector with every bit of a lane set if the comparison holds for it. Every
+     * operation wraps around like two's complement `int` arithmetic does on the targeted machines, so a lane always
+     * computes the same value as the equivalent scalar code.
+     */
+    struct vint {
+#if defined(__AVX2__)
+        static constexpr int lanes = 8;
+        __m256i v;
+#elif defined(__SSE4_1__)
+        static constexpr int lanes = 4;
+        __m128i v;
+#else
+        static constexpr int lanes = 4;
+        int32_t v[lanes];
+#endif
+    };
+
+    /** @brief The instruction set `vint` uses, for diagnostics. */
+    inline const char *name() {
+#if defined(__AVX2__)
+        return "AVX2";
+#elif defined(__SSE4_1__)
+        return "SSE4.1";
+#else
+        return "scalar";
+#endif
+    }
+
+#if defined(__AVX2__)
+    inline vint load(const int32_t *src) { return {_mm256_loadu_si256(reinterpret_cast<const __m256i *>(src))}; }
+    inline void store(int32_t *dst, vint a) { _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), a.v); }
+    inline vint set1(int32_t a) { return {_mm256_set1_epi32(a)}; }
+
+    inline vint operator +(vint a, vint b) { return {_mm256_add_epi32(a.v, b.v)}; }
+    inline vint operator -(vint a, vint b) { return {_mm256_sub_epi32(a.v, b.v)}; }
+    inline vint operator *(vint a, vint b) { return {_mm256_mullo_epi32(a.v, b.v)}; }
+    inline vint operator &(vint a, vint b) { return {_mm256_and_si256(a.v, b.v)}; }
+    inline vint operator |(vint a, vint b) { return {_mm256_or_si256(a.v, b.v)}; }
+
+    inline vint min(vint a, vint b) { return {_mm256_min_epi32(a.v, b.v)}; }
+    inline vint max(vint a, vint b) { return {_mm256_max_epi32(a.v, b.v)}; }
+    inline vint operator >(vint a, vint b) { return {_mm256_cmpgt_epi32(a.v, b.v)}; }
+    inline vint operator >=(vint a, vint b) { return {_mm256_cmpeq_epi32(_mm256_max_epi32(a.v, b.v), a.v)}; }
+
+    /** @return The sign bit of every lane, lane 0 in the lowest bit. */
+    inline uint32_t mask(vint a) { return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(a.v))); }
+#elif defined(__SSE4_1__)
+    inline vint load(const int32_t *src) { return {_mm_loadu_si128(reinterpret_cast<const __m128i *>(src))}; }
+    inline void store(int32_t *dst, vint a) { _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), a.v); }
+    inline vint set1(int32_t a) { return {_mm_set1_epi32(a)}; }
+
+    inline vint operator +(vint a, vint b) { return {_mm_add_epi32(a.v, b.v)}; }
+    inline vint operator -(vint a, vint b) { return {_mm_sub_epi32(a.v, b.v)}; }
+    inline vint operator *(vint a, vint b) { return {_mm_mullo_epi32(a.v, b.v)}; }
+    inline vint operator &(vint a, vint b) { return {_mm_and_si128(a.v, b.v)}; }
+    inline vint operator |(vint a, vint b) { return {_mm_or_si128(a.v, b.v)}; }
+
+    inline vint min(vint a, vint b) { return {_mm_min_epi32(a.v, b.v)}; }
+    inline vint max(vint a, vint b) { return {_mm_max_epi32(a.v, b.v)}; }
+    inline vint operator >(vint a, vint b) { return {_mm_cmpgt_epi32(a.v, b.v)}; }
+    inline vint operator >=(vint a, vint b) { return {_mm_cmpeq_epi32(_mm_max_epi32(a.v, b.v), a.v)}; }
+
+    /** @return The sign bit of every lane, lane 0 in the lowest bit. */
+    inline uint32_t mask(vint a) { return static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(a.v))); }
+#else
+    template<typename T_op>
+    inline vint apply(vint a, vint b, T_op &&op) {
+        vint result;
+        for(int i = 0; i < vint::lanes; ++i) result.v[i] = op(a.v[i], b.v[i]);
+        return result;
+    }
+
+    inline vint load(const int32_t *src) {
+        vint result;
+        for(int i = 0; i < vint::lanes; ++i) result.v[i] = src[i];
+        return result;
+    }
+
+    inline void store(int32_t *dst, vint a) { for(int i = 0; i < vint::lanes; ++i) dst[i] = a.v[i]; }
+    inline vint set1(int32_t a) { return apply({}, {}, [a](int32_t, int32_t) { return a; }); }
+
+    // Wrapping arithmetic goes through `uint32_t`, as signed overflow is undefined.
+    inline vint operator +(vint a, vint b) { return apply(a, b, [](int32_t x, int32_t y) { return static_cast<int32_t>(static_cast<uint32_t>(x) + static_cast<uint32_t>(y)); }); }
+    inline vint operator -(vint a, vint b) { return apply(a, b, [](int32_t x, int32_t y) { return static_cast<int32_t>(static_cast<uint32_t>(x) - static_cast<uint32_t>(y)); }); }
+    inline vint operator *(vint a, vint b) { return apply(a, b, [](int32_t x, int32_t y) { return static_cast<int32_t>(static_cast<uint32_t>(x) * static_cast<uint32_t>(y)); }); }
+    inline vint operator &(vint a, vint b) { return apply(a, b, [](int32_t x, int32_t y) { return x & y; }); }
+    inline vint operator |(vint a, vint b) { return apply(a, b, [](int32_t x, int32_t y) { return x | y; }); }
+
+    inline vint min(vint a, vint b) { return apply(a, b, [](int32_t x, int32_t y) { return x < y ? x : y; }); }
+    inline vint max(vint a, vint b) { return apply(a, b, [](int32_t x, int32_t y) { return x > y ? x : y; }); }
+    inline vint operator >(vint a, vint b) { return apply(a, b, [](int32_t x, int32_t y) { return x > y ? -1 : 0; }); }
+    inline vint operator >=(vint a, vint b) { return apply(a, b, [](int32_t x, int32_t y) { return x >= y ? -1 : 0; }); }
+
+    /** @return The sign bit of every lane, lane 0 in the lowest bit. */
+    inline uint32_t mask(vint a) {
+        uint32_t result = 0;
+        for(int i = 0; i < vint::lanes; ++i) result |= static_cast<uint32_t>(a.v[i] < 0) << i;
+        return result;
+    }
+#endif
+
+    /**
+     * @brief The four `float` channels of a single pixel. Uses SSE whenever `vint` uses SSE4.1 or AVX2, and a plain
+     * array otherwise.
+     */
+    struct vfloat4 {
+#if defined(__AVX2__) || defined(__SSE4_1__)
+        __m128 v;
+#else
+        float v[4];
+#endif
+    };
+
+#if defined(__AVX2__) || defined(__SSE4_1__)
+    inline vfloat4 load(const float *src) { return {_mm_loadu_ps(src)}; }
+    inline void store(float *dst, vfloat4 a) { _mm_storeu_ps(dst, a.v); }
+    inline vfloat4 set(float x, float y, float z, float w) { return {_mm_setr_ps(x, y, z, w)}; }
+    inline vfloat4 splat(float a) { return {_mm_set1_ps(a)}; }
+
+    inline vfloat4 operator +(vfloat4 a, vfloat4 b) { return {_mm_add_ps(a.v, b.v)}; }
+    inline vfloat4 operator *(vfloat4 a, vfloat4 b) { return {_mm_mul_ps(a.v, b.v)}; }
+    inline vfloat4 max(vfloat4 a, vfloat4 b) { return {_mm_max_ps(a.v, b.v)}; }
+#else
+    inline vfloat4 load(const float *src) { return {{src[0], src[1], src[2], src[3]}}; }
+    inline void store(float *dst, vfloat4 a) { for(int i = 0; i < 4; ++i) dst[i] = a.v[i]; }
+    inline vfloat4 set(float x, float y, float z, float w) { return {{x, y, z, w}}; }
+    inline vfloat4 splat(float a) { return {{a, a, a, a}}; }
+
+    inline vfloat4 operator +(vfloat4 a, vfloat4 b) { return {{a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3]}}; }
+    inline vfloat4 operator *(vfloat4 a, vfloat4 b) { return {{a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2], a.v[3] * b.v[3]}}; }
+    inline vfloat4 max(vfloat4 a, vfloat4 b) { return {{std::max(a.v[0], b.v[0]), std::max(a.v[1], b.v[1]), std::max(a.v[2], b.v[2]), std::max(a.v[3], b.v[3])}}; }
+#endif
+}
+
+#endif // !AV_PACKER_SIMD_HPP
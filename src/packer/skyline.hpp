@@ -0,0 +1,419 @@
+#ifndef AV_PACKER_SKYLINE_HPP
+#define AV_PACKER_SKYLINE_HPP
+
+#include <av/util/packing/guillotine.hpp>
+#include <av/util/packing/rect.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace av {
+    /**
+     * @brief Packs rectangles on top of a skyline, the outline of the top edges of everything placed so far. Space
+     * a placement leaves below the skyline goes to a waste map that later rectangles are packed into first, but the
+     * skyline still packs looser than `max_rects_bin_pack`. A placement only has to scan the skyline segments and the
+     * few wasted areas rather than every free rectangle, which makes single insertions fast enough for packing at
+     * runtime.
+     */
+    class skyline_bin_pack {
+        public:
+        /** @brief Specifies the different heuristic rules that can be used when deciding where to place a new rectangle. */
+        enum class heuristic {
+            /** @brief Positions the rectangle so that its top side is as low as possible. */
+            bottom_left_rule,
+            /** @brief Positions the rectangle where it leaves the least space between itself and the skyline. */
+            min_waste_fit
+        };
+
+        /** @brief Every heuristic, the default first. */
+        static constexpr heuristic heuristics[] = {heuristic::bottom_left_rule, heuristic::min_waste_fit};
+
+        skyline_bin_pack(): bin_width(0), bin_height(0), allow_flip(true) {}
+
+        /**
+         * @brief Instantiates a bin of the given size.
+         * @param allow_flip Specifies whether the packing algorithm is allowed to rotate the input rectangles by 90 degrees
+         * to consider a better placement.
+         */
+        skyline_bin_pack(int width, int height, bool allow_flip = true) {
+            init(width, height, allow_flip);
+        }
+
+        /**
+         * @brief Initializes the packer to an empty bin of width x height units. Call whenever you need to restart with a
+         * new bin.
+         * @param width The bin width;
+         * @param height The bin height;
+         * @param allow_flip Specifies whether the packing algorithm is allowed to rotate the input rectangles by 90 degrees
+         * to consider a better placement.
+         */
+        void init(int width, int height, bool allow_flip = true) {
+            this->allow_flip = allow_flip;
+            bin_width = width;
+            bin_height = height;
+
+            skyline.assign(1, {0, 0, width});
+            waste.init(0, 0, allow_flip);
+            used_rects.clear();
+            used_area = 0;
+        }
+
+        /**
+         * @brief Inserts the given list of rectangles in an offline/batch mode, possibly rotated.
+         *
+         * @param rects The list of rectangles to insert. This vector will be destroyed in the process.
+         * @param dst [out] This list will contain the packed rectangles. The indices will not correspond to that of rects.
+         * @param method The rectangle placement rule to use when packing.
+         */
+        void insert(std::vector<rect_size> &rects, std::vector<rect> &dst, heuristic method) {
+            std::vector<int> dst_ids;
+            insert(rects, dst, dst_ids, method);
+        }
+
+        /**
+         * @brief Inserts the given list of rectangles in an offline/batch mode, possibly rotated, always placing the
+         * rectangle with the best position next and keeping track of where each of them went. With
+         * `heuristic::min_waste_fit`, the best position is nearly always a small rectangle that fits a gap exactly, which
+         * leaves a ragged skyline and takes long to rescore, so the rectangles are inserted largest first instead.
+         *
+         * @param rects   The list of rectangles to insert. Rectangles that didn't fit in the bin are left in here, and
+         *                everything else is removed.
+         * @param dst     [out] This list will contain the packed rectangles.
+         * @param dst_ids [out] This list will contain the `rect_size::id` each of the packed rectangles came from, in
+         *                the same order as `dst`.
+         * @param method  The rectangle placement rule to use when packing.
+         */
+        void insert(std::vector<rect_size> &rects, std::vector<rect> &dst, std::vector<int> &dst_ids, heuristic method) {
+            dst.clear();
+            dst_ids.clear();
+
+            switch(method) {
+                case heuristic::bottom_left_rule: insert_cached(rects, dst, dst_ids, bottom_left_scoring{}); break;
+                case heuristic::min_waste_fit: insert_largest_first(rects, dst, dst_ids, method); break;
+            }
+        }
+
+        /**
+         * Inserts a single rectangle into the bin, possibly rotated.
+         *
+         * @param width The rectangle width.
+         * @param height The rectangle height.
+         * @param method The packing method. See `heuristic` documentation for details.
+         * @return The inserted rectangle, or an empty one if it doesn't fit.
+         */
+        rect insert(int width, int height, heuristic method) {
+            rect wasted = waste.insert(width, height, guillotine_bin_pack::heuristic::best_short_side_fit);
+            if(wasted.height != 0) {
+                add_used(wasted);
+                return wasted;
+            }
+
+            fit best;
+            switch(method) {
+                case heuristic::bottom_left_rule: best = find_fit(width, height, 0, skyline.size(), bottom_left_scoring{}); break;
+                case heuristic::min_waste_fit: best = find_fit(width, height, 0, skyline.size(), min_waste_scoring{}); break;
+            }
+
+            if(best.node.height == 0) return best.node;
+
+            place(best.node);
+            return best.node;
+        }
+
+        /** @return The bin width. */
+        inline int get_width() const {
+            return bin_width;
+        }
+        /** @return The bin height. */
+        inline int get_height() const {
+            return bin_height;
+        }
+        /** @return The rectangles packed so far. */
+        inline const std::vector<rect> &get_used_rects() const {
+            return used_rects;
+        }
+
+        /** @return The ratio of used surface area to the total bin area. */
+        double occupancy() const {
+            return static_cast<double>(used_area) / (static_cast<uint64_t>(bin_width) * bin_height);
+        }
+
+        private:
+        /** @brief A horizontal piece of the skyline, which everything above is free. */
+        struct segment {
+            int x;
+            int y;
+            int width;
+        };
+
+        int bin_width;
+        int bin_height;
+
+        bool allow_flip;
+
+        /** @brief The skyline, from left to right. Segments are contiguous and neighbours are at different heights. */
+        std::vector<segment> skyline;
+        /** @brief The space left between placed rectangles and the skyline below them, with no space of its own. */
+        guillotine_bin_pack waste;
+        std::vector<rect> used_rects;
+        uint64_t used_area;
+
+        /** @brief A candidate position for a rectangle, along with its scores. */
+        struct fit {
+            /** @brief Where the rectangle would be placed, or an empty `rect` if it doesn't fit anywhere. */
+            rect node = {};
+            int64_t score1 = std::numeric_limits<int64_t>::max();
+            int64_t score2 = std::numeric_limits<int64_t>::max();
+            bool flipped = false;
+
+            /** @return Whether this position scores better than the other one, breaking ties by the leftmost position. */
+            inline bool better_than(const fit &other) const {
+                if(score1 != other.score1) return score1 < other.score1;
+                if(score2 != other.score2) return score2 < other.score2;
+                if(node.x != other.node.x) return node.x < other.node.x;
+                return !flipped && other.flipped;
+            }
+        };
+
+        /** @brief Scoring of `heuristic::bottom_left_rule`; the top side. */
+        struct bottom_left_scoring {
+            inline void score(int y, int height, int64_t, int64_t &top, int64_t &tie) const {
+                top = y + height;
+                tie = 0;
+            }
+        };
+
+        /** @brief Scoring of `heuristic::min_waste_fit`; the area left below the rectangle, then the top side. */
+        struct min_waste_scoring {
+            inline void score(int y, int height, int64_t waste, int64_t &wasted, int64_t &top) const {
+                wasted = waste;
+                top = y + height;
+            }
+        };
+
+        /**
+         * @brief Finds how low a rectangle can go with its left side on a segment.
+         *
+         * @param index  The segment.
+         * @param width  The rectangle width.
+         * @param height The rectangle height.
+         * @param y      [out] The bottom side of the rectangle, resting on the highest segment below it.
+         * @param waste  [out] The area between the rectangle and the segments below it.
+         * @return Whether the rectangle fits in the bin there.
+         */
+        bool fits(size_t index, int width, int height, int &y, int64_t &waste) const {
+            int x = skyline[index].x;
+            if(x + width > bin_width) return false;
+
+            y = 0;
+            size_t end = index;
+            for(int left = width; left > 0; left -= skyline[end++].width) {
+                y = std::max(y, skyline[end].y);
+                if(y + height > bin_height) return false;
+            }
+
+            waste = 0;
+            for(size_t i = index; i < end; ++i) {
+                int covered = std::min(skyline[i].x + skyline[i].width, x + width) - skyline[i].x;
+                waste += static_cast<int64_t>(covered) * (y - skyline[i].y);
+            }
+
+            return true;
+        }
+
+        /** @brief Finds the best position with its left side on one of the given segments, in either orientation. */
+        template<typename T_scoring>
+        fit find_fit(int width, int height, size_t begin, size_t end, const T_scoring &scoring) const {
+            fit best;
+            auto visit = [&](int w, int h, bool flipped) {
+                for(size_t i = begin; i < end; ++i) {
+                    int y;
+                    int64_t waste;
+                    if(!fits(i, w, h, y, waste)) continue;
+
+                    fit candidate;
+                    candidate.node = {skyline[i].x, y, w, h};
+                    candidate.flipped = flipped;
+                    scoring.score(y, h, waste, candidate.score1, candidate.score2);
+
+                    if(candidate.better_than(best)) best = candidate;
+                }
+            };
+
+            visit(width, height, false);
+            if(allow_flip && width != height) visit(height, width, true);
+            return best;
+        }
+
+        /** @return The first segment that starts at or after the given position. */
+        inline size_t segment_at(int x) const {
+            return std::lower_bound(skyline.begin(), skyline.end(), x, [](const segment &s, int x) { return s.x < x; }) - skyline.begin();
+        }
+
+        /**
+         * @brief Raises the skyline over a rectangle, which must rest on the skyline with its left side at the start
+         * of a segment, such as a position found by `find_fit()`.
+         */
+        void place(const rect &node) {
+            size_t index = segment_at(node.x);
+            int right = node.x + node.width;
+            for(size_t i = index; i < skyline.size() && skyline[i].x < right; ++i) {
+                const segment &below = skyline[i];
+                if(below.y < node.y) waste.add_free_area({below.x, below.y, std::min(below.x + below.width, right) - below.x, node.y - below.y});
+            }
+
+            skyline.insert(skyline.begin() + index, {node.x, node.y + node.height, node.width});
+
+            // Cut the segments below the rectangle off, down to the one it ends in.
+            size_t end = index + 1;
+            while(end < skyline.size() && skyline[end].x + skyline[end].width <= right) ++end;
+            skyline.erase(skyline.begin() + index + 1, skyline.begin() + end);
+
+            if(index + 1 < skyline.size() && skyline[index + 1].x < right) {
+                skyline[index + 1].width -= right - skyline[index + 1].x;
+                skyline[index + 1].x = right;
+            }
+
+            // Merge with the neighbours at the same height.
+            if(index + 1 < skyline.size() && skyline[index + 1].y == skyline[index].y) {
+                skyline[index].width += skyline[index + 1].width;
+                skyline.erase(skyline.begin() + index + 1);
+            }
+
+            if(index > 0 && skyline[index - 1].y == skyline[index].y) {
+                skyline[index - 1].width += skyline[index].width;
+                skyline.erase(skyline.begin() + index);
+            }
+
+            add_used(node);
+        }
+
+        void add_used(const rect &node) {
+            used_rects.push_back(node);
+            used_area += static_cast<uint64_t>(node.width) * node.height;
+        }
+
+        /** @brief Inserts rectangles one at a time by decreasing area, leaving the ones that didn't fit in `rects`. */
+        void insert_largest_first(std::vector<rect_size> &rects, std::vector<rect> &dst, std::vector<int> &dst_ids, heuristic method) {
+            std::stable_sort(rects.begin(), rects.end(), [](const rect_size &a, const rect_size &b) {
+                return static_cast<int64_t>(a.width) * a.height > static_cast<int64_t>(b.width) * b.height;
+            });
+
+            std::vector<rect_size> left;
+            for(const rect_size &r : rects) {
+                rect node = insert(r.width, r.height, method);
+                if(node.height == 0) {
+                    left.push_back(r);
+                } else {
+                    dst.push_back(node);
+                    dst_ids.push_back(r.id);
+                }
+            }
+
+            rects = std::move(left);
+        }
+
+        /**
+         * @brief Packs pending rectangles into the waste map, largest first, until none of them fits. The skyline
+         * doesn't change, so the positions found on it for the others stay as they are.
+         */
+        void fill_waste(std::vector<rect_size> &rects, std::vector<fit> &fits, std::vector<rect> &dst, std::vector<int> &dst_ids) {
+            while(true) {
+                // Most pending rectangles are larger than any wasted area, which its widest and tallest sides tell.
+                int max_width = 0, max_height = 0;
+                for(const rect &r : waste.get_free_rects()) {
+                    max_width = std::max(max_width, r.width);
+                    max_height = std::max(max_height, r.height);
+                }
+
+                std::vector<size_t> candidates;
+                for(size_t i = 0; i < rects.size(); ++i) {
+                    int width = rects[i].width, height = rects[i].height;
+                    if((width <= max_width && height <= max_height) || (allow_flip && height <= max_width && width <= max_height)) candidates.push_back(i);
+                }
+
+                std::stable_sort(candidates.begin(), candidates.end(), [&](size_t a, size_t b) {
+                    return static_cast<int64_t>(rects[a].width) * rects[a].height > static_cast<int64_t>(rects[b].width) * rects[b].height;
+                });
+
+                size_t placed = rects.size();
+                for(size_t i : candidates) {
+                    rect node = waste.insert(rects[i].width, rects[i].height, guillotine_bin_pack::heuristic::best_short_side_fit);
+                    if(node.height == 0) continue;
+
+                    add_used(node);
+                    dst.push_back(node);
+                    dst_ids.push_back(rects[i].id);
+                    placed = i;
+                    break;
+                }
+
+                if(placed == rects.size()) return;
+
+                rects[placed] = rects.back();
+                fits[placed] = fits.back();
+                rects.pop_back();
+                fits.pop_back();
+            }
+        }
+
+        /**
+         * @brief Inserts the given list of rectangles in an offline/batch mode, keeping every pending rectangle's best
+         * position around between placements.
+         *
+         * A placement only changes the skyline over the span of the placed rectangle, so positions whose span doesn't
+         * reach it keep their scores. A rectangle whose best position does is searched from scratch; any other one only
+         * needs to be compared with the positions that start on the segments around the new one. Rectangles that
+         * didn't fit anywhere on the skyline never will, since it only rises, but they may still fit in the waste map,
+         * which is filled after every placement.
+         *
+         * @param scoring The placement scoring rule; one of the `*_scoring` structs.
+         */
+        template<typename T_scoring>
+        void insert_cached(std::vector<rect_size> &rects, std::vector<rect> &dst, std::vector<int> &dst_ids, const T_scoring &scoring) {
+            std::vector<fit> fits(rects.size());
+            for(size_t i = 0; i < rects.size(); ++i) fits[i] = find_fit(rects[i].width, rects[i].height, 0, skyline.size(), scoring);
+
+            while(true) {
+                size_t best = rects.size();
+                for(size_t i = 0; i < rects.size(); ++i) {
+                    if(fits[i].node.height && (best == rects.size() || fits[i].better_than(fits[best]))) best = i;
+                }
+
+                if(best == rects.size()) return;
+
+                rect node = fits[best].node;
+                place(node);
+                dst.push_back(node);
+                dst_ids.push_back(rects[best].id);
+
+                rects[best] = rects.back();
+                fits[best] = fits.back();
+                rects.pop_back();
+                fits.pop_back();
+
+                int left = node.x, right = node.x + node.width;
+                for(size_t i = 0; i < rects.size(); ++i) {
+                    fit &f = fits[i];
+                    if(!f.node.height) continue;
+
+                    // A position is affected if it spans the placed rectangle, or starts where a segment was merged.
+                    if(f.node.x + f.node.width > left && f.node.x <= right) {
+                        f = find_fit(rects[i].width, rects[i].height, 0, skyline.size(), scoring);
+                        continue;
+                    }
+
+                    int reach = std::max(rects[i].width, rects[i].height);
+                    fit around = find_fit(rects[i].width, rects[i].height, segment_at(left - reach + 1), segment_at(right + 1), scoring);
+                    if(around.better_than(f)) f = around;
+                }
+
+                fill_waste(rects, fits, dst, dst_ids);
+            }
+        }
+    };
+}
+
+#endif // !AV_PACKER_SKYLINE_HPP
@@ -0,0 +1,177 @@
+#include <av/util/graphics/block_decoder.hpp>
+#include <av/util/graphics/atlas_file.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+namespace av {
+    namespace {
+        /** @brief The 16 RGBA pixels of a block, row by row. */
+        using block_pixels = unsigned char[16][4];
+
+        /** @brief Reads the bits of a 16-byte block, from the lowest bit of the first byte up. */
+        class bit_reader {
+            uint64_t low = 0, high = 0;
+            int position = 0;
+
+            public:
+            bit_reader(const unsigned char *block) {
+                for(int i = 7; i >= 0; --i) {
+                    low = low << 8 | block[i];
+                    high = high << 8 | block[i + 8];
+                }
+            }
+
+            uint32_t read(int count) {
+                uint64_t bits = position >= 64 ? high >> (position - 64) : position ? low >> position | high << (64 - position) : low;
+                position += count;
+                return static_cast<uint32_t>(bits & ((uint64_t(1) << count) - 1));
+            }
+        };
+
+        /** @return A BC7 endpoint component of the given bit count, widened to 8 bits by repeating its top bits. */
+        inline unsigned char widen(uint32_t value, int bits) {
+            value <<= 8 - bits;
+            return static_cast<unsigned char>(value | value >> bits);
+        }
+
+        /** @return A BC7 color between two endpoints, given the weight of the second one out of 64. */
+        inline unsigned char blend(unsigned char a, unsigned char b, int weight) {
+            return static_cast<unsigned char>(((64 - weight) * a + weight * b + 32) >> 6);
+        }
+
+        constexpr int weights2[] = {0, 21, 43, 64};
+        constexpr int weights3[] = {0, 9, 18, 27, 37, 46, 55, 64};
+        constexpr int weights4[] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+        /** @return The weights of BC7 indices of the given bit count. */
+        inline const int *weights(int bits) {
+            return bits == 2 ? weights2 : bits == 3 ? weights3 : weights4;
+        }
+
+        /** @brief Reads the 16 indices of a single subset BC7 block; the first one has one bit less, its top bit being 0. */
+        void read_indices(bit_reader &bits, int count, int (&indices)[16]) {
+            indices[0] = static_cast<int>(bits.read(count - 1));
+            for(int i = 1; i < 16; ++i) indices[i] = static_cast<int>(bits.read(count));
+        }
+
+        void decode_color(const unsigned char *block, bool always_opaque, block_pixels &out) {
+            uint32_t c0 = block[0] | block[1] << 8, c1 = block[2] | block[3] << 8;
+            uint32_t indices = block[4] | block[5] << 8 | block[6] << 16 | static_cast<uint32_t>(block[7]) << 24;
+
+            unsigned char palette[4][4];
+            for(int i = 0; i < 2; ++i) {
+                uint32_t c = i ? c1 : c0;
+                uint32_t r = c >> 11 & 31, g = c >> 5 & 63, b = c & 31;
+                palette[i][0] = static_cast<unsigned char>(r << 3 | r >> 2);
+                palette[i][1] = static_cast<unsigned char>(g << 2 | g >> 4);
+                palette[i][2] = static_cast<unsigned char>(b << 3 | b >> 2);
+                palette[i][3] = 255;
+            }
+
+            for(int c = 0; c < 3; ++c) {
+                if(always_opaque || c0 > c1) {
+                    palette[2][c] = static_cast<unsigned char>((2 * palette[0][c] + palette[1][c]) / 3);
+                    palette[3][c] = static_cast<unsigned char>((palette[0][c] + 2 * palette[1][c]) / 3);
+                } else {
+                    palette[2][c] = static_cast<unsigned char>((palette[0][c] + palette[1][c]) / 2);
+                    palette[3][c] = 0;
+                }
+            }
+
+            palette[2][3] = 255;
+            palette[3][3] = always_opaque || c0 > c1 ? 255 : 0;
+            for(int i = 0; i < 16; ++i) std::memcpy(out[i], palette[indices >> (i * 2) & 3], 4);
+        }
+
+        void decode_alpha(const unsigned char *block, block_pixels &out) {
+            int a0 = block[0], a1 = block[1];
+            uint64_t indices = 0;
+            for(int i = 7; i >= 2; --i) indices = indices << 8 | block[i];
+
+            int palette[8] = {a0, a1};
+            if(a0 > a1) {
+                for(int i = 1; i < 7; ++i) palette[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+            } else {
+                for(int i = 1; i < 5; ++i) palette[i + 1] = ((5 - i) * a0 + i * a1) / 5;
+                palette[6] = 0;
+                palette[7] = 255;
+            }
+
+            for(int i = 0; i < 16; ++i) out[i][3] = static_cast<unsigned char>(palette[indices >> (i * 3) & 7]);
+        }
+
+        void decode_bc7(const unsigned char *block, block_pixels &out) {
+            int mode = 0;
+            while(mode < 8 && !(block[0] >> mode & 1)) ++mode;
+            if(mode < 4 || mode > 6) {
+                std::memset(out, 0, sizeof(out));
+                return;
+            }
+
+            bit_reader bits(block);
+            bits.read(mode + 1);
+
+            // Mode 6 has a shared lowest bit for every endpoint, modes 4 and 5 a rotation that swaps alpha with a
+            // color channel, and mode 4 has a selector for which of its two index sets the color uses.
+            int rotation = mode == 6 ? 0 : static_cast<int>(bits.read(2));
+            bool swap_indices = mode == 4 && bits.read(1);
+            int color_bits = mode == 4 ? 5 : 7, alpha_bits = mode == 4 ? 6 : mode == 5 ? 8 : 7;
+
+            uint32_t endpoints[2][4];
+            for(int c = 0; c < 4; ++c) for(int e = 0; e < 2; ++e) endpoints[e][c] = bits.read(c < 3 ? color_bits : alpha_bits);
+
+            unsigned char ends[2][4];
+            if(mode == 6) {
+                for(int e = 0; e < 2; ++e) {
+                    uint32_t low = bits.read(1);
+                    for(int c = 0; c < 4; ++c) ends[e][c] = static_cast<unsigned char>(endpoints[e][c] << 1 | low);
+                }
+            } else {
+                for(int e = 0; e < 2; ++e) for(int c = 0; c < 4; ++c) ends[e][c] = widen(endpoints[e][c], c < 3 ? color_bits : alpha_bits);
+            }
+
+            int color_indices[16], alpha_indices[16];
+            int color_index_bits = mode == 6 ? 4 : 2, alpha_index_bits = mode == 4 ? 3 : color_index_bits;
+            read_indices(bits, color_index_bits, color_indices);
+            if(mode != 6) read_indices(bits, alpha_index_bits, alpha_indices);
+            else std::memcpy(alpha_indices, color_indices, sizeof(color_indices));
+
+            if(swap_indices) {
+                std::swap(color_indices, alpha_indices);
+                std::swap(color_index_bits, alpha_index_bits);
+            }
+
+            const int *color_weights = weights(color_index_bits), *alpha_weights = weights(alpha_index_bits);
+            for(int i = 0; i < 16; ++i) {
+                for(int c = 0; c < 3; ++c) out[i][c] = blend(ends[0][c], ends[1][c], color_weights[color_indices[i]]);
+                out[i][3] = blend(ends[0][3], ends[1][3], alpha_weights[alpha_indices[i]]);
+                if(rotation) std::swap(out[i][3], out[i][rotation - 1]);
+            }
+        }
+    }
+
+    void decode_blocks(uint32_t format, const unsigned char *blocks, int width, int height, unsigned char *pixels) {
+        size_t block_size = atlas_view::block_size(format);
+        block_pixels decoded;
+
+        for(int y = 0; y < height; y += 4) {
+            for(int x = 0; x < width; x += 4, blocks += block_size) {
+                if(format == atlas_format_bc1) {
+                    decode_color(blocks, false, decoded);
+                } else if(format == atlas_format_bc3) {
+                    decode_color(blocks + 8, true, decoded);
+                    decode_alpha(blocks, decoded);
+                } else {
+                    decode_bc7(blocks, decoded);
+                }
+
+                // Blocks past the edges are only partially used.
+                for(int row = 0; row < std::min(4, height - y); ++row) {
+                    unsigned char *dst = pixels + (static_cast<size_t>(y + row) * width + x) * 4;
+                    std::memcpy(dst, decoded[row * 4], static_cast<size_t>(std::min(4, width - x)) * 4);
+                }
+            }
+        }
+    }
+}
@@ -7,6 +7,14 @@
 
 using namespace av; // I don't care.
 
+struct vertex {
+    float x, y;
+    float col;
+};
+
+using vertex_layout = layout<attr::pos_2D, attr::color_packed>;
+static_assert(vertex_layout::fits<vertex>, "Vertices must match their layout.");
+
 int main([[maybe_unused]] int argc, [[maybe_unused]] char *argv[]) {
     log::level = log_level::error;
     log::msg<log_level::debug>("Can't see me.");
@@ -24,12 +32,11 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char *argv[]) {
     if(!process.has_initialized()) return 1;
 
     class listener: public app_listener {
-        mesh model;
+        mesh<vertex_layout> model;
         shader model_shader;
 
         public:
         listener():
-            model({vert_attribute::pos_2D, vert_attribute::color_packed}),
             model_shader(R"(
 #version 150 core
 in vec2 a_pos;
@@ -51,16 +58,16 @@ void main() {
 
         protected:
         void init(app &) override {
-            float vertices[] = {
-                -1.0f, -1.0f, color(1.0f, 0.0f, 0.0f).float_bits(),
-                1.0f, -1.0f, color(0.0f, 1.0f, 0.0f).float_bits(),
-                1.0f, 1.0f, color(0.0f, 0.0f, 1.0f).float_bits(),
-                -1.0f, 1.0f, color(1.0f, 1.0f, 1.0f).float_bits()
+            vertex vertices[] = {
+                {-1.0f, -1.0f, color(1.0f, 0.0f, 0.0f).float_bits()},
+                {1.0f, -1.0f, color(0.0f, 1.0f, 0.0f).float_bits()},
+                {1.0f, 1.0f, color(0.0f, 0.0f, 1.0f).float_bits()},
+                {-1.0f, 1.0f, color(1.0f, 1.0f, 1.0f).float_bits()}
             };
 
             unsigned short elements[] = {0, 1, 2, 2, 3, 0};
 
-            model.set_vertices(vertices, 0, sizeof(vertices));
+            model.set_vertices(vertices, sizeof(vertices) / sizeof(vertex));
             model.set_elements(elements, 0, sizeof(elements));
 
             log::msg("Start test.");